@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "model.h"
+
+// each activation function as a compile time parameter, so the layer loops that use one
+// are instantiated for it and the function inlines, instead of an indirect call per value.
+// Derivative takes the activation value, not z.
+template <ActivationFunction A>
+struct activation;
+
+template <>
+struct activation<ActivationFunction::None>
+{
+    static real Apply(const real z) { return z; }
+    static real Derivative(const real) { return 1; }
+};
+
+template <>
+struct activation<ActivationFunction::Sigmoid>
+{
+    static real Apply(const real z) { return 1  / (1 + std::exp(-z)); }
+    static real Derivative(const real a) { return a * (1 - a); }
+};
+
+template <>
+struct activation<ActivationFunction::Relu>
+{
+    static real Apply(const real z) { return std::max(real(0), z); }
+    static real Derivative(const real a) { return (a > 0) ? real(1) : real(0); }
+};
+
+template <>
+struct activation<ActivationFunction::Softmax>
+{
+    // just return the input, it'll be classified later
+    static real Apply(const real z) { return z; }
+    static real Derivative(const real a) { return a * (1 - a); }
+};
+
+// calls f(activation<A>()) for the layer's activation function. dispatching once per
+// layer this way lets f be a generic lambda holding the whole loop.
+template <typename F>
+inline void withActivation(ActivationFunction aFunc, F&& f)
+{
+    switch (aFunc)
+    {
+        case ActivationFunction::Sigmoid: f(activation<ActivationFunction::Sigmoid>()); break;
+        case ActivationFunction::Relu: f(activation<ActivationFunction::Relu>()); break;
+        case ActivationFunction::Softmax: f(activation<ActivationFunction::Softmax>()); break;
+        default: f(activation<ActivationFunction::None>()); break;
+    }
+}
+
+// as with the activation functions, each cost function as a compile time parameter
+template <CostFunction C>
+struct cost;
+
+template <>
+struct cost<CostFunction::None>
+{
+    static real Apply(const real, const real) { return 0; }
+    static real Derivative(const real, const real) { return 0; }
+};
+
+template <>
+struct cost<CostFunction::MSE>
+{
+    // MSE cost function - whose derivative below is a simple addition!
+    static real Apply(const real predicted, const real target) { return real(0.5) * (predicted - target) * (predicted - target); }
+    static real Derivative(const real predicted, const real target) { return predicted - target; }
+};
+
+template <>
+struct cost<CostFunction::RMSE>
+{
+    static real Apply(const real predicted, const real target) { return std::sqrt(cost<CostFunction::MSE>::Apply(predicted, target)); }
+    static real Derivative(const real predicted, const real target) { return (predicted - target) / std::sqrt(real(2)); }
+};
+
+template <>
+struct cost<CostFunction::CrossEntropy>
+{
+    // un-used, since softmax is run over the entire array.
+    static real Apply(const real predicted, const real target) { return - target*std::exp(predicted); }
+    static real Derivative(const real predicted, const real target) { return predicted - target; }
+};
+
+// calls f(cost<C>()) for the cost function, as withActivation does
+template <typename F>
+inline void withCost(CostFunction cFunc, F&& f)
+{
+    switch (cFunc)
+    {
+        case CostFunction::MSE: f(cost<CostFunction::MSE>()); break;
+        case CostFunction::RMSE: f(cost<CostFunction::RMSE>()); break;
+        case CostFunction::CrossEntropy: f(cost<CostFunction::CrossEntropy>()); break;
+        default: f(cost<CostFunction::None>()); break;
+    }
+}
+
+// softmax over a single row of values, in place
+inline void softmaxInPlace(columnView values)
+{
+    const real maxInput = *std::max_element(values.begin(), values.end());
+    real sumExpValues = 0.0;
+    for (real& val : values)
+    {
+        val = std::exp(val - maxInput);
+        sumExpValues += val;
+    }
+    for (real& val : values)
+        val /= sumExpValues;
+}
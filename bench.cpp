@@ -0,0 +1,805 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "gemm.h"
+#include "kernels.h"
+#include "model.h"
+#include "quantized.h"
+#include "staticmodel.h"
+#include "trace.h"
+
+#pragma warning( disable : 4996 )
+
+// times the training and prediction paths over a grid of model shapes, on synthetic data,
+// and writes the results as json so two commits can be compared. for example:
+//
+//  bench --out before.json
+//  bench --baseline before.json --out after.json
+//
+// with --accuracy it instead trains the digits and CIFAR-10 models with each optimizer, and
+// reports the training time each takes to reach a fixed accuracy on the test set.
+
+// ------------------------------- synthetic data -------------------------------
+
+static uint32 mix(uint32 x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// pseudo random samples in 0-1, or one-hot classes, made as each row is read. nothing is
+// stored, so a run can cover millions of samples.
+struct syntheticSource : sampleSource
+{
+    syntheticSource(uint32 rows, uint32 cols, uint32 seed, bool oneHot)
+        : rows(rows), cols(cols), seed(seed), oneHot(oneHot) {}
+
+    uint32 Rows() const override { return rows; }
+    uint32 Cols() const override { return cols; }
+
+    constColumnView Row(uint32 r, columnView scratch) const override
+    {
+        const uint32 h = mix(r ^ seed);
+        for (uint32 c=0; c < cols; c++)
+        {
+            if (oneHot)
+                scratch[c] = (c == h % cols) ? real(1) : real(0);
+            else
+                scratch[c] = real(mix(h + c) & 0xffff) / 65535;
+        }
+        return constColumnView(scratch.data(), cols);
+    }
+
+    uint32 rows;
+    uint32 cols;
+    uint32 seed;
+    bool oneHot;
+};
+
+static matrix makeRows(const sampleSource& source, uint32 count)
+{
+    matrix values(count, column(source.Cols()));
+    for (uint32 r=0; r < count; r++)
+        source.Row(r, values[r]);
+    return values;
+}
+
+// ------------------------------- measurement -------------------------------
+
+struct benchOptions
+{
+    uint32 warmups = 1;
+    uint32 reps = 5;
+    uint32 threads = 1;
+    uint32 samples = 0;             // samples per repetition, 0 to size each one by its flops
+    double flopsPerRep = 2e8;
+    const char* filter = nullptr;
+    const char* out = "bench.json";
+    const char* baseline = nullptr;
+    const char* trace = nullptr;
+    const char* tune = nullptr;
+    const char* data = "Resources/Data";
+    bool quick = false;
+    bool accuracy = false;
+};
+
+struct benchResult
+{
+    std::string id;
+    uint32 samples;
+    double medianNs;                // per sample
+    double p99Ns;
+    double flopsPerSample;
+};
+
+struct benchShape
+{
+    uint32 width;
+    uint32 depth;
+    ActivationFunction aFunc;
+    uint32 batchSize;               // 0 for the paths that don't take mini-batches
+};
+
+const uint32 NumClasses = 10;
+
+static const char* activationName(ActivationFunction aFunc)
+{
+    switch (aFunc)
+    {
+        case ActivationFunction::Sigmoid: return "sigmoid";
+        case ActivationFunction::Relu: return "relu";
+        case ActivationFunction::Softmax: return "softmax";
+        default: return "none";
+    }
+}
+
+static std::string shapeId(const char* path, const benchShape& shape)
+{
+    char id[128];
+    if (shape.batchSize)
+        snprintf(id, sizeof(id), "%s/w%u/d%u/%s/b%u", path, shape.width, shape.depth, activationName(shape.aFunc), shape.batchSize);
+    else
+        snprintf(id, sizeof(id), "%s/w%u/d%u/%s", path, shape.width, shape.depth, activationName(shape.aFunc));
+    return id;
+}
+
+// spreads the weights over +-1/sqrt(inputs), so deep stacks stay finite over long runs
+static void initWeights(model& m)
+{
+    for (uint32 i=1; i < m.layers.size(); i++)
+    {
+        layer& current = *m.layers[i];
+        const uint32 fanIn = current.weights.cols;
+        const real range = 1 / std::sqrt(real(fanIn));
+        for (uint32 n=0; n < current.weights.rows; n++)
+        {
+            current.biases[n] = 0;
+            for (uint32 j=0; j < fanIn; j++)
+                current.weights[n][j] = range * (real(mix(i * 7919 + n * fanIn + j) & 0xffff) / 32767 - 1);
+        }
+    }
+}
+
+// width inputs, depth hidden layers of width neurons, then a softmax classifier
+static void buildModel(model& m, const benchShape& shape, uint32 threads)
+{
+    m.SetNumThreads(threads);
+    layer* l = m.AddInputLayer(shape.width);
+    for (uint32 d=0; d < shape.depth; d++)
+        l = m.AddDenseLayer(shape.width, shape.aFunc, l);
+    m.AddSoftmaxCrossEntropyLayer(NumClasses, l);
+    initWeights(m);
+}
+
+// multiply-adds counted as two flops. the backward pass also propagates errors into every
+// dense layer but the first.
+static double forwardsFlops(const model& m)
+{
+    double flops = 0;
+    for (uint32 l=1; l < m.layers.size(); l++)
+        flops += 2.0 * m.layers[l]->numInputs * m.layers[l]->numNeurons;
+    return flops;
+}
+
+static double backwardsFlops(const model& m)
+{
+    double flops = 0;
+    for (uint32 l=1; l < m.layers.size(); l++)
+        flops += 2.0 * m.layers[l]->numInputs * m.layers[l]->numNeurons * (l > 1 ? 2 : 1);
+    return flops;
+}
+
+static uint32 samplesFor(const benchOptions& options, double flopsPerSample, uint32 least)
+{
+    if (options.samples)
+        return options.samples;
+    const double samples = options.flopsPerRep / std::max(1.0, flopsPerSample);
+    return uint32(std::min(4.0e6, std::max(double(least), samples)));
+}
+
+// runs fn(samples) for the warm-ups, then times each repetition
+template <typename F>
+static void measure(
+    std::vector<benchResult>& results,
+    const benchOptions& options,
+    const std::string& id,
+    uint32 samples,
+    double flopsPerSample,
+    F&& fn)
+{
+    for (uint32 w=0; w < options.warmups; w++)
+        fn(samples);
+
+    std::vector<double> times;
+    for (uint32 r=0; r < options.reps; r++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        fn(samples);
+        const auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::nano>(end - start).count() / samples);
+    }
+    std::sort(times.begin(), times.end());
+
+    // nearest rank, so with a handful of repetitions p99 is the slowest one
+    benchResult result;
+    result.id = id;
+    result.samples = samples;
+    result.medianNs = times[times.size() / 2];
+    result.p99Ns = times[std::min(times.size() - 1, size_t(times.size() * 0.99))];
+    result.flopsPerSample = flopsPerSample;
+    results.push_back(result);
+
+    printf("%-36s %9u %12.1f %12.1f %14.0f %9.2f\n",
+        id.c_str(), samples, result.medianNs, result.p99Ns, 1e9 / result.medianNs, flopsPerSample / result.medianNs);
+    fflush(stdout);
+}
+
+// ------------------------------- benchmarks -------------------------------
+
+struct gemmShape
+{
+    uint32 m;
+    uint32 n;
+    uint32 k;
+    bool transposeA;
+    bool transposeB;
+};
+
+// the products of the first images layer at a batch of 256, then a square one
+static const gemmShape gemmShapes[] = {
+    { 256, 200, 3072, false, true },    // forwards, x * w^T
+    { 256, 3072, 200, false, false },   // errors, g * w
+    { 200, 3072, 256, true, false },    // weight gradients, g^T * x
+    { 1024, 1024, 1024, false, false },
+};
+
+static void benchGemm(std::vector<benchResult>& results, const benchOptions& options, const gemmShape& shape)
+{
+    char id[128];
+    snprintf(id, sizeof(id), "gemm/m%u/n%u/k%u/%c%c", shape.m, shape.n, shape.k, shape.transposeA ? 't' : 'n', shape.transposeB ? 't' : 'n');
+    if (options.filter && !strstr(id, options.filter))
+        return;
+
+    // stored as the layers store them, each row on a cache line
+    auto fill = [](alignedArray<real>& values, uint32 rows, uint32 cols, uint32 seed)
+    {
+        const uint32 stride = alignedCount<real>(cols);
+        values.Allocate(size_t(rows) * stride);
+        for (uint32 r=0; r < rows; r++)
+            for (uint32 c=0; c < cols; c++)
+                values.data()[size_t(r) * stride + c] = real(mix(seed + r * cols + c) & 0xffff) / 65535 - real(0.5);
+        return matrixView(values.data(), rows, cols, stride);
+    };
+    alignedArray<real> aValues, bValues, cValues, pack;
+    const matrixView a = shape.transposeA ? fill(aValues, shape.k, shape.m, 1) : fill(aValues, shape.m, shape.k, 1);
+    const matrixView b = shape.transposeB ? fill(bValues, shape.n, shape.k, 2) : fill(bValues, shape.k, shape.n, 2);
+    const matrixView c = fill(cValues, shape.m, shape.n, 3);
+    pack.Allocate(gemmPackSize(shape.n));
+
+    // one sample is one product
+    const double flops = 2.0 * shape.m * shape.n * shape.k;
+    measure(results, options, id, samplesFor(options, flops, 1), flops, [&](uint32 samples)
+    {
+        for (uint32 s=0; s < samples; s++)
+            gemm(a, shape.transposeA, b, shape.transposeB, c, false, columnView(pack.data(), uint32(pack.size())));
+    });
+}
+
+// the paths that don't depend on the mini-batch size
+static void benchPerSample(std::vector<benchResult>& results, const benchOptions& options, const benchShape& shape)
+{
+    const bool forwards = !options.filter || shapeId("forwards", shape).find(options.filter) != std::string::npos;
+    const bool backwards = !options.filter || shapeId("backwards", shape).find(options.filter) != std::string::npos;
+    const bool single = !options.filter || shapeId("predictSingle", shape).find(options.filter) != std::string::npos;
+    const bool batch = !options.filter || shapeId("predictBatch", shape).find(options.filter) != std::string::npos;
+    const bool quantized = !options.filter || shapeId("predictInt8", shape).find(options.filter) != std::string::npos;
+
+    model m;
+    buildModel(m, shape, options.threads);
+
+    // a small pool of rows, cycled through, so making the data isn't timed
+    const uint32 poolSize = 256;
+    const matrix inputs = makeRows(syntheticSource(poolSize, shape.width, 1, false), poolSize);
+    const matrix targets = makeRows(syntheticSource(poolSize, NumClasses, 2, true), poolSize);
+    column outputs(NumClasses);
+
+    const double fFlops = forwardsFlops(m);
+    const double bFlops = backwardsFlops(m);
+
+    if (forwards)
+    {
+        measure(results, options, shapeId("forwards", shape), samplesFor(options, fFlops, 256), fFlops, [&](uint32 samples)
+        {
+            for (uint32 s=0; s < samples; s++)
+                m.ForwardsPass(inputs[s % poolSize]);
+        });
+    }
+
+    if (backwards)
+    {
+        // the same forward pass is left in the layers, and a tiny learning rate keeps the
+        // weights from drifting far over many passes
+        m.ForwardsPass(inputs[0]);
+        measure(results, options, shapeId("backwards", shape), samplesFor(options, bFlops, 256), bFlops, [&](uint32 samples)
+        {
+            for (uint32 s=0; s < samples; s++)
+                m.BackwardsPass(targets[s % poolSize], 1e-6);
+        });
+    }
+
+    if (single)
+    {
+        measure(results, options, shapeId("predictSingle", shape), samplesFor(options, fFlops, 256), fFlops, [&](uint32 samples)
+        {
+            for (uint32 s=0; s < samples; s++)
+                m.PredictSingleInput(inputs[s % poolSize], outputs);
+        });
+    }
+
+    matrix predictions;
+    if (batch)
+    {
+        measure(results, options, shapeId("predictBatch", shape), samplesFor(options, fFlops, poolSize) / poolSize * poolSize, fFlops, [&](uint32 samples)
+        {
+            for (uint32 s=0; s < samples; s += poolSize)
+                m.PredictBatch(inputs, predictions);
+        });
+    }
+
+    if (quantized)
+    {
+        quantizedModel q;
+        q.SetNumThreads(options.threads);
+        q.Build(m, matrixSource(inputs));
+        measure(results, options, shapeId("predictInt8", shape), samplesFor(options, fFlops, poolSize) / poolSize * poolSize, fFlops, [&](uint32 samples)
+        {
+            for (uint32 s=0; s < samples; s += poolSize)
+                q.PredictBatch(inputs, predictions);
+        });
+    }
+}
+
+static void benchTrain(std::vector<benchResult>& results, const benchOptions& options, const benchShape& shape)
+{
+    const std::string id = shapeId("train", shape);
+    if (options.filter && id.find(options.filter) == std::string::npos)
+        return;
+
+    model m;
+    buildModel(m, shape, options.threads);
+
+    // the samples are made as they are read, which is timed along with the training
+    const double flops = forwardsFlops(m) + backwardsFlops(m);
+    const uint32 samples = samplesFor(options, flops, std::max(256u, shape.batchSize * 4));
+    const syntheticSource inputs(samples, shape.width, 3, false);
+    const syntheticSource targets(samples, NumClasses, 4, true);
+
+    measure(results, options, id, samples, flops, [&](uint32)
+    {
+        m.Train(inputs, targets, 1, 0.01, shape.batchSize);
+    });
+}
+
+// the 2-8-3 sigmoid model main.cpp draws, as a model and as a staticModel
+static void benchSmall(std::vector<benchResult>& results, const benchOptions& options)
+{
+    using smallModel = staticModel<2,
+        staticLayer<8, ActivationFunction::Sigmoid>,
+        staticLayer<3, ActivationFunction::Sigmoid>>;
+
+    model m;
+    m.SetNumThreads(options.threads);
+    smallModel::AddLayers(m);
+    smallModel s;
+    s.CopyFrom(m);
+
+    // main.cpp's grid of 80 x 80 points, predicted every frame
+    const uint32 poolSize = 80 * 80;
+    const matrix inputs = makeRows(syntheticSource(poolSize, 2, 5, false), poolSize);
+    const matrix targets = makeRows(syntheticSource(poolSize, 3, 6, true), poolSize);
+    column outputs(3);
+    matrix predictions;
+
+    const double fFlops = forwardsFlops(m);
+    const double tFlops = fFlops + backwardsFlops(m);
+    auto run = [&](const char* id, double flops, uint32 least, const std::function<void(uint32)>& f)
+    {
+        if (!options.filter || strstr(id, options.filter))
+            measure(results, options, id, samplesFor(options, flops, least) / least * least, flops, f);
+    };
+
+    run("small/model/predictSingle", fFlops, 1, [&](uint32 samples)
+    {
+        for (uint32 i=0; i < samples; i++)
+            m.PredictSingleInput(inputs[i % poolSize], outputs);
+    });
+    run("small/static/predictSingle", fFlops, 1, [&](uint32 samples)
+    {
+        for (uint32 i=0; i < samples; i++)
+            s.PredictSingleInput(inputs[i % poolSize], outputs);
+    });
+    run("small/model/predictBatch", fFlops, poolSize, [&](uint32 samples)
+    {
+        for (uint32 i=0; i < samples; i += poolSize)
+            m.PredictBatch(inputs, predictions);
+    });
+    run("small/static/predictBatch", fFlops, poolSize, [&](uint32 samples)
+    {
+        for (uint32 i=0; i < samples; i += poolSize)
+            s.PredictBatch(inputs, predictions);
+    });
+    run("small/model/train", tFlops, poolSize, [&](uint32 samples)
+    {
+        for (uint32 i=0; i < samples; i += poolSize)
+            m.Train(inputs, targets, 1, 0.01);
+    });
+    run("small/static/train", tFlops, poolSize, [&](uint32 samples)
+    {
+        for (uint32 i=0; i < samples; i += poolSize)
+            s.Train(inputs, targets, 1, 0.01);
+    });
+}
+
+// ------------------------------- time to accuracy -------------------------------
+
+struct accuracyResult
+{
+    std::string id;
+    double target;
+    double accuracy;                // on the test set when training stopped
+    uint32 epochs;
+    double seconds;                 // training only, not the evaluations between epochs
+    bool reached;
+};
+
+struct benchOptimizer
+{
+    const char* name;
+    OptimizerKind kind;
+    double learningRate;
+    double weightDecay;
+};
+
+// each at a learning rate that suits it on these models
+static const benchOptimizer benchOptimizers[] = {
+    { "sgd", OptimizerKind::SGD, 0.1, 0 },
+    { "momentum", OptimizerKind::Momentum, 0.02, 0 },
+    { "nesterov", OptimizerKind::Nesterov, 0.02, 0 },
+    { "adam", OptimizerKind::Adam, 0.003, 0 },
+    { "adamw", OptimizerKind::AdamW, 0.003, 0.01 },
+};
+
+const uint32 AccuracyBatchSize = 32;
+
+// the 8x8 digits: a row of 64 values from 0 to 16 per sample in one file, the digit in another
+static bool loadDigits(const std::string& featuresFile, const std::string& labelsFile, matrix& inputs, std::vector<uint32>& labels)
+{
+    FILE* features = fopen(featuresFile.c_str(), "r");
+    FILE* digits = fopen(labelsFile.c_str(), "r");
+    bool ok = features && digits;
+    int label;
+    while (ok && fscanf(digits, "%d", &label) == 1)
+    {
+        column row(64);
+        for (uint32 c=0; c < 64 && ok; c++)
+        {
+            int value;
+            ok = fscanf(features, "%d", &value) == 1;
+            row[c] = real(value) / 16;
+        }
+        ok = ok && label >= 0 && label < int(NumClasses);
+        inputs.push_back(row);
+        labels.push_back(uint32(label));
+    }
+    if (features)
+        fclose(features);
+    if (digits)
+        fclose(digits);
+    return ok && !labels.empty();
+}
+
+static matrix oneHot(const std::vector<uint32>& labels)
+{
+    matrix targets(labels.size(), column(NumClasses, 0));
+    for (size_t r=0; r < labels.size(); r++)
+        targets[r][labels[r]] = 1;
+    return targets;
+}
+
+// adds the layers of a model up to its classifier, returning the last of them
+using layerBuilder = std::function<layer*(model&)>;
+
+// numInputs, then relu layers of the hidden widths
+static layerBuilder denseLayers(uint32 numInputs, std::vector<uint32> hidden)
+{
+    return [=](model& m)
+    {
+        layer* l = m.AddInputLayer(numInputs);
+        for (const uint32 width : hidden)
+            l = m.AddDenseLayer(width, ActivationFunction::Relu, l);
+        return l;
+    };
+}
+
+// two rounds of 3x3 convolutions and 2x2 max pooling over the images, then a relu layer
+static layer* convLayers(model& m)
+{
+    imageShape image;
+    image.width = 32;
+    image.height = 32;
+    image.channels = 3;
+    imageWindow filter;
+    filter.size = 3;
+    filter.padding = 1;
+    imageWindow pool;
+    pool.size = 2;
+    pool.stride = 2;
+
+    layer* l = m.AddInputLayer(image);
+    l = m.AddConvLayer(16, filter, ActivationFunction::Relu, l);
+    l = m.AddPoolLayer(LayerKind::MaxPool, pool, l);
+    l = m.AddConvLayer(32, filter, ActivationFunction::Relu, l);
+    l = m.AddPoolLayer(LayerKind::MaxPool, pool, l);
+    return m.AddDenseLayer(64, ActivationFunction::Relu, l);
+}
+
+// trains a model with each optimizer in turn, an epoch at a time, until it reaches the
+// target accuracy or runs out of epochs
+static void timeToAccuracy(
+    std::vector<accuracyResult>& results,
+    const benchOptions& options,
+    const char* dataset,
+    const layerBuilder& addLayers,
+    const sampleSource& inputs,
+    const sampleSource& targets,
+    const sampleSource& testInputs,
+    const sampleSource& testTargets,
+    double target,
+    uint32 maxEpochs)
+{
+    for (const benchOptimizer& o : benchOptimizers)
+    {
+        const std::string id = std::string("accuracy/") + dataset + "/" + o.name;
+        if (options.filter && id.find(options.filter) == std::string::npos)
+            continue;
+
+        model m;
+        m.SetNumThreads(options.threads);
+        m.AddSoftmaxCrossEntropyLayer(NumClasses, addLayers(m));
+        initWeights(m);
+
+        optimizer settings;
+        settings.kind = o.kind;
+        settings.weightDecay = o.weightDecay;
+        m.SetOptimizer(settings);
+
+        accuracyResult result = { id, target, 0, 0, 0, false };
+        while (result.epochs < maxEpochs && !result.reached)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            m.Train(inputs, targets, 1, o.learningRate, AccuracyBatchSize);
+            result.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            result.epochs++;
+            result.accuracy = m.Evaluate(testInputs, testTargets).Accuracy();
+            result.reached = result.accuracy >= target;
+        }
+        results.push_back(result);
+
+        printf("%-36s %8.3f %8.3f %8u %10.3f%s\n",
+            id.c_str(), target, result.accuracy, result.epochs, result.seconds, result.reached ? "" : "  not reached");
+        fflush(stdout);
+    }
+}
+
+static void benchAccuracy(std::vector<accuracyResult>& results, const benchOptions& options)
+{
+    printf("%-36s %8s %8s %8s %10s\n", "time to accuracy", "target", "reached", "epochs", "seconds");
+
+    const std::string dir = options.data;
+    matrix digits, testDigits;
+    std::vector<uint32> digitLabels, testDigitLabels;
+    if (loadDigits(dir + "/train_features.txt", dir + "/train_output.txt", digits, digitLabels) &&
+        loadDigits(dir + "/test_features.txt", dir + "/test_output.txt", testDigits, testDigitLabels))
+    {
+        const matrix targets = oneHot(digitLabels);
+        const matrix testTargets = oneHot(testDigitLabels);
+        timeToAccuracy(results, options, "digits", denseLayers(64, { 128 }), matrixSource(digits), matrixSource(targets),
+            matrixSource(testDigits), matrixSource(testTargets), 0.95, options.quick ? 10 : 40);
+    }
+    else
+        printf("skipping digits, can't load them from %s\n", options.data);
+
+    const std::string batches[] = { dir + "/data_batch_1.bin", dir + "/data_batch_2.bin", dir + "/data_batch_3.bin",
+        dir + "/data_batch_4.bin", dir + "/data_batch_5.bin", dir + "/test_batch.bin" };
+    imageSet images;
+    imageSet testImages;
+    if (images.Load({ batches[0].c_str(), batches[1].c_str(), batches[2].c_str(), batches[3].c_str(), batches[4].c_str() }) &&
+        testImages.Load({ batches[5].c_str() }))
+    {
+        // the whole test set, straight from the bytes
+        timeToAccuracy(results, options, "cifar", denseLayers(images.Cols(), { 200, 150 }), images, images.Categories(),
+            testImages, testImages.Categories(), 0.40, options.quick ? 3 : 15);
+        timeToAccuracy(results, options, "cifar-conv", convLayers, images, images.Categories(),
+            testImages, testImages.Categories(), 0.40, options.quick ? 3 : 15);
+    }
+    else
+        printf("skipping cifar, can't load the CIFAR-10 batches from %s\n", options.data);
+}
+
+// ------------------------------- results -------------------------------
+
+// one result per line, so a baseline can be read back without a json parser
+static bool writeResults(const char* filename, const std::vector<benchResult>& results, const std::vector<accuracyResult>& accuracies, const benchOptions& options)
+{
+    FILE* fp = fopen(filename, "w");
+    if (!fp)
+        return false;
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"real\": \"%s\",\n", sizeof(real) == 4 ? "float" : "double");
+    fprintf(fp, "  \"kernels\": \"%s\",\n", activeKernels().name);
+    fprintf(fp, "  \"int8_kernels\": \"%s\",\n", activeInt8Kernels().name);
+    fprintf(fp, "  \"threads\": %u,\n", options.threads);
+    fprintf(fp, "  \"reps\": %u,\n", options.reps);
+    fprintf(fp, "  \"results\": [\n");
+    for (size_t i=0; i < results.size(); i++)
+    {
+        const benchResult& r = results[i];
+        fprintf(fp, "    { \"id\": \"%s\", \"samples\": %u, \"median_ns\": %.2f, \"p99_ns\": %.2f, \"samples_per_sec\": %.1f, \"gflops\": %.3f }%s\n",
+            r.id.c_str(), r.samples, r.medianNs, r.p99Ns, 1e9 / r.medianNs, r.flopsPerSample / r.medianNs,
+            (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(fp, "  ],\n");
+    fprintf(fp, "  \"time_to_accuracy\": [\n");
+    for (size_t i=0; i < accuracies.size(); i++)
+    {
+        const accuracyResult& r = accuracies[i];
+        fprintf(fp, "    { \"id\": \"%s\", \"target\": %.3f, \"reached\": %s, \"accuracy\": %.4f, \"epochs\": %u, \"seconds\": %.3f }%s\n",
+            r.id.c_str(), r.target, r.reached ? "true" : "false", r.accuracy, r.epochs, r.seconds,
+            (i + 1 < accuracies.size()) ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    return fclose(fp) == 0;
+}
+
+// prints how each result compares with the same id in an earlier run
+static void compareBaseline(const char* filename, const std::vector<benchResult>& results)
+{
+    FILE* fp = fopen(filename, "r");
+    if (!fp)
+    {
+        printf("can't read the baseline %s\n", filename);
+        return;
+    }
+
+    printf("\n%-36s %12s %12s %8s\n", "against", "was ns", "now ns", "change");
+    char line[512];
+    while (fgets(line, sizeof(line), fp))
+    {
+        const char* id = strstr(line, "\"id\": \"");
+        const char* median = strstr(line, "\"median_ns\": ");
+        if (!id || !median)
+            continue;
+        id += strlen("\"id\": \"");
+        const char* idEnd = strchr(id, '"');
+        if (!idEnd)
+            continue;
+
+        const std::string name(id, idEnd);
+        const double was = atof(median + strlen("\"median_ns\": "));
+        for (const benchResult& r : results)
+        {
+            if (r.id == name && was > 0)
+                printf("%-36s %12.1f %12.1f %+7.1f%%\n", name.c_str(), was, r.medianNs, 100 * (r.medianNs - was) / was);
+        }
+    }
+    fclose(fp);
+}
+
+// ------------------------------- main -------------------------------
+
+static int usage()
+{
+    printf("usage: bench [--quick] [--accuracy] [--data dir] [--reps n] [--warmups n] [--threads n] [--samples n] [--filter text] [--out file] [--baseline file] [--trace file] [--tune file]\n");
+    printf("  --quick     a smaller grid and less work per repetition\n");
+    printf("  --accuracy  time each optimizer to a fixed test accuracy on the digits and CIFAR-10, not the grid\n");
+    printf("  --data      where the datasets are, Resources/Data by default\n");
+    printf("  --threads   threads for training and batched prediction, 0 for one per core\n");
+    printf("  --samples   samples per repetition, otherwise sized so each does about the same work\n");
+    printf("  --filter    only the benchmarks whose id contains the text, e.g. train/w256\n");
+    printf("  --out       where the results are written, bench.json by default\n");
+    printf("  --baseline  results from an earlier run to compare against\n");
+    printf("  --trace     records the passes and layers, and writes them as chrome trace json\n");
+    printf("  --tune      times the gemm plans for each product shape first, keeping the winners in the file\n");
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    benchOptions options;
+    for (int a=1; a < argc; a++)
+    {
+        const bool hasValue = a + 1 < argc;
+        if (strcmp(argv[a], "--quick") == 0)
+            options.quick = true;
+        else if (strcmp(argv[a], "--accuracy") == 0)
+            options.accuracy = true;
+        else if (strcmp(argv[a], "--data") == 0 && hasValue)
+            options.data = argv[++a];
+        else if (strcmp(argv[a], "--reps") == 0 && hasValue)
+            options.reps = std::max(1, atoi(argv[++a]));
+        else if (strcmp(argv[a], "--warmups") == 0 && hasValue)
+            options.warmups = uint32(std::max(0, atoi(argv[++a])));
+        else if (strcmp(argv[a], "--threads") == 0 && hasValue)
+            options.threads = uint32(std::max(0, atoi(argv[++a])));
+        else if (strcmp(argv[a], "--samples") == 0 && hasValue)
+            options.samples = uint32(std::max(0, atoi(argv[++a])));
+        else if (strcmp(argv[a], "--filter") == 0 && hasValue)
+            options.filter = argv[++a];
+        else if (strcmp(argv[a], "--out") == 0 && hasValue)
+            options.out = argv[++a];
+        else if (strcmp(argv[a], "--baseline") == 0 && hasValue)
+            options.baseline = argv[++a];
+        else if (strcmp(argv[a], "--trace") == 0 && hasValue)
+            options.trace = argv[++a];
+        else if (strcmp(argv[a], "--tune") == 0 && hasValue)
+            options.tune = argv[++a];
+        else
+            return usage();
+    }
+
+    std::vector<uint32> widths = { 64, 256, 1024 };
+    std::vector<uint32> depths = { 1, 3 };
+    std::vector<uint32> batchSizes = { 1, 32, 256 };
+    std::vector<ActivationFunction> activations = { ActivationFunction::Sigmoid, ActivationFunction::Relu };
+    if (options.quick)
+    {
+        widths = { 64, 256 };
+        depths = { 2 };
+        batchSizes = { 1, 32 };
+        activations = { ActivationFunction::Relu };
+        options.flopsPerRep /= 10;
+    }
+
+    printf("kernels %s, int8 kernels %s, %s, %u threads\n",
+        activeKernels().name, activeInt8Kernels().name, sizeof(real) == 4 ? "float" : "double", options.threads);
+
+    if (options.tune && !setGemmTuning(true, options.tune))
+        printf("can't write the tuning cache %s, tuning without one\n", options.tune);
+
+    // each thread keeps only its latest events, so a long run traces its last benchmarks
+    if (options.trace)
+        setTracing(true);
+
+    std::vector<benchResult> results;
+    std::vector<accuracyResult> accuracies;
+    if (options.accuracy)
+        benchAccuracy(accuracies, options);
+    else
+    {
+        printf("%-36s %9s %12s %12s %14s %9s\n", "benchmark", "samples", "median ns", "p99 ns", "samples/s", "GFLOP/s");
+        for (const gemmShape& shape : gemmShapes)
+            benchGemm(results, options, shape);
+        benchSmall(results, options);
+        for (const uint32 width : widths)
+        {
+            for (const uint32 depth : depths)
+            {
+                for (const ActivationFunction aFunc : activations)
+                {
+                    benchPerSample(results, options, { width, depth, aFunc, 0 });
+                    for (const uint32 batchSize : batchSizes)
+                        benchTrain(results, options, { width, depth, aFunc, batchSize });
+                }
+            }
+        }
+    }
+
+    if (options.tune)
+        printf("tuned %u gemm shapes into %s\n", gemmShapesTuned(), options.tune);
+
+    if (options.baseline)
+        compareBaseline(options.baseline, results);
+
+    if (options.trace && !writeTrace(options.trace))
+        printf("can't write the trace to %s\n", options.trace);
+
+    if (!writeResults(options.out, results, accuracies, options))
+    {
+        printf("can't write %s\n", options.out);
+        return 1;
+    }
+    printf("wrote %zu results to %s\n", results.size() + accuracies.size(), options.out);
+    return 0;
+}
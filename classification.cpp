@@ -1,67 +1,131 @@
 #include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 
 #include "model.h"
 
 #pragma warning( disable : 4996 )
 
 const uint32 numCategories = 10;
-const double loadFactor = double(1)/16;
+const real loadFactor = real(1)/16;
+const uint32 batchSize = 16;
 
-void loadFile(const char* filename, matrix& output, const uint32 columns, const uint32 rows, const double factor)
+bool loadFile(const char* filename, matrix& output, const uint32 columns, const uint32 rows, const real factor)
 {
     output.resize(rows);
 
     FILE *fp = fopen(filename,"r");
+    if (!fp)
+        return false;
 
-    for(uint32 r=0; r < rows; r++)
+    bool ok = true;
+    for(uint32 r=0; r < rows && ok; r++)
     {
         output[r].resize(columns);
-        for (uint32 c = 0; c < columns; c++)
+        for (uint32 c = 0; c < columns && ok; c++)
         {
             int value;
-            fscanf(fp, "%d ", &value);
-            output[r][c] = double(value * factor);
+            ok = fscanf(fp, "%d ", &value) == 1;
+            output[r][c] = real(value * factor);
         }
     }
     fclose(fp);
+    return ok;
 }
 
 int main(int, char**)
 {
+    // the tensor files from convert_data are mapped in place, with nothing to parse:
+    //  convert_data Resources/Data/train_features.txt Resources/Data/train_features.bin 64
+    //  convert_data Resources/Data/train_output.txt Resources/Data/train_output.bin 1 --onehot 10
+    // without them, fall back to parsing the start of the text files.
+    tensorFile features;
+    tensorFile classes;
+    const bool mapped = features.Open("Resources/Data/train_features.bin") && classes.Open("Resources/Data/train_output.bin");
+
     matrix allInputs;
     matrix allOutputs;
-    matrix test_inputs;
-    matrix test_outputs;
+    matrix hotEncodedOutputs;
+    if (!mapped)
+    {
+        printf("no tensor files, training on the first 200 rows of the text files\n");
 
-    std::vector<int>train_classes_outputs; 
-    std::vector<int>test_classes_outputs;
+        //3823 
+        if (!loadFile("Resources/Data/train_features.txt", allInputs, 64, 200, 1) ||
+            !loadFile("Resources/Data/train_output.txt", allOutputs, 1, 200, 1))
+        {
+            printf("can't load the training data\n");
+            return 1;
+        }
 
-    //3823 
-    loadFile("Resources/Data/train_features.txt", allInputs, 64, 200, 1);
-    loadFile("Resources/Data/train_output.txt", allOutputs, 1, 200, 1);
-    
-    //1797
-    loadFile("Resources/Data/train_features.txt", test_inputs, 64, 200, 1);
-    loadFile("Resources/Data/train_output.txt", test_outputs, 1, 200, 1);
+        hotEncodedOutputs.resize(allOutputs.size());
+        for (uint32 r = 0; r < allOutputs.size(); r++)
+        {
+            hotEncodedOutputs[r].resize(numCategories, 0);
+            hotEncodedOutputs[r][ uint32(allOutputs[r][0]) ] = 1;
+        }
+    }
+
+    const matrixSource textInputs(allInputs);
+    const matrixSource textOutputs(hotEncodedOutputs);
+    const sampleSource& inputs = mapped ? static_cast<const sampleSource&>(features) : textInputs;
+    const sampleSource& outputs = mapped ? static_cast<const sampleSource&>(classes) : textOutputs;
 
-    matrix hotEncodedOutputs(allOutputs.size());
-    for (uint32 r = 0; r < allOutputs.size(); r++)
+    // the held out digits, scored after every epoch
+    matrix testInputs;
+    matrix testOutputs;
+    matrix hotEncodedTestOutputs;
+    const bool testing = loadFile("Resources/Data/test_features.txt", testInputs, 64, 1797, 1) &&
+        loadFile("Resources/Data/test_output.txt", testOutputs, 1, 1797, 1);
+    if (testing)
     {
-        hotEncodedOutputs[r].resize(numCategories, 0);
-        hotEncodedOutputs[r][ uint32(allOutputs[r][0]) ] = 1;
+        hotEncodedTestOutputs.resize(testOutputs.size());
+        for (uint32 r = 0; r < testOutputs.size(); r++)
+        {
+            hotEncodedTestOutputs[r].resize(numCategories, 0);
+            hotEncodedTestOutputs[r][ uint32(testOutputs[r][0]) ] = 1;
+        }
     }
+    else
+        printf("can't load the test data, training without scoring it\n");
 
     model m;
+    m.SetNumThreads(0); // one per core
     layer* l = m.AddInputLayer(64);
     l = m.AddDenseLayer(200, ActivationFunction::Sigmoid, l);
     l = m.AddDenseLayer(100, ActivationFunction::Relu, l);
-    l = m.AddDenseLayer(10, ActivationFunction::Softmax, l);
+    l = m.AddSoftmaxCrossEntropyLayer(10, l);
 
     for (int i = 0; i < 20; i++)
     {
-        m.Train(allInputs, hotEncodedOutputs, 1, 0.1);
-        printf("loss: %f\n", m.loss);
+        m.Train(inputs, outputs, 1, 0.1, batchSize);
+        if (!testing)
+        {
+            printf("loss: %f\n", m.loss);
+            continue;
+        }
+
+        const evaluation tested = m.Evaluate(testInputs, hotEncodedTestOutputs, 3);
+        printf("loss: %f, test accuracy %.3f, top %u %.3f, test loss %.4f\n",
+            m.loss, tested.Accuracy(), tested.topK, tested.TopKAccuracy(), tested.loss);
+    }
+
+    // which digits get taken for which, from the last epoch
+    if (testing)
+    {
+        const evaluation tested = m.Evaluate(testInputs, hotEncodedTestOutputs);
+        printf("confusion, actual down and predicted across:\n");
+        for (uint32 actual=0; actual < numCategories; actual++)
+        {
+            for (uint32 predicted=0; predicted < numCategories; predicted++)
+                printf("%5u", tested.Confusion(actual, predicted));
+            printf("\n");
+        }
     }
+
+    if (!m.Save("classification.model"))
+        printf("can't save the model\n");
     
     return 1;
-}
\ No newline at end of file
+}
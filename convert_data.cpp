@@ -0,0 +1,110 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "dataset.h"
+
+#pragma warning( disable : 4996 )
+
+// converts a text file of whitespace separated numbers into a tensor file, so the
+// apps can map their data instead of parsing it on every run. for example:
+//
+//  convert_data Resources/Data/train_features.txt Resources/Data/train_features.bin 64
+//  convert_data Resources/Data/train_output.txt Resources/Data/train_output.bin 1 --onehot 10
+
+static int usage()
+{
+    printf("usage: convert_data <input.txt> <output.bin> <columns> [--scale s] [--onehot n] [--type float32|float64|uint8]\n");
+    printf("  --scale   multiplies every value by s\n");
+    printf("  --onehot  turns a single column of class indices into n columns of 0s and a 1\n");
+    printf("  --type    how values are stored, float32 by default\n");
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+        return usage();
+
+    const char* inputName = argv[1];
+    const char* outputName = argv[2];
+    const uint32 columns = uint32(atoi(argv[3]));
+    double scale = 1;
+    uint32 oneHot = 0;
+    TensorType type = TensorType::Float32;
+
+    for (int a=4; a < argc; a++)
+    {
+        if (strcmp(argv[a], "--scale") == 0 && a + 1 < argc)
+            scale = atof(argv[++a]);
+        else if (strcmp(argv[a], "--onehot") == 0 && a + 1 < argc)
+            oneHot = uint32(atoi(argv[++a]));
+        else if (strcmp(argv[a], "--type") == 0 && a + 1 < argc)
+        {
+            a++;
+            if (strcmp(argv[a], "float32") == 0) type = TensorType::Float32;
+            else if (strcmp(argv[a], "float64") == 0) type = TensorType::Float64;
+            else if (strcmp(argv[a], "uint8") == 0) type = TensorType::UInt8;
+            else return usage();
+        }
+        else
+            return usage();
+    }
+
+    if (columns == 0 || (oneHot && columns != 1))
+        return usage();
+
+    FILE* fp = fopen(inputName, "r");
+    if (!fp)
+    {
+        printf("can't open %s\n", inputName);
+        return 1;
+    }
+
+    std::vector<double> values;
+    double value;
+    while (fscanf(fp, "%lf", &value) == 1)
+        values.push_back(value);
+    const bool readAll = feof(fp) != 0;
+    fclose(fp);
+
+    if (!readAll || values.size() % columns != 0)
+    {
+        printf("%s doesn't hold rows of %u numbers\n", inputName, columns);
+        return 1;
+    }
+
+    const uint32 rows = uint32(values.size() / columns);
+    uint32 outputColumns = columns;
+    if (oneHot)
+    {
+        std::vector<double> encoded(size_t(rows) * oneHot, 0);
+        for (uint32 r=0; r < rows; r++)
+        {
+            const int c = int(values[r]);
+            if (c < 0 || c >= int(oneHot))
+            {
+                printf("class %d in row %u is out of range\n", c, r);
+                return 1;
+            }
+            encoded[size_t(r) * oneHot + c] = 1;
+        }
+        values.swap(encoded);
+        outputColumns = oneHot;
+    }
+    else
+    {
+        for (double& v : values)
+            v *= scale;
+    }
+
+    if (!WriteTensorFile(outputName, type, rows, outputColumns, values.data()))
+    {
+        printf("can't write %s\n", outputName);
+        return 1;
+    }
+
+    printf("wrote %u x %u to %s\n", rows, outputColumns, outputName);
+    return 0;
+}
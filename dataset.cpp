@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "dataset.h"
+#include "kernels.h"
+#include "trace.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#pragma warning( disable : 4996 )
+
+// ------------------------------- sampleSource -------------------------------
+
+void readRow(const sampleSource& source, uint32 r, columnView dst)
+{
+    const constColumnView row = source.Row(r, dst);
+    if (row.data() != dst.data())
+        std::copy(row.begin(), row.end(), dst.begin());
+}
+
+// ------------------------------- sparseSource -------------------------------
+
+sparseSource::sparseSource(const matrix& rows)
+    : cols(rows.empty() ? 0 : uint32(rows.front().size()))
+    , rowStarts(1, 0)
+{
+    for (const column& row : rows)
+    {
+        assert(row.size() == cols);
+        for (uint32 c=0; c < cols; c++)
+        {
+            if (row[c] != 0)
+            {
+                indices.push_back(c);
+                values.push_back(row[c]);
+            }
+        }
+        rowStarts.push_back(uint32(indices.size()));
+    }
+}
+
+void sparseSource::AddRow(const uint32* rowIndices, const real* rowValues, uint32 count)
+{
+    for (uint32 i=0; i < count; i++)
+    {
+        assert(rowIndices[i] < cols && (i == 0 || rowIndices[i] > rowIndices[i-1]));
+        indices.push_back(rowIndices[i]);
+        values.push_back(rowValues[i]);
+    }
+    rowStarts.push_back(uint32(indices.size()));
+}
+
+constColumnView sparseSource::Row(uint32 r, columnView scratch) const
+{
+    assert(r < Rows() && scratch.size() >= cols);
+    std::fill(scratch.begin(), scratch.begin() + cols, real(0));
+    for (uint32 i = rowStarts[r]; i < rowStarts[r + 1]; i++)
+        scratch[indices[i]] = values[i];
+    return constColumnView(scratch.data(), cols);
+}
+
+bool sparseSource::SparseRow(uint32 r, sparseRow& row) const
+{
+    assert(r < Rows());
+    row.indices = indices.data() + rowStarts[r];
+    row.values = values.data() + rowStarts[r];
+    row.count = rowStarts[r + 1] - rowStarts[r];
+    return true;
+}
+
+double sparseSource::Density() const
+{
+    const double total = double(Rows()) * cols;
+    return total > 0 ? double(indices.size()) / total : 0;
+}
+
+// ------------------------------- tensor files -------------------------------
+
+uint32 TensorTypeSize(TensorType type)
+{
+    switch (type)
+    {
+        case TensorType::Float32: return 4;
+        case TensorType::Float64: return 8;
+        case TensorType::UInt8: return 1;
+        default: return 0;
+    }
+}
+
+// the layout of a tensor in the type the model uses
+static TensorType RealTensorType()
+{
+    return (sizeof(real) == 4) ? TensorType::Float32 : TensorType::Float64;
+}
+
+bool WriteTensorFile(const char* filename, TensorType type, uint32 rows, uint32 cols, const double* values)
+{
+    const uint32 typeSize = TensorTypeSize(type);
+    if (typeSize == 0)
+        return false;
+
+    tensorHeader header = {};
+    memcpy(header.magic, TensorMagic, sizeof(header.magic));
+    header.version = TensorVersion;
+    header.type = type;
+    header.rows = rows;
+    header.cols = cols;
+    header.stride = (cols * typeSize + CacheLineSize - 1) / CacheLineSize * CacheLineSize / typeSize;
+    header.dataOffset = sizeof(tensorHeader);
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    // one padded row at a time
+    std::vector<uint8> row(size_t(header.stride) * typeSize, 0);
+    for (uint32 r=0; ok && r < rows; r++)
+    {
+        const double* v = values + size_t(r) * cols;
+        for (uint32 c=0; c < cols; c++)
+        {
+            switch (type)
+            {
+                case TensorType::Float32: { const float f = float(v[c]); memcpy(&row[c * 4], &f, 4); break; }
+                case TensorType::Float64: memcpy(&row[c * 8], &v[c], 8); break;
+                case TensorType::UInt8: row[c] = uint8(v[c] < 0 ? 0 : (v[c] > 255 ? 255 : v[c] + 0.5)); break;
+                default: break;
+            }
+        }
+        ok = fwrite(row.data(), row.size(), 1, fp) == 1;
+    }
+
+    return (fclose(fp) == 0) && ok;
+}
+
+// ------------------------------- mapped files -------------------------------
+
+mappedFile::~mappedFile()
+{
+    Close();
+}
+
+#if defined(_WIN32)
+
+bool mappedFile::Open(const char* filename, bool newCopyOnWrite)
+{
+    Close();
+    copyOnWrite = newCopyOnWrite;
+
+    file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        file = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+
+    mapping = CreateFileMappingA(file, nullptr, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+    if (mapping)
+        ptr = static_cast<uint8*>(MapViewOfFile(mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0));
+    if (!ptr)
+    {
+        Close();
+        return false;
+    }
+    length = size_t(fileSize.QuadPart);
+    return true;
+}
+
+void mappedFile::Close()
+{
+    if (ptr)
+        UnmapViewOfFile(ptr);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file)
+        CloseHandle(file);
+    ptr = nullptr;
+    length = 0;
+    mapping = nullptr;
+    file = nullptr;
+}
+
+#else
+
+bool mappedFile::Open(const char* filename, bool newCopyOnWrite)
+{
+    Close();
+    copyOnWrite = newCopyOnWrite;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        Close();
+        return false;
+    }
+
+    void* p = copyOnWrite
+        ? mmap(nullptr, size_t(info.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+        : mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+    ptr = static_cast<uint8*>(p);
+    length = size_t(info.st_size);
+    return true;
+}
+
+void mappedFile::Close()
+{
+    if (ptr)
+        munmap(ptr, length);
+    if (fd >= 0)
+        close(fd);
+    ptr = nullptr;
+    length = 0;
+    fd = -1;
+}
+
+#endif
+
+// ------------------------------- tensorFile -------------------------------
+
+bool tensorFile::Open(const char* filename)
+{
+    TRACE_SCOPE("tensorFile::Open");
+    header = nullptr;
+    rows = nullptr;
+    if (!file.Open(filename))
+        return false;
+
+    // the rows start after the header, on a cache line, which lines them up for any type.
+    // they're bounded by dividing what's left of the file, as their size could wrap.
+    const tensorHeader* h = reinterpret_cast<const tensorHeader*>(file.data());
+    const uint32 typeSize = (file.size() >= sizeof(tensorHeader)) ? TensorTypeSize(h->type) : 0;
+    const bool valid = typeSize != 0
+        && memcmp(h->magic, TensorMagic, sizeof(h->magic)) == 0
+        && h->version == TensorVersion
+        && h->stride != 0 && h->stride >= h->cols
+        && h->dataOffset >= sizeof(tensorHeader)
+        && h->dataOffset % CacheLineSize == 0
+        && h->dataOffset <= file.size()
+        && h->rows <= (file.size() - h->dataOffset) / (uint64(h->stride) * typeSize);
+    if (!valid)
+    {
+        file.Close();
+        return false;
+    }
+
+    header = h;
+    rows = file.data() + h->dataOffset;
+    return true;
+}
+
+constMatrixView tensorFile::Values() const
+{
+    if (!header || header->type != RealTensorType())
+        return constMatrixView();
+    return constMatrixView(reinterpret_cast<const real*>(rows), header->rows, header->cols, header->stride);
+}
+
+constColumnView tensorFile::Row(uint32 r, columnView scratch) const
+{
+    assert(header && r < header->rows);
+
+    const size_t offset = size_t(r) * header->stride * TensorTypeSize(header->type);
+    if (header->type == RealTensorType())
+        return constColumnView(reinterpret_cast<const real*>(rows + offset), header->cols);
+
+    assert(scratch.size() >= header->cols);
+    const uint32 cols = header->cols;
+    switch (header->type)
+    {
+        case TensorType::Float32:
+        {
+            const float* values = reinterpret_cast<const float*>(rows + offset);
+            for (uint32 c=0; c < cols; c++)
+                scratch[c] = real(values[c]);
+            break;
+        }
+        case TensorType::Float64:
+        {
+            const double* values = reinterpret_cast<const double*>(rows + offset);
+            for (uint32 c=0; c < cols; c++)
+                scratch[c] = real(values[c]);
+            break;
+        }
+        case TensorType::UInt8:
+        {
+            const uint8* values = rows + offset;
+            for (uint32 c=0; c < cols; c++)
+                scratch[c] = real(values[c]);
+            break;
+        }
+        default:
+            break;
+    }
+    return constColumnView(scratch.data(), cols);
+}
+
+// ------------------------------- imageSet -------------------------------
+
+// the size of a file, or 0 if it can't be opened
+static size_t fileSize(const char* filename)
+{
+    FILE* fp = fopen(filename, "rb");
+    if (!fp)
+        return 0;
+    fseek(fp, 0, SEEK_END);
+    const long size = ftell(fp);
+    fclose(fp);
+    return (size > 0) ? size_t(size) : 0;
+}
+
+bool imageSet::Load(std::initializer_list<const char*> filenames)
+{
+    TRACE_SCOPE("imageSet::Load");
+    records.Free();
+    numImages = 0;
+
+    // size the block for all of the files up front, then read each one straight into it
+    size_t total = 0;
+    for (const char* filename : filenames)
+    {
+        const size_t size = fileSize(filename);
+        if (size == 0 || size % ImageRecordSize != 0)
+            return false;
+        total += size;
+    }
+    records.Allocate(total);
+
+    uint8* p = records.data();
+    for (const char* filename : filenames)
+    {
+        FILE* fp = fopen(filename, "rb");
+        if (!fp)
+            return false;
+        const size_t size = fileSize(filename);
+        const bool ok = fread(p, 1, size, fp) == size;
+        fclose(fp);
+        if (!ok)
+        {
+            records.Free();
+            return false;
+        }
+        p += size;
+    }
+
+    numImages = uint32(total / ImageRecordSize);
+    return true;
+}
+
+constColumnView imageSet::Row(uint32 r, columnView scratch) const
+{
+    assert(scratch.size() >= Cols());
+    const uint8* planes = Planes(r);
+    activeKernels().interleave3(scratch.data(), planes, planes + ImagePixels, planes + 2 * ImagePixels, real(1) / real(255), ImagePixels);
+    return constColumnView(scratch.data(), Cols());
+}
+
+constColumnView imageSet::categorySource::Row(uint32 r, columnView scratch) const
+{
+    assert(scratch.size() >= ImageCategories);
+    const uint32 category = images.Category(r);
+    for (uint32 c=0; c < ImageCategories; c++)
+        scratch[c] = (c == category) ? real(1) : real(0);
+    return constColumnView(scratch.data(), ImageCategories);
+}
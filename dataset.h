@@ -0,0 +1,232 @@
+#pragma once
+
+#include <initializer_list>
+#include <vector>
+
+#include "utils.h"
+
+// ------------------------------- sample sources -------------------------------
+
+// the nonzero values of a row and their columns, in column order
+struct sparseRow
+{
+    const uint32* indices = nullptr;
+    const real* values = nullptr;
+    uint32 count = 0;
+};
+
+// rows of samples for training, wherever they are stored. a source either hands back
+// a view of its own storage, or converts the row into scratch and returns that.
+struct sampleSource
+{
+    virtual ~sampleSource() {}
+
+    virtual uint32 Rows() const = 0;
+    virtual uint32 Cols() const = 0;
+
+    // scratch must hold Cols() values, and is only written when the source has to convert
+    virtual constColumnView Row(uint32 r, columnView scratch) const = 0;
+
+    // the nonzeros of row r, for sources that store their rows that way. false if not,
+    // in which case only Row can read it.
+    virtual bool SparseRow(uint32, sparseRow&) const { return false; }
+};
+
+// copies row r of a source into dst, unless the source already converted it there
+void readRow(const sampleSource& source, uint32 r, columnView dst);
+
+// the rows of a matrix
+struct matrixSource : sampleSource
+{
+    matrixSource(const matrix& values) : values(values) {}
+
+    uint32 Rows() const override { return uint32(values.size()); }
+    uint32 Cols() const override { return values.empty() ? 0 : uint32(values.front().size()); }
+    constColumnView Row(uint32 r, columnView) const override { return values[r]; }
+
+    const matrix& values;
+};
+
+// the rows of a view, such as a memory mapped tensor file
+struct viewSource : sampleSource
+{
+    viewSource(constMatrixView values) : values(values) {}
+
+    uint32 Rows() const override { return values.rows; }
+    uint32 Cols() const override { return values.cols; }
+    constColumnView Row(uint32 r, columnView) const override { return values[r]; }
+
+    constMatrixView values;
+};
+
+// compressed sparse rows, for samples that are mostly zeros such as one-hot or bag of
+// words features: the nonzeros of every row one after another, and where each row starts.
+// a model reads their nonzeros straight from here, without expanding them.
+class sparseSource : public sampleSource
+{
+  public:
+    explicit sparseSource(uint32 cols) : cols(cols), rowStarts(1, 0) {}
+
+    // the nonzeros of every row of a matrix
+    explicit sparseSource(const matrix& rows);
+
+    // appends a row from its count nonzeros, in column order
+    void AddRow(const uint32* rowIndices, const real* rowValues, uint32 count);
+
+    uint32 Rows() const override { return uint32(rowStarts.size() - 1); }
+    uint32 Cols() const override { return cols; }
+
+    // expands the row into scratch, zeros and all
+    constColumnView Row(uint32 r, columnView scratch) const override;
+    bool SparseRow(uint32 r, sparseRow& row) const override;
+
+    // the share of all the values that are nonzero
+    double Density() const;
+
+  private:
+    uint32 cols;
+    std::vector<uint32> rowStarts;  // Rows() + 1, the last is the end of the last row
+    std::vector<uint32> indices;
+    std::vector<real> values;
+};
+
+// ------------------------------- tensor files -------------------------------
+
+// a 2d tensor on disk: this header, then the rows starting at dataOffset. each row is
+// padded out to a cache line and dataOffset is a multiple of one, so once the file is
+// mapped every row is aligned just like the model's own storage. little endian.
+enum class TensorType : uint32
+{
+    Float32,
+    Float64,
+    UInt8,
+    Last
+};
+
+const char TensorMagic[4] = { 'A', 'G', 'T', 'N' };
+const uint32 TensorVersion = 1;
+
+struct tensorHeader
+{
+    char magic[4];
+    uint32 version;
+    TensorType type;
+    uint32 rows;
+    uint32 cols;
+    uint32 stride;      // values from the start of one row to the next
+    uint32 dataOffset;  // bytes from the start of the file to the first row
+    uint32 reserved[9];
+};
+static_assert(sizeof(tensorHeader) == CacheLineSize, "the header fills one cache line");
+
+uint32 TensorTypeSize(TensorType type);
+
+// writes rows x cols values, packed row after row, converted to type
+bool WriteTensorFile(const char* filename, TensorType type, uint32 rows, uint32 cols, const double* values);
+
+// a read only view of a whole file through the os page cache, so loading costs nothing
+// up front and processes mapping the same file share its memory
+class mappedFile
+{
+  public:
+    mappedFile() {}
+    ~mappedFile();
+
+    mappedFile(const mappedFile&) = delete;
+    mappedFile& operator=(const mappedFile&) = delete;
+
+    // a copy on write mapping can be written to, but the changes are private to this
+    // process and never reach the file
+    bool Open(const char* filename, bool copyOnWrite = false);
+    void Close();
+
+    const uint8* data() const { return ptr; }
+    uint8* WritableData() const { assert(copyOnWrite); return ptr; }
+    size_t size() const { return length; }
+
+  private:
+    uint8* ptr = nullptr;
+    bool copyOnWrite = false;
+    size_t length = 0;
+#if defined(_WIN32)
+    void* file = nullptr;
+    void* mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// a mapped tensor file. the rows are used in place when they are stored as real,
+// otherwise each row is converted as it is read.
+class tensorFile : public sampleSource
+{
+  public:
+    // false if the file can't be mapped or isn't a tensor file this build understands
+    bool Open(const char* filename);
+
+    uint32 Rows() const override { return header ? header->rows : 0; }
+    uint32 Cols() const override { return header ? header->cols : 0; }
+    constColumnView Row(uint32 r, columnView scratch) const override;
+
+    TensorType Type() const { return header->type; }
+
+    // the rows without any conversion, empty unless they are stored as real
+    constMatrixView Values() const;
+
+  private:
+    mappedFile file;
+    const tensorHeader* header = nullptr;
+    const uint8* rows = nullptr;
+};
+
+// ------------------------------- image sets -------------------------------
+
+// CIFAR-10 images, kept as bytes in one block just as they are in the files: each record
+// is a category byte then 1024 red, 1024 green and 1024 blue bytes. rows come out as
+// interleaved rgb in 0-1 as they are read, so only the samples being trained on are
+// ever held as real.
+const uint32 ImagePixels = 32 * 32;
+const uint32 ImageRecordSize = 1 + ImagePixels * 3;
+const uint32 ImageCategories = 10;
+
+class imageSet : public sampleSource
+{
+  public:
+    imageSet() : categories(*this) {}
+
+    imageSet(const imageSet&) = delete;
+    imageSet& operator=(const imageSet&) = delete;
+
+    // reads every image in the files, replacing any loaded before
+    bool Load(std::initializer_list<const char*> filenames);
+
+    uint32 Rows() const override { return numImages; }
+    uint32 Cols() const override { return ImagePixels * 3; }
+    constColumnView Row(uint32 r, columnView scratch) const override;
+
+    uint32 Category(uint32 r) const { return Record(r)[0]; }
+
+    // the red, green and blue planes of an image
+    const uint8* Planes(uint32 r) const { return Record(r) + 1; }
+
+    // the categories one-hot encoded, to train against
+    const sampleSource& Categories() const { return categories; }
+
+  private:
+    const uint8* Record(uint32 r) const { assert(r < numImages); return records.data() + size_t(r) * ImageRecordSize; }
+
+    struct categorySource : sampleSource
+    {
+        categorySource(const imageSet& images) : images(images) {}
+
+        uint32 Rows() const override { return images.Rows(); }
+        uint32 Cols() const override { return ImageCategories; }
+        constColumnView Row(uint32 r, columnView scratch) const override;
+
+        const imageSet& images;
+    };
+
+    alignedArray<uint8> records;
+    uint32 numImages = 0;
+    categorySource categories;
+};
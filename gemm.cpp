@@ -0,0 +1,516 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "gemm.h"
+
+#pragma warning( disable : 4996 )
+
+// ------------------------------- blocking -------------------------------
+
+// what each level of the blocking aims to take up: half of a typical L1 for a panel of
+// b, leaving room for the panels of a streaming past it, half of L2 for the packed a
+// and a share of L3 for the packed b
+const size_t GemmL1Bytes = 16 * 1024;
+const size_t GemmL2Bytes = 128 * 1024;
+const size_t GemmL3Bytes = 2 * 1024 * 1024;
+
+gemmBlocking gemmBlockingFor(const kernelTable& kernels)
+{
+    const uint32 mr = kernels.gemmRows;
+    const uint32 nr = kernels.gemmCols;
+
+    gemmBlocking blocking;
+    blocking.kc = uint32(std::min<size_t>(384, std::max<size_t>(64, GemmL1Bytes / (nr * sizeof(real)))));
+    blocking.mc = std::max(mr, uint32(GemmL2Bytes / (blocking.kc * sizeof(real))) / mr * mr);
+    blocking.nc = std::max(nr, uint32(GemmL3Bytes / (blocking.kc * sizeof(real))) / nr * nr);
+    return blocking;
+}
+
+// the packed a first, then the packed b starting on a cache line, in whole cache lines
+static size_t packSizeFor(const gemmBlocking& blocking, uint32 nr, uint32 n)
+{
+    const uint32 columns = (std::min(blocking.nc, n) + nr - 1) / nr * nr;
+    return alignedCount<real>(blocking.mc * blocking.kc) + alignedCount<real>(blocking.kc * columns);
+}
+
+// ------------------------------- plans -------------------------------
+
+// how one product runs: the kernel table whose register tile it uses, and its blocking
+struct gemmPlan
+{
+    const kernelTable* kernels;
+    gemmBlocking blocking;
+};
+
+static bool sameBlocking(const gemmBlocking& a, const gemmBlocking& b)
+{
+    return a.kc == b.kc && a.mc == b.mc && a.nc == b.nc;
+}
+
+// calls f with every plan tuning tries, starting with the default one: the register tile
+// of each kernel table from SSE2 up to the active one, each with its own blocking and
+// with panels of b from 64 to 256 deep, the packed a filling all, half or a quarter of
+// its share of L2
+template <typename F>
+static void forEachPlan(F&& f)
+{
+    const kernelTable& active = activeKernels();
+    f(gemmPlan{ &active, gemmBlockingFor(active) });
+
+    const kernelTable* previous = nullptr;
+    for (short level = short(active.level); level >= 0; level--)
+    {
+        const kernelTable& kernels = kernelsFor(KernelLevel(level));
+        if (&kernels == previous || (kernels.level == KernelLevel::Scalar && active.level != KernelLevel::Scalar))
+            continue;
+        previous = &kernels;
+
+        const uint32 mr = kernels.gemmRows;
+        const uint32 nr = kernels.gemmCols;
+        const gemmBlocking standard = gemmBlockingFor(kernels);
+        if (&kernels != &active)
+            f(gemmPlan{ &kernels, standard });
+        for (uint32 kc : { 64u, 128u, 256u })
+        {
+            for (uint32 share : { 1u, 2u, 4u })
+            {
+                gemmBlocking blocking;
+                blocking.kc = kc;
+                blocking.mc = std::max(mr, uint32(GemmL2Bytes / share / (kc * sizeof(real))) / mr * mr);
+                blocking.nc = std::max(nr, uint32(GemmL3Bytes / (kc * sizeof(real))) / nr * nr);
+                if (!sameBlocking(blocking, standard))
+                    f(gemmPlan{ &kernels, blocking });
+            }
+        }
+    }
+}
+
+// set by setGemmTuning
+static std::atomic<bool> tuningEnabled{false};
+
+size_t gemmPackSize(uint32 n)
+{
+    // untuned products only ever run the default plan
+    if (!tuningEnabled.load(std::memory_order_acquire))
+    {
+        const kernelTable& kernels = activeKernels();
+        return packSizeFor(gemmBlockingFor(kernels), kernels.gemmCols, n);
+    }
+
+    size_t size = 0;
+    forEachPlan([&](const gemmPlan& plan)
+    {
+        size = std::max(size, packSizeFor(plan.blocking, plan.kernels->gemmCols, n));
+    });
+    return size;
+}
+
+// ------------------------------- packing -------------------------------
+
+// rows [i0, i0 + rows) and depth [p0, p0 + depth) of a, in panels of mr rows. each panel
+// holds its mr values for one step of depth together, and the last is padded with zeros.
+static void packA(constMatrixView a, bool transposed, uint32 i0, uint32 rows, uint32 p0, uint32 depth, uint32 mr, real* out)
+{
+    for (uint32 ir=0; ir < rows; ir += mr)
+    {
+        const uint32 count = std::min(mr, rows - ir);
+        real* panel = out + size_t(ir) * depth;
+        if (!transposed)
+        {
+            for (uint32 r=0; r < mr; r++)
+            {
+                if (r < count)
+                {
+                    const real* src = a[i0 + ir + r].data() + p0;
+                    for (uint32 p=0; p < depth; p++)
+                        panel[size_t(p) * mr + r] = src[p];
+                }
+                else
+                {
+                    for (uint32 p=0; p < depth; p++)
+                        panel[size_t(p) * mr + r] = 0;
+                }
+            }
+        }
+        else
+        {
+            for (uint32 p=0; p < depth; p++)
+            {
+                const real* src = a[p0 + p].data() + i0 + ir;
+                real* dst = panel + size_t(p) * mr;
+                std::copy(src, src + count, dst);
+                std::fill(dst + count, dst + mr, real(0));
+            }
+        }
+    }
+}
+
+// depth [p0, p0 + depth) and columns [j0, j0 + cols) of b, in panels of nr columns
+static void packB(constMatrixView b, bool transposed, uint32 p0, uint32 depth, uint32 j0, uint32 cols, uint32 nr, real* out)
+{
+    for (uint32 jr=0; jr < cols; jr += nr)
+    {
+        const uint32 count = std::min(nr, cols - jr);
+        real* panel = out + size_t(jr) * depth;
+        if (!transposed)
+        {
+            for (uint32 p=0; p < depth; p++)
+            {
+                const real* src = b[p0 + p].data() + j0 + jr;
+                real* dst = panel + size_t(p) * nr;
+                std::copy(src, src + count, dst);
+                std::fill(dst + count, dst + nr, real(0));
+            }
+        }
+        else
+        {
+            for (uint32 j=0; j < nr; j++)
+            {
+                if (j < count)
+                {
+                    const real* src = b[j0 + jr + j].data() + p0;
+                    for (uint32 p=0; p < depth; p++)
+                        panel[size_t(p) * nr + j] = src[p];
+                }
+                else
+                {
+                    for (uint32 p=0; p < depth; p++)
+                        panel[size_t(p) * nr + j] = 0;
+                }
+            }
+        }
+    }
+}
+
+// ------------------------------- gemm -------------------------------
+
+// the largest register tile of any kernel table
+const uint32 MaxGemmTile = 6 * 32;
+
+static void runGemm(
+    const gemmPlan& plan,
+    constMatrixView a,
+    bool transposeA,
+    constMatrixView b,
+    bool transposeB,
+    matrixView c,
+    bool accumulate,
+    columnView pack,
+    const gemmEpilogue& epilogue)
+{
+    const uint32 m = c.rows;
+    const uint32 n = c.cols;
+    const uint32 k = transposeA ? a.rows : a.cols;
+
+    if (!accumulate)
+    {
+        for (uint32 i=0; i < m; i++)
+            std::fill(c[i].begin(), c[i].end(), real(0));
+    }
+    if (m == 0 || n == 0)
+        return;
+    if (k == 0)
+    {
+        if (epilogue.fn)
+            epilogue.fn(epilogue.context, c, 0, 0);
+        return;
+    }
+
+    const kernelTable& kernels = *plan.kernels;
+    const gemmBlocking& blocking = plan.blocking;
+    const uint32 mr = kernels.gemmRows;
+    const uint32 nr = kernels.gemmCols;
+    assert(mr * nr <= MaxGemmTile);
+
+    alignedArray<real> ownPack;
+    const size_t packSize = packSizeFor(blocking, nr, n);
+    if (pack.size() < packSize)
+    {
+        ownPack.Allocate(packSize);
+        pack = columnView(ownPack.data(), uint32(packSize));
+    }
+    real* packedA = pack.data();
+    real* packedB = packedA + alignedCount<real>(blocking.mc * blocking.kc);
+
+    // tiles that hang over the edge of c are made in here, then added in
+    alignas(CacheLineSize) real edge[MaxGemmTile];
+
+    for (uint32 jc=0; jc < n; jc += blocking.nc)
+    {
+        const uint32 cols = std::min(blocking.nc, n - jc);
+        for (uint32 pc=0; pc < k; pc += blocking.kc)
+        {
+            const uint32 depth = std::min(blocking.kc, k - pc);
+            const bool lastDepth = pc + depth == k;
+            packB(b, transposeB, pc, depth, jc, cols, nr, packedB);
+
+            for (uint32 ic=0; ic < m; ic += blocking.mc)
+            {
+                const uint32 rows = std::min(blocking.mc, m - ic);
+                packA(a, transposeA, ic, rows, pc, depth, mr, packedA);
+
+                for (uint32 jr=0; jr < cols; jr += nr)
+                {
+                    const uint32 tileCols = std::min(nr, cols - jr);
+                    const real* bPanel = packedB + size_t(jr) * depth;
+                    for (uint32 ir=0; ir < rows; ir += mr)
+                    {
+                        const uint32 tileRows = std::min(mr, rows - ir);
+                        const real* aPanel = packedA + size_t(ir) * depth;
+                        real* tile = c[ic + ir].data() + jc + jr;
+                        if (tileRows == mr && tileCols == nr)
+                            kernels.gemmTile(depth, aPanel, bPanel, tile, c.stride);
+                        else
+                        {
+                            std::fill(edge, edge + mr * nr, real(0));
+                            kernels.gemmTile(depth, aPanel, bPanel, edge, nr);
+                            for (uint32 r=0; r < tileRows; r++)
+                            {
+                                for (uint32 j=0; j < tileCols; j++)
+                                    tile[size_t(r) * c.stride + j] += edge[r * nr + j];
+                            }
+                        }
+
+                        if (lastDepth && epilogue.fn)
+                            epilogue.fn(epilogue.context, matrixView(tile, tileRows, tileCols, c.stride), ic + ir, jc + jr);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// ------------------------------- tuning -------------------------------
+
+// a product tuning tells apart, under the kernel level it was tuned up to
+struct tunedShape
+{
+    KernelLevel ceiling;
+    uint32 m;
+    uint32 n;
+    uint32 k;
+    bool transposeA;
+    bool transposeB;
+
+    bool operator<(const tunedShape& o) const
+    {
+        if (ceiling != o.ceiling) return ceiling < o.ceiling;
+        if (m != o.m) return m < o.m;
+        if (n != o.n) return n < o.n;
+        if (k != o.k) return k < o.k;
+        if (transposeA != o.transposeA) return transposeA < o.transposeA;
+        return transposeB < o.transposeB;
+    }
+};
+
+// the plans and the file are guarded by tuningLock, which a product only takes the first
+// time its thread sees its shape. the epoch moves on whenever tuning is set, so each
+// thread's copies of the plans are dropped along with the shared ones.
+static std::atomic<uint32> shapesTuned{0};
+static std::atomic<uint32> tuningEpoch{0};
+static std::mutex tuningLock;
+static std::map<tunedShape, gemmPlan> tunedPlans;
+static std::string tuningFile;
+
+// the plans this thread has looked up, read without the lock
+struct threadPlans
+{
+    uint32 epoch = 0;
+    std::map<tunedShape, gemmPlan> plans;
+};
+static thread_local threadPlans localPlans;
+
+static const char* realName()
+{
+    return sizeof(real) == 4 ? "float" : "double";
+}
+
+// the plan forEachPlan would try for a level and blocking, if there is one
+static bool findPlan(KernelLevel level, const gemmBlocking& blocking, gemmPlan& found)
+{
+    bool ok = false;
+    forEachPlan([&](const gemmPlan& plan)
+    {
+        if (!ok && plan.kernels->level == level && sameBlocking(plan.blocking, blocking))
+        {
+            found = plan;
+            ok = true;
+        }
+    });
+    return ok;
+}
+
+// the lines this cpu wrote at this precision and kernel level. a line whose plan this
+// build wouldn't try, say from another version, is skipped.
+static void readTuning(const char* filename)
+{
+    FILE* fp = fopen(filename, "r");
+    if (!fp)
+        return;
+
+    const KernelLevel active = activeKernels().level;
+    char line[512];
+    while (fgets(line, sizeof(line), fp))
+    {
+        char type[16];
+        char cpu[256];
+        short ceiling, level;
+        unsigned m, n, k, transposeA, transposeB;
+        gemmBlocking blocking;
+        if (sscanf(line, "gemm %15s %hd %u %u %u %u %u %hd %u %u %u %255[^\n]", type, &ceiling, &m, &n, &k,
+                &transposeA, &transposeB, &level, &blocking.kc, &blocking.mc, &blocking.nc, cpu) != 12)
+            continue;
+        if (strcmp(type, realName()) != 0 || strcmp(cpu, cpuName()) != 0 || KernelLevel(ceiling) != active)
+            continue;
+
+        gemmPlan plan;
+        if (findPlan(KernelLevel(level), blocking, plan))
+            tunedPlans[tunedShape{ active, m, n, k, transposeA != 0, transposeB != 0 }] = plan;
+    }
+    fclose(fp);
+}
+
+static void appendTuning(const tunedShape& shape, const gemmPlan& plan)
+{
+    if (tuningFile.empty())
+        return;
+
+    FILE* fp = fopen(tuningFile.c_str(), "a");
+    if (!fp)
+        return;
+    fprintf(fp, "gemm %s %d %u %u %u %u %u %d %u %u %u %s\n", realName(), int(shape.ceiling), shape.m, shape.n, shape.k,
+        unsigned(shape.transposeA), unsigned(shape.transposeB), int(plan.kernels->level),
+        plan.blocking.kc, plan.blocking.mc, plan.blocking.nc, cpuName());
+    fclose(fp);
+}
+
+// times every plan on a product of this shape and returns the quickest. the products
+// go into scratch, so c keeps its values for the one that counts.
+static gemmPlan tunePlan(constMatrixView a, bool transposeA, constMatrixView b, bool transposeB, const matrixView& c)
+{
+    const uint32 stride = alignedCount<real>(c.cols);
+    alignedArray<real> scratch(size_t(c.rows) * stride);
+    alignedArray<real> pack(gemmPackSize(c.cols));
+    const matrixView out(scratch.data(), c.rows, c.cols, stride);
+    const columnView packView(pack.data(), uint32(pack.size()));
+
+    gemmPlan best = {};
+    double bestTime = 0;
+    forEachPlan([&](const gemmPlan& plan)
+    {
+        // one run to warm the caches, then the quickest of a few, or of one when a run
+        // is slow enough to time on its own
+        runGemm(plan, a, transposeA, b, transposeB, out, false, packView, gemmEpilogue());
+        double fastest = 0;
+        for (uint32 r=0; r < 3; r++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            runGemm(plan, a, transposeA, b, transposeB, out, false, packView, gemmEpilogue());
+            const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            fastest = (r == 0) ? time : std::min(fastest, time);
+            if (time > 0.02)
+                break;
+        }
+        if (!best.kernels || fastest < bestTime)
+        {
+            best = plan;
+            bestTime = fastest;
+        }
+    });
+    return best;
+}
+
+bool setGemmTuning(bool enabled, const char* cacheFile)
+{
+    std::lock_guard<std::mutex> lock(tuningLock);
+    tunedPlans.clear();
+    tuningFile = (enabled && cacheFile) ? cacheFile : "";
+
+    bool ok = true;
+    if (!tuningFile.empty())
+    {
+        readTuning(cacheFile);
+
+        // a new cache starts with what its columns are
+        FILE* fp = fopen(cacheFile, "a");
+        ok = fp != nullptr;
+        if (fp && ftell(fp) == 0)
+            fprintf(fp, "# gemm type ceiling m n k transposeA transposeB level kc mc nc cpu\n");
+        if (fp)
+            fclose(fp);
+    }
+
+    tuningEpoch++;
+    tuningEnabled.store(enabled, std::memory_order_release);
+    return ok;
+}
+
+bool gemmTuning()
+{
+    return tuningEnabled.load(std::memory_order_acquire);
+}
+
+// the plan for a shape, timing it if no thread has yet
+static gemmPlan sharedPlan(const tunedShape& shape, constMatrixView a, bool transposeA, constMatrixView b, bool transposeB, const matrixView& c)
+{
+    // other threads wanting a plan wait while one shape is timed, which keeps them from
+    // running products alongside it
+    std::lock_guard<std::mutex> lock(tuningLock);
+    auto found = tunedPlans.find(shape);
+    if (found == tunedPlans.end())
+    {
+        found = tunedPlans.emplace(shape, tunePlan(a, transposeA, b, transposeB, c)).first;
+        shapesTuned++;
+        appendTuning(shape, found->second);
+    }
+    return found->second;
+}
+
+uint32 gemmShapesTuned()
+{
+    return shapesTuned.load(std::memory_order_relaxed);
+}
+
+void gemm(
+    constMatrixView a,
+    bool transposeA,
+    constMatrixView b,
+    bool transposeB,
+    matrixView c,
+    bool accumulate,
+    columnView pack,
+    const gemmEpilogue& epilogue)
+{
+    const uint32 m = c.rows;
+    const uint32 n = c.cols;
+    const uint32 k = transposeA ? a.rows : a.cols;
+    assert((transposeA ? a.cols : a.rows) == m);
+    assert((transposeB ? b.cols : b.rows) == k && (transposeB ? b.rows : b.cols) == n);
+
+    const kernelTable& active = activeKernels();
+    gemmPlan plan{ &active, gemmBlockingFor(active) };
+    if (tuningEnabled.load(std::memory_order_acquire) && m && n && k)
+    {
+        const uint32 epoch = tuningEpoch.load(std::memory_order_acquire);
+        if (localPlans.epoch != epoch)
+        {
+            localPlans.plans.clear();
+            localPlans.epoch = epoch;
+        }
+
+        const tunedShape shape{ active.level, m, n, k, transposeA, transposeB };
+        auto found = localPlans.plans.find(shape);
+        if (found == localPlans.plans.end())
+            found = localPlans.plans.emplace(shape, sharedPlan(shape, a, transposeA, b, transposeB, c)).first;
+        plan = found->second;
+    }
+
+    runGemm(plan, a, transposeA, b, transposeB, c, accumulate, pack, epilogue);
+}
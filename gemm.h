@@ -0,0 +1,68 @@
+#pragma once
+
+#include "kernels.h"
+#include "utils.h"
+
+// ------------------------------- gemm -------------------------------
+
+// the matrix products of the batched dense passes, blocked in the manner of BLIS and
+// GotoBLAS. b is packed a block at a time into panels that stay in L3, a into panels
+// that stay in L2, and the register tile from kernelTable::gemmTile runs over a panel
+// of each, its slice of b in L1. packing also turns either input round, so a
+// transposed operand costs nothing in the inner loop.
+
+// how much of each input a level of the blocking holds
+struct gemmBlocking
+{
+    uint32 kc;  // depth of the packed panels, sized so a panel of b fits in L1
+    uint32 mc;  // rows of a packed at a time, sized for L2. a multiple of gemmRows
+    uint32 nc;  // columns of b packed at a time, sized for L3. a multiple of gemmCols
+};
+
+// the blocking for a kernel table's register tile
+gemmBlocking gemmBlockingFor(const kernelTable& kernels);
+
+// values of packing space a product with n columns needs with the active kernels. with
+// tuning on it is enough for whichever register tile and blocking tuning picks, so it
+// grows when tuning is turned on.
+size_t gemmPackSize(uint32 n);
+
+// work run on each tile of c as soon as its sums are complete, while the tile is still in
+// L1, such as adding the biases and applying the activation. fn is given the tile and
+// the row and column of c it starts at.
+struct gemmEpilogue
+{
+    void (*fn)(void* context, matrixView tile, uint32 row, uint32 col) = nullptr;
+    void* context = nullptr;
+};
+
+// c = a * b, or c += a * b with accumulate. a is c.rows x k, or stored transposed as
+// k x c.rows with transposeA, and b likewise k x c.cols, or c.cols x k. the packing
+// space holds gemmPackSize(c.cols) values, or is empty to allocate it on the heap.
+// each value of c goes through the epilogue exactly once, if there is one.
+void gemm(
+    constMatrixView a,
+    bool transposeA,
+    constMatrixView b,
+    bool transposeB,
+    matrixView c,
+    bool accumulate,
+    columnView pack = columnView(),
+    const gemmEpilogue& epilogue = gemmEpilogue());
+
+// ------------------------------- tuning -------------------------------
+
+// with tuning on, the first product of each shape, its rows, columns and depth and which
+// inputs are transposed, is timed with the register tile of every kernel table up to the
+// active one and a range of blockings, and the quickest runs every product of that shape
+// after it. the winners are appended to cacheFile, keyed by the cpu, and those for this
+// cpu are read back from it when tuning starts, so each shape is only timed once on a
+// machine. false if cacheFile can't be created, in which case it tunes without one. each
+// call starts over with only what the cache holds.
+bool setGemmTuning(bool enabled, const char* cacheFile = nullptr);
+
+// whether tuning is on
+bool gemmTuning();
+
+// shapes timed since the process started, rather than read from a cache
+uint32 gemmShapesTuned();
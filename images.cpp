@@ -2,123 +2,152 @@
 #include <random>
 #include <cassert>
 #include <array>
-
-#include <fstream>
-#include <iterator>
+#include <cstdio>
+#include <cstdlib>
 
 #include "model.h"
+#include "quantized.h"
 #include "render.h"
+#include "trace.h"
+#include "trainer.h"
 
-// each image is 32 x 32 x 3
+// each image is 32 x 32 x 3, a row at a time with each pixel's colors together
 const int imageArraySize = 32 * 32 * 3;
-const int numImages = 400;
-const int numCategories = 10;
-
-// each image in the data is this many bytes
-const int imageDataSize = 1 + 1024*3;
-
-// constant to covert from 255 to float in 0-to-1 range
-const double convert255 = double(1) / double(255);
-
-void loadImages(const char* filename, matrix& images, matrix& categories)
-{
-    std::ifstream input(filename, std::ios::binary );
-    std::vector<unsigned char> buffer(std::istreambuf_iterator<char>(input), {});
-
-    // flatten and scale image data from the file into a matrix
-    for (int i=0; i < numImages; i++)
-    {
-        images[i].resize(1024 * 3);
-
-        unsigned char* imagePtr = &buffer[i*imageDataSize];
-        unsigned char* r = &imagePtr[1];
-        unsigned char* g = &imagePtr[1+1024];
-        unsigned char* b = &imagePtr[1+1024+1024];
-
-        for (int pixel = 0; pixel < 1024; pixel++)
-        {
-            const int o = pixel*3;
-            images[i][o+0] = (*r++) * convert255;
-            images[i][o+1] = (*g++) * convert255;
-            images[i][o+2] = (*b++) * convert255;
-        }
-
-        // hot encode categories
-        categories[i].resize(numCategories);
-        unsigned char category = *imagePtr;
-        for (int c=0; c < numCategories; c++)
-        {
-            categories[i][c] = (category == c) ? 1 : 0;
-        }
-    }
-}
-
+const uint32 batchSize = 32;
 
 int main(int, char**)
 {
     // stable random values
     srand(101010101);
 
-    // need image data in matrix of [numImages][width][height][color], in 0.0 to 1.0 range
-
-    matrix batch1Images(numImages);
-    matrix batch1Categories(numImages);
-    loadImages("Resources/Data/data_batch_1.bin", batch1Images, batch1Categories);
-    
-    
-    matrix testImages(numImages);
-    matrix testCategories(numImages);
-    loadImages("Resources/Data/test_batch.bin", testImages, testCategories);
-    
+    // AGAIN_TRACE_FILE=images.json records the passes and layers, for chrome://tracing
+    const char* traceFilename = getenv("AGAIN_TRACE_FILE");
+    if (traceFilename)
+        setTracing(true);
+
+    // all 50,000 training images stay as bytes, and are turned into [width][height][color]
+    // rows in the 0.0 to 1.0 range a mini-batch at a time as they are trained on
+    imageSet trainImages;
+    imageSet testImages;
+    if (!trainImages.Load({
+            "Resources/Data/data_batch_1.bin",
+            "Resources/Data/data_batch_2.bin",
+            "Resources/Data/data_batch_3.bin",
+            "Resources/Data/data_batch_4.bin",
+            "Resources/Data/data_batch_5.bin" }) ||
+        !testImages.Load({ "Resources/Data/test_batch.bin" }))
+    {
+        printf("can't load the CIFAR-10 batches from Resources/Data\n");
+        return 1;
+    }
 
+    // carry on from where the last run left off, if it saved the model. the weights are
+    // copied rather than mapped, since the file is saved over at the end.
+    const char* modelFilename = "images.model";
     model m;
-    layer* l = m.AddInputLayer(imageArraySize); // input layer for one image
-    l = m.AddDenseLayer(200, ActivationFunction::Relu, l);  
-    l = m.AddDenseLayer(150, ActivationFunction::Relu, l); 
-    l = m.AddDenseLayer(10, ActivationFunction::Softmax, l); 
+    m.SetNumThreads(0); // one per core
+    if (!m.Load(modelFilename, false))
+    {
+        // two rounds of 3x3 filters and 2x2 max pooling, 32x32x3 -> 16x16x16 -> 8x8x32,
+        // then a small dense classifier. a fifth of the weights of a 200 and 150 wide
+        // dense model over the raw pixels, and they see the image as an image.
+        imageShape image;
+        image.width = 32;
+        image.height = 32;
+        image.channels = 3;
+        imageWindow filter;
+        filter.size = 3;
+        filter.padding = 1;
+        imageWindow pool;
+        pool.size = 2;
+        pool.stride = 2;
+
+        layer* l = m.AddInputLayer(image); // input layer for one image
+        l = m.AddConvLayer(16, filter, ActivationFunction::Relu, l);
+        l = m.AddPoolLayer(LayerKind::MaxPool, pool, l);
+        l = m.AddConvLayer(32, filter, ActivationFunction::Relu, l);
+        l = m.AddPoolLayer(LayerKind::MaxPool, pool, l);
+        l = m.AddDenseLayer(64, ActivationFunction::Relu, l);
+        l = m.AddSoftmaxCrossEntropyLayer(10, l);
+    }
+
+    // adam's moments aren't saved with the model, so they build up again on each run
+    optimizer adam;
+    adam.kind = OptimizerKind::Adam;
+    m.SetOptimizer(adam);
+    const double learningRate = 0.001;
 
     renderWindow rw;
 
 
-    // stable random set of test indices
+    // the int8 copy is checked on a small stable random set of test images
     const int numTests = 100;    
     std::array<int, numTests> testIds;
     for (int j=0; j< numTests; j++)
     testIds[j] = rand() % numTests;
 
+    matrix testSubset(numTests);
+    matrix testSubsetTargets(numTests);
+    for (int t=0; t < numTests; t++)
+    {
+        testSubset[t].resize(imageArraySize);
+        testImages.Row(testIds[t], testSubset[t]);
+        testSubsetTargets[t].resize(ImageCategories);
+        testImages.Categories().Row(testIds[t], testSubsetTargets[t]);
+    }
+
+    // the int8 model is calibrated on test images the accuracy isn't measured on
+    const uint32 calibrationFirst = numTests;
+    const uint32 calibrationCount = 1000;
+    matrix calibrationImages(calibrationCount);
+    for (uint32 c=0; c < calibrationCount; c++)
+    {
+        calibrationImages[c].resize(imageArraySize);
+        testImages.Row(calibrationFirst + c, calibrationImages[c]);
+    }
+    quantizedModel quantized;
+    quantized.SetNumThreads(0);
+    matrix quantizedPredictions;
+
+    // an epoch and its evaluation at a time on a thread of their own, while the window
+    // keeps drawing from the newest snapshot of the model
     int trainingRuns = 0;
-    bool running = 1;
-    while (running)
+    backgroundTrainer trainer;
+    trainer.Start(m, [&](model& trained)
     {
-        m.Train(batch1Images, batch1Categories, 1, 0.1);
+        trained.Train(trainImages, trainImages.Categories(), 1, learningRate, batchSize);
 
+        // the whole test set, batched across the threads
         trainingRuns++;
-        {
-            column predictions(numCategories);
-
-            int numCorrect = 0;
+        const evaluation tested = trained.Evaluate(testImages, testImages.Categories());
+        printf("epoch %d: accuracy %.3f, top %u %.3f, test loss %.4f\n",
+            trained.epoch, tested.Accuracy(), tested.topK, tested.TopKAccuracy(), tested.loss);
 
-            // calculate accuracy on a subset of test images
+        // every so often, how much accuracy an int8 copy of the model gives up
+        if (trainingRuns % 10 == 0 && quantized.Build(trained, matrixSource(calibrationImages)))
+        {
+            int numQuantizedCorrect = 0;
+            quantized.PredictBatch(testSubset, quantizedPredictions);
             for (int t=0; t < numTests; t++)
             {
-                const int index = testIds[t];
-
-                m.PredictSingleInput(testImages[index], predictions);
-                
-                int predictedCategory = argmax(predictions);
-                int testCategory = argmax(testCategories[index]);
-
-                if (predictedCategory == testCategory)
-                    numCorrect += 1;
-
+                if (argmax(quantizedPredictions[t]) == int(testImages.Category(testIds[t])))
+                    numQuantizedCorrect += 1;
             }
-            m.loss = double(numCorrect) / numTests;
+            const double quantizedAccuracy = double(numQuantizedCorrect) / numTests;
+            const double accuracy = trained.Evaluate(testSubset, testSubsetTargets).Accuracy();
+            printf("int8 accuracy %.3f, %+.3f against the model, weights %zu KB\n",
+                quantizedAccuracy, quantizedAccuracy - accuracy, quantized.WeightBytes() / 1024);
         }
+    });
 
+    bool running = 1;
+    while (running)
+    {
         rw.ProcessEvents(running);
 
+        const model& snapshot = trainer.Latest();
         rw.BeginDisplay();
-        rw.DisplayTitle(m.epoch, m.loss, "Images");
+        rw.DisplayTitle(snapshot.epoch, snapshot.loss, "Images");
 
 
 
@@ -138,4 +167,14 @@ int main(int, char**)
         
         rw.EndDisplay();
     }
+
+    // Stop waits for the epoch in progress, then the model is this thread's again
+    printf("finishing the epoch\n");
+    trainer.Stop();
+
+    if (!m.Save(modelFilename))
+        printf("can't save the model to %s\n", modelFilename);
+
+    if (traceFilename && !writeTrace(traceFilename))
+        printf("can't write the trace to %s\n", traceFilename);
 }
@@ -0,0 +1,338 @@
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include "kernels.h"
+
+#if AGAIN_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// ------------------------------- scalar reference -------------------------------
+
+// straightforward loops, kept as the reference the vector versions are tested against
+
+static real scalar_dot(const real* a, const real* b, uint32 count)
+{
+    real sum = 0;
+    for (uint32 i=0; i < count; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static void scalar_axpy(real* y, const real* x, const real alpha, uint32 count)
+{
+    for (uint32 i=0; i < count; i++)
+        y[i] += alpha * x[i];
+}
+
+static void scalar_interleave3(real* out, const uint8* c0, const uint8* c1, const uint8* c2, const real scale, uint32 count)
+{
+    for (uint32 i=0; i < count; i++)
+    {
+        out[3*i+0] = c0[i] * scale;
+        out[3*i+1] = c1[i] * scale;
+        out[3*i+2] = c2[i] * scale;
+    }
+}
+
+static void scalar_momentumStep(real* w, real* velocity, const real* g, const real scale, const optimizerStep& step, uint32 count)
+{
+    for (uint32 i=0; i < count; i++)
+    {
+        const real gi = scale * g[i] + step.l2 * w[i];
+        const real vi = step.momentum * velocity[i] + gi;
+        velocity[i] = vi;
+        w[i] -= step.learningRate * (step.nesterov ? gi + step.momentum * vi : vi);
+    }
+}
+
+static void scalar_adamStep(real* w, real* m, real* v, const real* g, const real scale, const optimizerStep& step, uint32 count)
+{
+    for (uint32 i=0; i < count; i++)
+    {
+        const real wi = w[i] - step.decay * w[i];
+        const real gi = scale * g[i] + step.l2 * w[i];
+        const real mi = step.beta1 * m[i] + (1 - step.beta1) * gi;
+        const real vi = step.beta2 * v[i] + (1 - step.beta2) * gi * gi;
+        m[i] = mi;
+        v[i] = vi;
+        w[i] = wi - step.learningRate * (mi * step.correction1) / (std::sqrt(vi * step.correction2) + step.epsilon);
+    }
+}
+
+static uint32 scalar_argmax(const real* values, uint32 count)
+{
+    uint32 index = 0;
+    for (uint32 i=1; i < count; i++)
+    {
+        if (values[i] > values[index])
+            index = i;
+    }
+    return index;
+}
+
+static uint32 scalar_countGreater(const real* values, const real threshold, uint32 count)
+{
+    uint32 greater = 0;
+    for (uint32 i=0; i < count; i++)
+        greater += (values[i] > threshold) ? 1 : 0;
+    return greater;
+}
+
+const uint32 scalarGemmRows = 4;
+const uint32 scalarGemmCols = 4;
+
+static void scalar_gemmTile(uint32 k, const real* a, const real* b, real* c, uint32 ldc)
+{
+    real sum[scalarGemmRows][scalarGemmCols] = {};
+    for (uint32 p=0; p < k; p++, a += scalarGemmRows, b += scalarGemmCols)
+    {
+        for (uint32 i=0; i < scalarGemmRows; i++)
+            for (uint32 j=0; j < scalarGemmCols; j++)
+                sum[i][j] += a[i] * b[j];
+    }
+
+    for (uint32 i=0; i < scalarGemmRows; i++)
+        for (uint32 j=0; j < scalarGemmCols; j++)
+            c[size_t(i) * ldc + j] += sum[i][j];
+}
+
+static const kernelTable scalarTable = {
+    KernelLevel::Scalar,
+    "scalar",
+    scalar_dot,
+    scalar_axpy,
+    scalar_interleave3,
+    scalar_momentumStep,
+    scalar_adamStep,
+    scalar_argmax,
+    scalar_countGreater,
+    scalarGemmRows,
+    scalarGemmCols,
+    scalar_gemmTile
+};
+
+const kernelTable* scalarKernelTable()
+{
+    return &scalarTable;
+}
+
+static int32 scalar_dot_int8(const uint8* x, const int8* w, uint32 count)
+{
+    int32 sum = 0;
+    for (uint32 i=0; i < count; i++)
+        sum += int32(x[i]) * int32(w[i]);
+    return sum;
+}
+
+static const int8KernelTable scalarInt8Table = {
+    "scalar",
+    scalar_dot_int8
+};
+
+const int8KernelTable* scalarInt8KernelTable()
+{
+    return &scalarInt8Table;
+}
+
+// ------------------------------- cpu detection -------------------------------
+
+#if AGAIN_X86
+
+static void cpuid(int info[4], int leaf, int subleaf)
+{
+#if defined(_MSC_VER)
+    __cpuidex(info, leaf, subleaf);
+#else
+    __cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+#endif
+}
+
+// which register state the os saves on a context switch
+static unsigned long long xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32 lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+}
+
+KernelLevel detectKernelLevel()
+{
+    int info[4];
+    cpuid(info, 0, 0);
+    const int maxLeaf = info[0];
+
+    cpuid(info, 1, 0);
+    const bool sse2 = (info[3] & (1 << 26)) != 0;
+    const bool fma = (info[2] & (1 << 12)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+
+    if (!sse2)
+        return KernelLevel::Scalar;
+
+    if (!osxsave || !avx || maxLeaf < 7)
+        return KernelLevel::SSE2;
+
+    // xmm and ymm state, then opmask and both halves of zmm state
+    const unsigned long long xcr0 = xgetbv0();
+    const bool osAvx = (xcr0 & 0x6) == 0x6;
+    const bool osAvx512 = (xcr0 & 0xe6) == 0xe6;
+
+    cpuid(info, 7, 0);
+    const bool avx2 = (info[1] & (1 << 5)) != 0;
+    const bool avx512f = (info[1] & (1 << 16)) != 0;
+
+    if (osAvx512 && avx512f && avx2 && fma && avx512KernelTable())
+        return KernelLevel::AVX512;
+
+    if (osAvx && avx2 && fma && avx2KernelTable())
+        return KernelLevel::AVX2;
+
+    return sse2KernelTable() ? KernelLevel::SSE2 : KernelLevel::Scalar;
+}
+
+// the AVX-512 vector neural network instructions, on top of what the AVX512 level needs
+static bool detectVnni()
+{
+    if (detectKernelLevel() != KernelLevel::AVX512)
+        return false;
+
+    int info[4];
+    cpuid(info, 7, 0);
+    return (info[2] & (1 << 11)) != 0;
+}
+
+// leaves 0x80000002 to 0x80000004 hold 48 characters of brand string, padded with spaces
+static void readCpuName(char* name)
+{
+    int info[4];
+    cpuid(info, 0x80000000, 0);
+    if (uint32(info[0]) < 0x80000004u)
+        return;
+
+    for (int leaf=0; leaf < 3; leaf++)
+    {
+        cpuid(info, 0x80000002 + leaf, 0);
+        memcpy(name + leaf * 16, info, 16);
+    }
+    name[48] = 0;
+}
+
+#else
+
+KernelLevel detectKernelLevel()
+{
+    return KernelLevel::Scalar;
+}
+
+static void readCpuName(char*)
+{
+}
+
+static bool detectVnni()
+{
+    return false;
+}
+
+#endif
+
+const char* cpuName()
+{
+    static const std::string name = []()
+    {
+        char brand[49] = {};
+        readCpuName(brand);
+        std::string trimmed(brand);
+        trimmed.erase(0, trimmed.find_first_not_of(' '));
+        trimmed.erase(trimmed.find_last_not_of(' ') + 1);
+        return trimmed.empty() ? std::string("unknown") : trimmed;
+    }();
+    return name.c_str();
+}
+
+// ------------------------------- selection -------------------------------
+
+static const kernelTable* tableFor(KernelLevel level)
+{
+    switch (level)
+    {
+        case KernelLevel::SSE2: return sse2KernelTable();
+        case KernelLevel::AVX2: return avx2KernelTable();
+        case KernelLevel::AVX512: return avx512KernelTable();
+        default: return scalarKernelTable();
+    }
+}
+
+const kernelTable& kernelsFor(KernelLevel level)
+{
+    const KernelLevel supported = detectKernelLevel();
+    if (short(level) > short(supported))
+        level = supported;
+
+    for (short l = short(level); l > short(KernelLevel::Scalar); l--)
+    {
+        if (const kernelTable* table = tableFor(KernelLevel(l)))
+            return *table;
+    }
+    return *scalarKernelTable();
+}
+
+static const kernelTable*& selectedKernels()
+{
+    static const kernelTable* selected = &kernelsFor(detectKernelLevel());
+    return selected;
+}
+
+const kernelTable& activeKernels()
+{
+    return *selectedKernels();
+}
+
+void setKernelLevel(KernelLevel level)
+{
+    selectedKernels() = &kernelsFor(level);
+}
+
+static const int8KernelTable* int8TableFor(KernelLevel level)
+{
+    switch (level)
+    {
+        case KernelLevel::SSE2: return sse2Int8KernelTable();
+        case KernelLevel::AVX2: return avx2Int8KernelTable();
+        case KernelLevel::AVX512:
+        {
+            static const bool vnni = detectVnni();
+            return vnni ? avx512VnniInt8KernelTable() : nullptr;
+        }
+        default: return scalarInt8KernelTable();
+    }
+}
+
+const int8KernelTable& int8KernelsFor(KernelLevel level)
+{
+    const KernelLevel supported = detectKernelLevel();
+    if (short(level) > short(supported))
+        level = supported;
+
+    for (short l = short(level); l > short(KernelLevel::Scalar); l--)
+    {
+        if (const int8KernelTable* table = int8TableFor(KernelLevel(l)))
+            return *table;
+    }
+    return *scalarInt8KernelTable();
+}
+
+const int8KernelTable& activeInt8Kernels()
+{
+    return int8KernelsFor(activeKernels().level);
+}
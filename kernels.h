@@ -0,0 +1,119 @@
+#pragma once
+
+#include "utils.h"
+
+// the innermost loops of the dense layers, implemented once per instruction set.
+// kernels_<isa>.cpp are each built with the compiler flags for that instruction set,
+// and the best one the cpu supports is selected at startup.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AGAIN_X86 1
+#else
+#define AGAIN_X86 0
+#endif
+
+enum class KernelLevel : short
+{
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512,
+    Last
+};
+
+// the constants of one optimizer step, see optimizer in model.h. the gradient of a value w
+// is scale * g + l2 * w, where scale and g are passed to the step kernels.
+struct optimizerStep
+{
+    real learningRate;
+    real momentum;
+    real beta1;
+    real beta2;
+    real correction1;   // Adam's bias corrections at step t, 1 / (1 - beta1^t)
+    real correction2;   // and 1 / (1 - beta2^t)
+    real epsilon;
+    real l2;
+    real decay;         // taken off w as decay * w before the step, for AdamW
+    bool nesterov;
+};
+
+struct kernelTable
+{
+    KernelLevel level;
+    const char* name;
+
+    // returns sum of a[i] * b[i]
+    real (*dot)(const real* a, const real* b, uint32 count);
+
+    // y[i] += alpha * x[i]
+    void (*axpy)(real* y, const real* x, const real alpha, uint32 count);
+
+    // out[3i+k] = ck[i] * scale, three planes of bytes into one interleaved row of reals
+    void (*interleave3)(real* out, const uint8* c0, const uint8* c1, const uint8* c2, const real scale, uint32 count);
+
+    // one optimizer step over count values, each value and its moments read and written
+    // once. momentum keeps a velocity per value, and Adam a first and second moment.
+    void (*momentumStep)(real* w, real* velocity, const real* g, const real scale, const optimizerStep& step, uint32 count);
+    void (*adamStep)(real* w, real* m, real* v, const real* g, const real scale, const optimizerStep& step, uint32 count);
+
+    // the index of the first largest value, 0 when count is 0
+    uint32 (*argmax)(const real* values, uint32 count);
+
+    // how many values are greater than threshold. a value's rank among the rest, so a
+    // class is in the top k when fewer than k scores are greater than its own.
+    uint32 (*countGreater)(const real* values, const real threshold, uint32 count);
+
+    // the register tile of the gemm in gemm.h. c[i][j] += sum over p of a[p][i] * b[p][j]
+    // for gemmRows rows i and gemmCols columns j, with the values a and b have for each p
+    // packed together, and ldc values from one row of c to the next
+    uint32 gemmRows;
+    uint32 gemmCols;
+    void (*gemmTile)(uint32 k, const real* a, const real* b, real* c, uint32 ldc);
+};
+
+// implementations, nullptr when not built for this target
+const kernelTable* scalarKernelTable();
+const kernelTable* sse2KernelTable();
+const kernelTable* avx2KernelTable();
+const kernelTable* avx512KernelTable();
+
+// the best level this cpu and os support, from cpuid
+KernelLevel detectKernelLevel();
+
+// the cpu's brand string, such as "Intel(R) Xeon(R) ...", or "unknown" where there isn't one
+const char* cpuName();
+
+// the table for a level, or the best supported one below it
+const kernelTable& kernelsFor(KernelLevel level);
+
+// the table used by the layers. picked from detectKernelLevel() on first use.
+const kernelTable& activeKernels();
+
+// force a lower level, e.g. KernelLevel::Scalar to compare against the reference path.
+// levels the cpu doesn't support fall back to the best one it does.
+void setKernelLevel(KernelLevel level);
+
+// ------------------------------- int8 kernels -------------------------------
+
+// the inner loop of quantized inference: unsigned 8 bit activations against signed 8 bit
+// weights, summed exactly in 32 bits. weights must be in [-127, 127]. every level gives
+// the same result, so they only differ in speed.
+struct int8KernelTable
+{
+    const char* name;
+
+    // returns sum of x[i] * w[i]
+    int32 (*dot)(const uint8* x, const int8* w, uint32 count);
+};
+
+// implementations, nullptr when not built for this target. the AVX-512 one needs VNNI.
+const int8KernelTable* scalarInt8KernelTable();
+const int8KernelTable* sse2Int8KernelTable();
+const int8KernelTable* avx2Int8KernelTable();
+const int8KernelTable* avx512VnniInt8KernelTable();
+
+// the table for a level, or the best supported one below it
+const int8KernelTable& int8KernelsFor(KernelLevel level);
+
+// the table for the level activeKernels() is at
+const int8KernelTable& activeInt8Kernels();
@@ -0,0 +1,188 @@
+#include "kernels.h"
+
+// built with -mavx2 -mfma (/arch:AVX2). only reached when detectKernelLevel() says the
+// cpu has AVX2 and FMA, so nothing outside the kernel table may be defined here.
+
+#if AGAIN_X86
+
+#include <cstring>
+#include <immintrin.h>
+
+// thin wrappers so the kernels below read the same for float and double
+#if defined(AGAIN_FLOAT)
+
+typedef __m256 vreal;
+const uint32 lanes = 8;
+
+static inline vreal vzero() { return _mm256_setzero_ps(); }
+static inline vreal vset(real a) { return _mm256_set1_ps(a); }
+static inline vreal vload(const real* p) { return _mm256_loadu_ps(p); }
+static inline void vstore(real* p, vreal v) { _mm256_storeu_ps(p, v); }
+static inline vreal vadd(vreal a, vreal b) { return _mm256_add_ps(a, b); }
+static inline vreal vmul(vreal a, vreal b) { return _mm256_mul_ps(a, b); }
+static inline vreal vdiv(vreal a, vreal b) { return _mm256_div_ps(a, b); }
+static inline vreal vsqrt(vreal a) { return _mm256_sqrt_ps(a); }
+static inline vreal vfma(vreal a, vreal b, vreal c) { return _mm256_fmadd_ps(a, b, c); }
+static inline vreal vmax(vreal a, vreal b) { return _mm256_max_ps(a, b); }
+static inline uint32 vmaskgt(vreal a, vreal b) { return uint32(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ))); }
+
+static inline real hsum(vreal v)
+{
+    __m128 q = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    q = _mm_add_ps(q, _mm_movehl_ps(q, q));
+    return _mm_cvtss_f32(_mm_add_ss(q, _mm_shuffle_ps(q, q, 1)));
+}
+
+static inline real hmax(vreal v)
+{
+    __m128 q = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    q = _mm_max_ps(q, _mm_movehl_ps(q, q));
+    return _mm_cvtss_f32(_mm_max_ss(q, _mm_shuffle_ps(q, q, 1)));
+}
+
+// lanes bytes widened to reals
+static inline vreal vloadu8(const uint8* p)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+}
+
+// stores a, b and c interleaved: a0 b0 c0 a1 b1 c1 ... each output vector gathers its
+// values from all three inputs, then keeps each one from the input it belongs to
+static inline void vstore3(real* p, vreal a, vreal b, vreal c)
+{
+    const __m256i i0 = _mm256_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2);
+    const __m256i i1 = _mm256_setr_epi32(2, 3, 3, 3, 4, 4, 4, 5);
+    const __m256i i2 = _mm256_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7);
+    _mm256_storeu_ps(p + 0, _mm256_blend_ps(_mm256_blend_ps(_mm256_permutevar8x32_ps(a, i0), _mm256_permutevar8x32_ps(b, i0), 0x92), _mm256_permutevar8x32_ps(c, i0), 0x24));
+    _mm256_storeu_ps(p + 8, _mm256_blend_ps(_mm256_blend_ps(_mm256_permutevar8x32_ps(a, i1), _mm256_permutevar8x32_ps(b, i1), 0x24), _mm256_permutevar8x32_ps(c, i1), 0x49));
+    _mm256_storeu_ps(p + 16, _mm256_blend_ps(_mm256_blend_ps(_mm256_permutevar8x32_ps(a, i2), _mm256_permutevar8x32_ps(b, i2), 0x49), _mm256_permutevar8x32_ps(c, i2), 0x92));
+}
+
+#else
+
+typedef __m256d vreal;
+const uint32 lanes = 4;
+
+static inline vreal vzero() { return _mm256_setzero_pd(); }
+static inline vreal vset(real a) { return _mm256_set1_pd(a); }
+static inline vreal vload(const real* p) { return _mm256_loadu_pd(p); }
+static inline void vstore(real* p, vreal v) { _mm256_storeu_pd(p, v); }
+static inline vreal vadd(vreal a, vreal b) { return _mm256_add_pd(a, b); }
+static inline vreal vmul(vreal a, vreal b) { return _mm256_mul_pd(a, b); }
+static inline vreal vdiv(vreal a, vreal b) { return _mm256_div_pd(a, b); }
+static inline vreal vsqrt(vreal a) { return _mm256_sqrt_pd(a); }
+static inline vreal vfma(vreal a, vreal b, vreal c) { return _mm256_fmadd_pd(a, b, c); }
+static inline vreal vmax(vreal a, vreal b) { return _mm256_max_pd(a, b); }
+static inline uint32 vmaskgt(vreal a, vreal b) { return uint32(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GT_OQ))); }
+
+static inline real hsum(vreal v)
+{
+    const __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+static inline real hmax(vreal v)
+{
+    const __m128d pair = _mm_max_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_max_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+// lanes bytes widened to reals
+static inline vreal vloadu8(const uint8* p)
+{
+    int bytes;
+    memcpy(&bytes, p, sizeof(bytes));
+    return _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes)));
+}
+
+// stores a, b and c interleaved: a0 b0 c0 a1 b1 c1 ... each output vector gathers its
+// values from all three inputs, then keeps each one from the input it belongs to
+static inline void vstore3(real* p, vreal a, vreal b, vreal c)
+{
+    _mm256_storeu_pd(p + 0, _mm256_blend_pd(_mm256_blend_pd(_mm256_permute4x64_pd(a, 0x40), _mm256_permute4x64_pd(b, 0x40), 0x2), _mm256_permute4x64_pd(c, 0x40), 0x4));
+    _mm256_storeu_pd(p + 4, _mm256_blend_pd(_mm256_blend_pd(_mm256_permute4x64_pd(a, 0xa5), _mm256_permute4x64_pd(b, 0xa5), 0x9), _mm256_permute4x64_pd(c, 0xa5), 0x2));
+    _mm256_storeu_pd(p + 8, _mm256_blend_pd(_mm256_blend_pd(_mm256_permute4x64_pd(a, 0xfe), _mm256_permute4x64_pd(b, 0xfe), 0x4), _mm256_permute4x64_pd(c, 0xfe), 0x9));
+}
+
+#endif
+
+#include "kernels_simd.inl"
+
+static const kernelTable avx2Table = {
+    KernelLevel::AVX2,
+    "avx2",
+    simd_dot,
+    simd_axpy,
+    simd_interleave3,
+    simd_momentumStep,
+    simd_adamStep,
+    simd_argmax,
+    simd_countGreater,
+    simdGemmRows,
+    simdGemmCols,
+    simd_gemmTile
+};
+
+const kernelTable* avx2KernelTable()
+{
+    return &avx2Table;
+}
+
+// ------------------------------- int8 -------------------------------
+
+// widens 16 values of each to 16 bits and sums the products in pairs into 8 int32s.
+// not _mm256_maddubs_epi16, which saturates its 16 bit sums.
+static inline __m256i maddInt8(const uint8* x, const int8* w)
+{
+    const __m256i xw = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x)));
+    const __m256i ww = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w)));
+    return _mm256_madd_epi16(xw, ww);
+}
+
+static int32 avx2_dot_int8(const uint8* x, const int8* w, uint32 count)
+{
+    __m256i s0 = _mm256_setzero_si256();
+    __m256i s1 = _mm256_setzero_si256();
+
+    uint32 i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        s0 = _mm256_add_epi32(s0, maddInt8(x + i, w + i));
+        s1 = _mm256_add_epi32(s1, maddInt8(x + i + 16, w + i + 16));
+    }
+    for (; i + 16 <= count; i += 16)
+        s0 = _mm256_add_epi32(s0, maddInt8(x + i, w + i));
+
+    const __m256i s = _mm256_add_epi32(s0, s1);
+    __m128i q = _mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+    q = _mm_add_epi32(q, _mm_shuffle_epi32(q, _MM_SHUFFLE(1, 0, 3, 2)));
+    q = _mm_add_epi32(q, _mm_shuffle_epi32(q, _MM_SHUFFLE(2, 3, 0, 1)));
+    int32 total = _mm_cvtsi128_si32(q);
+    for (; i < count; i++)
+        total += int32(x[i]) * int32(w[i]);
+    return total;
+}
+
+static const int8KernelTable avx2Int8Table = {
+    "avx2",
+    avx2_dot_int8
+};
+
+const int8KernelTable* avx2Int8KernelTable()
+{
+    return &avx2Int8Table;
+}
+
+#else
+
+const kernelTable* avx2KernelTable()
+{
+    return nullptr;
+}
+
+const int8KernelTable* avx2Int8KernelTable()
+{
+    return nullptr;
+}
+
+#endif
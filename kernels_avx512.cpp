@@ -0,0 +1,116 @@
+#include "kernels.h"
+
+// built with -mavx512f (/arch:AVX512). only reached when detectKernelLevel() says the
+// cpu and os support AVX-512F, so nothing outside the kernel table may be defined here.
+
+#if AGAIN_X86
+
+#include <immintrin.h>
+
+// thin wrappers so the kernels below read the same for float and double
+#if defined(AGAIN_FLOAT)
+
+typedef __m512 vreal;
+const uint32 lanes = 16;
+
+static inline vreal vzero() { return _mm512_setzero_ps(); }
+static inline vreal vset(real a) { return _mm512_set1_ps(a); }
+static inline vreal vload(const real* p) { return _mm512_loadu_ps(p); }
+static inline void vstore(real* p, vreal v) { _mm512_storeu_ps(p, v); }
+static inline vreal vadd(vreal a, vreal b) { return _mm512_add_ps(a, b); }
+static inline vreal vmul(vreal a, vreal b) { return _mm512_mul_ps(a, b); }
+static inline vreal vdiv(vreal a, vreal b) { return _mm512_div_ps(a, b); }
+static inline vreal vsqrt(vreal a) { return _mm512_sqrt_ps(a); }
+static inline vreal vfma(vreal a, vreal b, vreal c) { return _mm512_fmadd_ps(a, b, c); }
+static inline vreal vmax(vreal a, vreal b) { return _mm512_max_ps(a, b); }
+static inline uint32 vmaskgt(vreal a, vreal b) { return uint32(_mm512_cmp_ps_mask(a, b, _CMP_GT_OQ)); }
+static inline real hsum(vreal v) { return _mm512_reduce_add_ps(v); }
+static inline real hmax(vreal v) { return _mm512_reduce_max_ps(v); }
+
+// lanes bytes widened to reals
+static inline vreal vloadu8(const uint8* p)
+{
+    return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+}
+
+// stores a, b and c interleaved: a0 b0 c0 a1 b1 c1 ... each output vector gathers its
+// values from all three inputs, then keeps each one from the input it belongs to
+static inline void vstore3(real* p, vreal a, vreal b, vreal c)
+{
+    const __m512i i0 = _mm512_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+    const __m512i i1 = _mm512_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+    const __m512i i2 = _mm512_setr_epi32(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+    _mm512_storeu_ps(p + 0, _mm512_mask_blend_ps(0x4924, _mm512_mask_blend_ps(0x2492, _mm512_permutexvar_ps(i0, a), _mm512_permutexvar_ps(i0, b)), _mm512_permutexvar_ps(i0, c)));
+    _mm512_storeu_ps(p + 16, _mm512_mask_blend_ps(0x2492, _mm512_mask_blend_ps(0x9249, _mm512_permutexvar_ps(i1, a), _mm512_permutexvar_ps(i1, b)), _mm512_permutexvar_ps(i1, c)));
+    _mm512_storeu_ps(p + 32, _mm512_mask_blend_ps(0x9249, _mm512_mask_blend_ps(0x4924, _mm512_permutexvar_ps(i2, a), _mm512_permutexvar_ps(i2, b)), _mm512_permutexvar_ps(i2, c)));
+}
+
+#else
+
+typedef __m512d vreal;
+const uint32 lanes = 8;
+
+static inline vreal vzero() { return _mm512_setzero_pd(); }
+static inline vreal vset(real a) { return _mm512_set1_pd(a); }
+static inline vreal vload(const real* p) { return _mm512_loadu_pd(p); }
+static inline void vstore(real* p, vreal v) { _mm512_storeu_pd(p, v); }
+static inline vreal vadd(vreal a, vreal b) { return _mm512_add_pd(a, b); }
+static inline vreal vmul(vreal a, vreal b) { return _mm512_mul_pd(a, b); }
+static inline vreal vdiv(vreal a, vreal b) { return _mm512_div_pd(a, b); }
+static inline vreal vsqrt(vreal a) { return _mm512_sqrt_pd(a); }
+static inline vreal vfma(vreal a, vreal b, vreal c) { return _mm512_fmadd_pd(a, b, c); }
+static inline vreal vmax(vreal a, vreal b) { return _mm512_max_pd(a, b); }
+static inline uint32 vmaskgt(vreal a, vreal b) { return uint32(_mm512_cmp_pd_mask(a, b, _CMP_GT_OQ)); }
+static inline real hsum(vreal v) { return _mm512_reduce_add_pd(v); }
+static inline real hmax(vreal v) { return _mm512_reduce_max_pd(v); }
+
+// lanes bytes widened to reals
+static inline vreal vloadu8(const uint8* p)
+{
+    return _mm512_cvtepi32_pd(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+}
+
+// stores a, b and c interleaved: a0 b0 c0 a1 b1 c1 ... each output vector gathers its
+// values from all three inputs, then keeps each one from the input it belongs to
+static inline void vstore3(real* p, vreal a, vreal b, vreal c)
+{
+    const __m512i i0 = _mm512_setr_epi64(0, 0, 0, 1, 1, 1, 2, 2);
+    const __m512i i1 = _mm512_setr_epi64(2, 3, 3, 3, 4, 4, 4, 5);
+    const __m512i i2 = _mm512_setr_epi64(5, 5, 6, 6, 6, 7, 7, 7);
+    _mm512_storeu_pd(p + 0, _mm512_mask_blend_pd(0x24, _mm512_mask_blend_pd(0x92, _mm512_permutexvar_pd(i0, a), _mm512_permutexvar_pd(i0, b)), _mm512_permutexvar_pd(i0, c)));
+    _mm512_storeu_pd(p + 8, _mm512_mask_blend_pd(0x49, _mm512_mask_blend_pd(0x24, _mm512_permutexvar_pd(i1, a), _mm512_permutexvar_pd(i1, b)), _mm512_permutexvar_pd(i1, c)));
+    _mm512_storeu_pd(p + 16, _mm512_mask_blend_pd(0x92, _mm512_mask_blend_pd(0x49, _mm512_permutexvar_pd(i2, a), _mm512_permutexvar_pd(i2, b)), _mm512_permutexvar_pd(i2, c)));
+}
+
+#endif
+
+#include "kernels_simd.inl"
+
+static const kernelTable avx512Table = {
+    KernelLevel::AVX512,
+    "avx512",
+    simd_dot,
+    simd_axpy,
+    simd_interleave3,
+    simd_momentumStep,
+    simd_adamStep,
+    simd_argmax,
+    simd_countGreater,
+    simdGemmRows,
+    simdGemmCols,
+    simd_gemmTile
+};
+
+const kernelTable* avx512KernelTable()
+{
+    return &avx512Table;
+}
+
+#else
+
+const kernelTable* avx512KernelTable()
+{
+    return nullptr;
+}
+
+#endif
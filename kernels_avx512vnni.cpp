@@ -0,0 +1,48 @@
+#include "kernels.h"
+
+// built with -mavx512f -mavx512vnni (/arch:AVX512). only reached when the cpu has
+// AVX-512 VNNI, whose vpdpbusd multiplies unsigned by signed bytes and adds each group of
+// four products into an int32 in one instruction, without saturating.
+
+#if AGAIN_X86
+
+#include <immintrin.h>
+
+static int32 vnni_dot_int8(const uint8* x, const int8* w, uint32 count)
+{
+    __m512i s0 = _mm512_setzero_si512();
+    __m512i s1 = _mm512_setzero_si512();
+
+    uint32 i = 0;
+    for (; i + 128 <= count; i += 128)
+    {
+        s0 = _mm512_dpbusd_epi32(s0, _mm512_loadu_si512(x + i), _mm512_loadu_si512(w + i));
+        s1 = _mm512_dpbusd_epi32(s1, _mm512_loadu_si512(x + i + 64), _mm512_loadu_si512(w + i + 64));
+    }
+    for (; i + 64 <= count; i += 64)
+        s0 = _mm512_dpbusd_epi32(s0, _mm512_loadu_si512(x + i), _mm512_loadu_si512(w + i));
+
+    int32 total = _mm512_reduce_add_epi32(_mm512_add_epi32(s0, s1));
+    for (; i < count; i++)
+        total += int32(x[i]) * int32(w[i]);
+    return total;
+}
+
+static const int8KernelTable vnniInt8Table = {
+    "avx512vnni",
+    vnni_dot_int8
+};
+
+const int8KernelTable* avx512VnniInt8KernelTable()
+{
+    return &vnniInt8Table;
+}
+
+#else
+
+const int8KernelTable* avx512VnniInt8KernelTable()
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,209 @@
+// kernel bodies shared by the instruction set files. each kernels_<isa>.cpp defines
+// vreal, lanes and the v* wrappers for its registers before including this, so the
+// same source is compiled once per instruction set.
+
+static real simd_dot(const real* a, const real* b, uint32 count)
+{
+    // four independent accumulators to cover the latency of the multiply-add units
+    vreal s0 = vzero();
+    vreal s1 = vzero();
+    vreal s2 = vzero();
+    vreal s3 = vzero();
+
+    uint32 i = 0;
+    for (; i + 4*lanes <= count; i += 4*lanes)
+    {
+        s0 = vfma(vload(a + i), vload(b + i), s0);
+        s1 = vfma(vload(a + i + lanes), vload(b + i + lanes), s1);
+        s2 = vfma(vload(a + i + 2*lanes), vload(b + i + 2*lanes), s2);
+        s3 = vfma(vload(a + i + 3*lanes), vload(b + i + 3*lanes), s3);
+    }
+    for (; i + lanes <= count; i += lanes)
+        s0 = vfma(vload(a + i), vload(b + i), s0);
+
+    real sum = hsum(vadd(vadd(s0, s1), vadd(s2, s3)));
+    for (; i < count; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static void simd_axpy(real* y, const real* x, const real alpha, uint32 count)
+{
+    const vreal a = vset(alpha);
+
+    uint32 i = 0;
+    for (; i + 4*lanes <= count; i += 4*lanes)
+    {
+        vstore(y + i, vfma(a, vload(x + i), vload(y + i)));
+        vstore(y + i + lanes, vfma(a, vload(x + i + lanes), vload(y + i + lanes)));
+        vstore(y + i + 2*lanes, vfma(a, vload(x + i + 2*lanes), vload(y + i + 2*lanes)));
+        vstore(y + i + 3*lanes, vfma(a, vload(x + i + 3*lanes), vload(y + i + 3*lanes)));
+    }
+    for (; i + lanes <= count; i += lanes)
+        vstore(y + i, vfma(a, vload(x + i), vload(y + i)));
+
+    for (; i < count; i++)
+        y[i] += alpha * x[i];
+}
+
+static void simd_interleave3(real* out, const uint8* c0, const uint8* c1, const uint8* c2, const real scale, uint32 count)
+{
+    const vreal s = vset(scale);
+
+    uint32 i = 0;
+    for (; i + lanes <= count; i += lanes)
+        vstore3(out + 3*i, vmul(vloadu8(c0 + i), s), vmul(vloadu8(c1 + i), s), vmul(vloadu8(c2 + i), s));
+
+    for (; i < count; i++)
+    {
+        out[3*i+0] = c0[i] * scale;
+        out[3*i+1] = c1[i] * scale;
+        out[3*i+2] = c2[i] * scale;
+    }
+}
+
+static void simd_momentumStep(real* w, real* velocity, const real* g, const real scale, const optimizerStep& step, uint32 count)
+{
+    const vreal s = vset(scale);
+    const vreal l2 = vset(step.l2);
+    const vreal mu = vset(step.momentum);
+    const vreal rate = vset(-step.learningRate);
+
+    uint32 i = 0;
+    for (; i + lanes <= count; i += lanes)
+    {
+        const vreal wi = vload(w + i);
+        const vreal gi = vfma(s, vload(g + i), vmul(l2, wi));
+        const vreal vi = vfma(mu, vload(velocity + i), gi);
+        vstore(velocity + i, vi);
+        vstore(w + i, vfma(rate, step.nesterov ? vfma(mu, vi, gi) : vi, wi));
+    }
+
+    for (; i < count; i++)
+    {
+        const real gi = scale * g[i] + step.l2 * w[i];
+        const real vi = step.momentum * velocity[i] + gi;
+        velocity[i] = vi;
+        w[i] -= step.learningRate * (step.nesterov ? gi + step.momentum * vi : vi);
+    }
+}
+
+static void simd_adamStep(real* w, real* m, real* v, const real* g, const real scale, const optimizerStep& step, uint32 count)
+{
+    const vreal s = vset(scale);
+    const vreal l2 = vset(step.l2);
+    const vreal keep = vset(1 - step.decay);
+    const vreal b1 = vset(step.beta1);
+    const vreal b2 = vset(step.beta2);
+    const vreal a1 = vset(1 - step.beta1);
+    const vreal a2 = vset(1 - step.beta2);
+    const vreal c1 = vset(-step.learningRate * step.correction1);
+    const vreal c2 = vset(step.correction2);
+    const vreal eps = vset(step.epsilon);
+
+    uint32 i = 0;
+    for (; i + lanes <= count; i += lanes)
+    {
+        const vreal wi = vload(w + i);
+        const vreal gi = vfma(s, vload(g + i), vmul(l2, wi));
+        const vreal mi = vfma(b1, vload(m + i), vmul(a1, gi));
+        const vreal vi = vfma(b2, vload(v + i), vmul(a2, vmul(gi, gi)));
+        vstore(m + i, mi);
+        vstore(v + i, vi);
+        vstore(w + i, vfma(c1, vdiv(mi, vadd(vsqrt(vmul(vi, c2)), eps)), vmul(keep, wi)));
+    }
+
+    // the tail through the scalar kernel, rather than a std::sqrt built for this instruction set
+    if (i < count)
+        scalarKernelTable()->adamStep(w + i, m + i, v + i, g + i, scale, step, count - i);
+}
+
+// the register tile of the gemm: six rows by two vectors of columns is twelve accumulators,
+// which with the two vectors of b and a broadcast of a fits in sixteen registers
+const uint32 simdGemmRows = 6;
+const uint32 simdGemmCols = 2 * lanes;
+
+static void simd_gemmTile(uint32 k, const real* a, const real* b, real* c, uint32 ldc)
+{
+    vreal c00 = vzero(), c01 = vzero();
+    vreal c10 = vzero(), c11 = vzero();
+    vreal c20 = vzero(), c21 = vzero();
+    vreal c30 = vzero(), c31 = vzero();
+    vreal c40 = vzero(), c41 = vzero();
+    vreal c50 = vzero(), c51 = vzero();
+
+    for (uint32 p=0; p < k; p++, a += simdGemmRows, b += simdGemmCols)
+    {
+        const vreal b0 = vload(b);
+        const vreal b1 = vload(b + lanes);
+        vreal ai;
+        ai = vset(a[0]); c00 = vfma(ai, b0, c00); c01 = vfma(ai, b1, c01);
+        ai = vset(a[1]); c10 = vfma(ai, b0, c10); c11 = vfma(ai, b1, c11);
+        ai = vset(a[2]); c20 = vfma(ai, b0, c20); c21 = vfma(ai, b1, c21);
+        ai = vset(a[3]); c30 = vfma(ai, b0, c30); c31 = vfma(ai, b1, c31);
+        ai = vset(a[4]); c40 = vfma(ai, b0, c40); c41 = vfma(ai, b1, c41);
+        ai = vset(a[5]); c50 = vfma(ai, b0, c50); c51 = vfma(ai, b1, c51);
+    }
+
+    vstore(c, vadd(vload(c), c00)); vstore(c + lanes, vadd(vload(c + lanes), c01)); c += ldc;
+    vstore(c, vadd(vload(c), c10)); vstore(c + lanes, vadd(vload(c + lanes), c11)); c += ldc;
+    vstore(c, vadd(vload(c), c20)); vstore(c + lanes, vadd(vload(c + lanes), c21)); c += ldc;
+    vstore(c, vadd(vload(c), c30)); vstore(c + lanes, vadd(vload(c + lanes), c31)); c += ldc;
+    vstore(c, vadd(vload(c), c40)); vstore(c + lanes, vadd(vload(c + lanes), c41)); c += ldc;
+    vstore(c, vadd(vload(c), c50)); vstore(c + lanes, vadd(vload(c + lanes), c51));
+}
+
+// the set bits of a lane mask from vmaskgt
+static inline uint32 countLanes(uint32 mask)
+{
+    uint32 count = 0;
+    for (; mask; mask &= mask - 1)
+        count++;
+    return count;
+}
+
+static uint32 simd_argmax(const real* values, uint32 count)
+{
+    if (count == 0)
+        return 0;
+
+    // the largest value a vector at a time, then the first lane that holds it
+    uint32 i = 0;
+    real largest = values[0];
+    if (count >= lanes)
+    {
+        vreal m = vload(values);
+        for (i = lanes; i + lanes <= count; i += lanes)
+            m = vmax(m, vload(values + i));
+        largest = hmax(m);
+    }
+    for (; i < count; i++)
+        largest = (values[i] > largest) ? values[i] : largest;
+
+    const vreal l = vset(largest);
+    const uint32 allLanes = (1u << lanes) - 1;
+    for (i = 0; i + lanes <= count; i += lanes)
+    {
+        const uint32 found = ~vmaskgt(l, vload(values + i)) & allLanes;
+        if (found)
+            return i + countLanes((found & (0u - found)) - 1);
+    }
+    for (; i < count; i++)
+    {
+        if (values[i] >= largest)
+            return i;
+    }
+    return 0;
+}
+
+static uint32 simd_countGreater(const real* values, const real threshold, uint32 count)
+{
+    const vreal t = vset(threshold);
+    uint32 greater = 0;
+    uint32 i = 0;
+    for (; i + lanes <= count; i += lanes)
+        greater += countLanes(vmaskgt(vload(values + i), t));
+    for (; i < count; i++)
+        greater += (values[i] > threshold) ? 1 : 0;
+    return greater;
+}
@@ -0,0 +1,183 @@
+#include "kernels.h"
+
+// SSE2 is the baseline for x86-64, so this needs no extra compiler flags there.
+// there is no fma at this level, so products and sums are separate instructions.
+
+#if AGAIN_X86
+
+#include <cstring>
+#include <emmintrin.h>
+
+// thin wrappers so the kernels below read the same for float and double
+#if defined(AGAIN_FLOAT)
+
+typedef __m128 vreal;
+const uint32 lanes = 4;
+
+static inline vreal vzero() { return _mm_setzero_ps(); }
+static inline vreal vset(real a) { return _mm_set1_ps(a); }
+static inline vreal vload(const real* p) { return _mm_loadu_ps(p); }
+static inline void vstore(real* p, vreal v) { _mm_storeu_ps(p, v); }
+static inline vreal vadd(vreal a, vreal b) { return _mm_add_ps(a, b); }
+static inline vreal vmul(vreal a, vreal b) { return _mm_mul_ps(a, b); }
+static inline vreal vdiv(vreal a, vreal b) { return _mm_div_ps(a, b); }
+static inline vreal vsqrt(vreal a) { return _mm_sqrt_ps(a); }
+static inline vreal vfma(vreal a, vreal b, vreal c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+static inline vreal vmax(vreal a, vreal b) { return _mm_max_ps(a, b); }
+static inline uint32 vmaskgt(vreal a, vreal b) { return uint32(_mm_movemask_ps(_mm_cmpgt_ps(a, b))); }
+
+static inline real hsum(vreal v)
+{
+    const __m128 q = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_add_ss(q, _mm_shuffle_ps(q, q, 1)));
+}
+
+static inline real hmax(vreal v)
+{
+    const __m128 q = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_max_ss(q, _mm_shuffle_ps(q, q, 1)));
+}
+
+// lanes bytes widened to reals
+static inline vreal vloadu8(const uint8* p)
+{
+    int bytes;
+    memcpy(&bytes, p, sizeof(bytes));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+}
+
+// stores a, b and c interleaved: a0 b0 c0 a1 b1 c1 ...
+static inline void vstore3(real* p, vreal a, vreal b, vreal c)
+{
+    const __m128 ab0 = _mm_unpacklo_ps(a, b);                                  // a0 b0 a1 b1
+    const __m128 ab1 = _mm_unpackhi_ps(a, b);                                  // a2 b2 a3 b3
+    const __m128 c0a1 = _mm_shuffle_ps(c, a, _MM_SHUFFLE(1, 1, 0, 0));          // c0 c0 a1 a1
+    const __m128 b1c1 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 1, 1));          // b1 b1 c1 c1
+    const __m128 c2a3 = _mm_shuffle_ps(c, a, _MM_SHUFFLE(3, 3, 2, 2));          // c2 c2 a3 a3
+    const __m128 b3c3 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(3, 3, 3, 3));          // b3 b3 c3 c3
+    _mm_storeu_ps(p + 0, _mm_shuffle_ps(ab0, c0a1, _MM_SHUFFLE(2, 0, 1, 0)));    // a0 b0 c0 a1
+    _mm_storeu_ps(p + 4, _mm_shuffle_ps(b1c1, ab1, _MM_SHUFFLE(1, 0, 2, 0)));    // b1 c1 a2 b2
+    _mm_storeu_ps(p + 8, _mm_shuffle_ps(c2a3, b3c3, _MM_SHUFFLE(2, 0, 2, 0)));   // c2 a3 b3 c3
+}
+
+#else
+
+typedef __m128d vreal;
+const uint32 lanes = 2;
+
+static inline vreal vzero() { return _mm_setzero_pd(); }
+static inline vreal vset(real a) { return _mm_set1_pd(a); }
+static inline vreal vload(const real* p) { return _mm_loadu_pd(p); }
+static inline void vstore(real* p, vreal v) { _mm_storeu_pd(p, v); }
+static inline vreal vadd(vreal a, vreal b) { return _mm_add_pd(a, b); }
+static inline vreal vmul(vreal a, vreal b) { return _mm_mul_pd(a, b); }
+static inline vreal vdiv(vreal a, vreal b) { return _mm_div_pd(a, b); }
+static inline vreal vsqrt(vreal a) { return _mm_sqrt_pd(a); }
+static inline vreal vfma(vreal a, vreal b, vreal c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+static inline vreal vmax(vreal a, vreal b) { return _mm_max_pd(a, b); }
+static inline uint32 vmaskgt(vreal a, vreal b) { return uint32(_mm_movemask_pd(_mm_cmpgt_pd(a, b))); }
+
+static inline real hsum(vreal v)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+static inline real hmax(vreal v)
+{
+    return _mm_cvtsd_f64(_mm_max_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+// lanes bytes widened to reals
+static inline vreal vloadu8(const uint8* p)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(p[0] | (p[1] << 8)), zero);
+    return _mm_cvtepi32_pd(_mm_unpacklo_epi16(words, zero));
+}
+
+// stores a, b and c interleaved: a0 b0 c0 a1 b1 c1
+static inline void vstore3(real* p, vreal a, vreal b, vreal c)
+{
+    _mm_storeu_pd(p + 0, _mm_unpacklo_pd(a, b));
+    _mm_storeu_pd(p + 2, _mm_shuffle_pd(c, a, 2));
+    _mm_storeu_pd(p + 4, _mm_unpackhi_pd(b, c));
+}
+
+#endif
+
+#include "kernels_simd.inl"
+
+static const kernelTable sse2Table = {
+    KernelLevel::SSE2,
+    "sse2",
+    simd_dot,
+    simd_axpy,
+    simd_interleave3,
+    simd_momentumStep,
+    simd_adamStep,
+    simd_argmax,
+    simd_countGreater,
+    simdGemmRows,
+    simdGemmCols,
+    simd_gemmTile
+};
+
+const kernelTable* sse2KernelTable()
+{
+    return &sse2Table;
+}
+
+// ------------------------------- int8 -------------------------------
+
+static int32 sse2_dot_int8(const uint8* x, const int8* w, uint32 count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = _mm_setzero_si128();
+
+    uint32 i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        // widen to 16 bits: x by unpacking with zeros, w by unpacking it with itself so
+        // each value lands in the high byte, then shifting it back down with its sign
+        const __m128i xv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        const __m128i wv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i));
+        const __m128i xlo = _mm_unpacklo_epi8(xv, zero);
+        const __m128i xhi = _mm_unpackhi_epi8(xv, zero);
+        const __m128i wlo = _mm_srai_epi16(_mm_unpacklo_epi8(wv, wv), 8);
+        const __m128i whi = _mm_srai_epi16(_mm_unpackhi_epi8(wv, wv), 8);
+        sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_madd_epi16(xlo, wlo), _mm_madd_epi16(xhi, whi)));
+    }
+
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    int32 total = _mm_cvtsi128_si32(sum);
+    for (; i < count; i++)
+        total += int32(x[i]) * int32(w[i]);
+    return total;
+}
+
+static const int8KernelTable sse2Int8Table = {
+    "sse2",
+    sse2_dot_int8
+};
+
+const int8KernelTable* sse2Int8KernelTable()
+{
+    return &sse2Int8Table;
+}
+
+#else
+
+const kernelTable* sse2KernelTable()
+{
+    return nullptr;
+}
+
+const int8KernelTable* sse2Int8KernelTable()
+{
+    return nullptr;
+}
+
+#endif
@@ -3,12 +3,11 @@
 
 #include "model.h"
 #include "render.h"
+#include "staticmodel.h"
+#include "trainer.h"
 
 int main(int, char**)
 {
-    // stable random values
-    srand(101010101);
-
     const matrix inputs = {
         {.1, .1},
         {.9, .1},
@@ -39,10 +38,13 @@ int main(int, char**)
         {.1, .1, .97},                         
     };
 
+    // input layer (x,y), hiddenB, output layer (r,g,b)
+    using gridModel = staticModel<2,
+        staticLayer<8, ActivationFunction::Sigmoid>,
+        staticLayer<3, ActivationFunction::Sigmoid>>;
+
     model m;
-    layer* l = m.AddInputLayer(2); // input layer (x,y)
-    l = m.AddDenseLayer(8, ActivationFunction::Sigmoid, l); // hiddenB
-    l = m.AddDenseLayer(3, ActivationFunction::Sigmoid, l); // output layer (r,g,b)
+    gridModel::AddLayers(m);
 
     renderWindow rw;
 
@@ -50,39 +52,54 @@ int main(int, char**)
      matrix outs(gridSize*gridSize);
      for (auto&& o : outs)
          o.resize(3, 0); // (r,g,b)
-    
-    bool running = 1;
-    while (running)
-    {
-        m.Train(inputs, targets, 100, 0.1);
 
-        for (int y=0; y < gridSize; y++)
+    // (x,y) of every cell in the grid, predicted together each frame
+    matrix gridInputs(gridSize*gridSize);
+    for (int y=0; y < gridSize; y++)
+    {
+        for (int x=0; x < gridSize; x++)
         {
-            for (int x=0; x < gridSize; x++)
-            {
-                column ins(2); // (x,y)
-                ins[0] = x*1.0/gridSize;
-                ins[1] = y*1.0/gridSize;
-                m.PredictSingleInput(ins, outs[y*gridSize+x]);                
-            }
+            column& ins = gridInputs[y*gridSize+x];
+            ins.resize(2);
+            ins[0] = x*1.0/gridSize;
+            ins[1] = y*1.0/gridSize;
         }
+    }
+
+    // each frame's predictions come from a copy of the snapshot with the layers compiled in
+    gridModel frame;
 
-        column tmp1(3);
-        column tmp2(3);
-        column tmp3(3);
-        m.PredictSingleInput(inputs[0], tmp1);       
-        m.PredictSingleInput(inputs[1], tmp2);       
-        m.PredictSingleInput(inputs[2], tmp3);       
+    // the model trains on a thread of its own, and each frame draws the newest snapshot
+    // of it, so the window keeps its frame rate however long the training takes
+    backgroundTrainer trainer;
+    trainer.Start(m, [&](model& trained) { trained.Train(inputs, targets, 100, 0.1); });
+
+    column tmp1(3);
+    column tmp2(3);
+    column tmp3(3);
+
+    bool running = 1;
+    while (running)
+    {
+        model& snapshot = trainer.Latest();
+        frame.CopyFrom(snapshot);
+        frame.PredictBatch(gridInputs, outs);
+
+        frame.PredictSingleInput(inputs[0], tmp1);
+        frame.PredictSingleInput(inputs[1], tmp2);
+        frame.PredictSingleInput(inputs[2], tmp3);
 
         rw.ProcessEvents(running);
 
         rw.BeginDisplay();
-        rw.DisplayTitle(m.epoch, m.loss, "Again");
+        rw.DisplayTitle(snapshot.epoch, snapshot.loss, "Again");
         rw.DisplayGrid(
-            m.layers.back()->gradients, 
+            snapshot.layers.back()->gradients, 
             tmp1, tmp2, tmp3,
             gridSize, 
             outs);
         rw.EndDisplay();
     }
+
+    trainer.Stop();
 }
@@ -1,75 +1,73 @@
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <random>
 #include <iostream>
+#include <limits>
 
+#include "activations.h"
+#include "gemm.h"
+#include "kernels.h"
 #include "model.h"
+#include "trace.h"
 
-int argmax(const column& values)
+int argmax(constColumnView values)
 {
-    int index = 0;
-    double highest = -1000;
-    for(int i=0; i < values.size(); i++)
-    {
-        if (values[i] > highest)
-        {
-            highest = values[i];
-            index = i;
-        }
-    }
-    return index;
+    return int(activeKernels().argmax(values.data(), values.size()));
 }
 
 // ------------------------------- activation functons -------------------------------
 
-double activation_function_sigmoid(const double input)
+real activation_function_sigmoid(const real input)
 {
-	return 1  / (1 + exp(-input));
+    return activation<ActivationFunction::Sigmoid>::Apply(input);
 }
 
-double activation_function_sigmoid_derivative(const double input)
+real activation_function_sigmoid_derivative(const real input)
 {
-	return input * (1 - input);
+    return activation<ActivationFunction::Sigmoid>::Derivative(input);
 }
 
-double activation_function_relu(const double input)
+real activation_function_relu(const real input)
 {
-    return std::max(0.0, input);
+    return activation<ActivationFunction::Relu>::Apply(input);
 }
 
-double activation_function_relu_derivative(const double input)
+real activation_function_relu_derivative(const real input)
 {
-    return (input > 0.0) ? 1.0 : 0.0;
+    return activation<ActivationFunction::Relu>::Derivative(input);
 }
 
-double activation_function_softmax(const double input)
+real activation_function_softmax(const real input)
 {
-    // just return the input, it'll be classified later
-    return input;
+    return activation<ActivationFunction::Softmax>::Apply(input);
 }
 
-double activation_function_softmax_derivative(const double input)
+real activation_function_softmax_derivative(const real input)
 {
-    return input * (1 - input);
+    return activation<ActivationFunction::Softmax>::Derivative(input);
 }
 
 // takes an array of all the inputs, not just a single input
 column softmax(const column& inputs) 
 {
-    double maxInput = *std::max_element(inputs.begin(), inputs.end());
+    real maxInput = *std::max_element(inputs.begin(), inputs.end());
     column expValues(inputs.size());
-    double sumExpValues = 0.0;
+    real sumExpValues = 0.0;
 
     // Compute the exponentials and sum them
     for (size_t i = 0; i < inputs.size(); ++i) 
     {
-        expValues[i] = exp(inputs[i] - maxInput);  // Subtract maxInput for numerical stability
+        expValues[i] = std::exp(inputs[i] - maxInput);  // Subtract maxInput for numerical stability
         sumExpValues += expValues[i];
     }
 
     // Normalize to get probabilities
-    for (double& val : expValues) {
-        assert(!isnan(val));
+    for (real& val : expValues) {
+        assert(!std::isnan(val));
         val /= sumExpValues;
     }
 
@@ -84,70 +82,115 @@ static ActivationFuncPtr activationFuncPtrs[5][2] = {
     {nullptr, nullptr}
 };
 
-// ------------------------------- cost functions -------------------------------
+// ------------------------------- utils -------------------------------
 
-double cost_function_mse(const double predicted, const double target)
+// splitmix64's finalizer, which scrambles every bit of x into every bit of the result
+static std::uint64_t mixBits(std::uint64_t x)
 {
-    // MSE cost function - whose derivative below is a simple addition!
-    return 0.5 * pow((predicted - target), 2);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
 }
 
-double cost_function_mse_derivative(const double predicted, const double target)
+// the start of a stream of random values, one per seed and stream
+static std::uint64_t randomKey(std::uint64_t seed, std::uint64_t stream)
 {
-    // MSE
-    return predicted - target;
+    return mixBits(seed + mixBits(stream + 1) * 0x9e3779b97f4a7c15ull);
 }
 
-double cost_function_rmse(const double predicted, const double target)
+// value counter of a stream, uniform in [0, 1). this is splitmix64's output at that
+// point in its sequence, found straight from the counter rather than stepping to it.
+static real randomAt(std::uint64_t key, std::uint64_t counter)
 {
-    return sqrt(0.5 * pow((predicted - target), 2));
+    const int bits = std::numeric_limits<real>::digits;
+    const std::uint64_t x = mixBits(key + (counter + 1) * 0x9e3779b97f4a7c15ull);
+    return real(x >> (64 - bits)) * (real(1) / real(std::uint64_t(1) << bits));
 }
 
-double cost_function_rmse_derivative(const double predicted, const double target)
-{
-    return (predicted - target) / sqrt(2.0);
-}
+// ------------------------------- layer -------------------------------
 
-double cost_function_crossEntropy(const double predicted, const double target)
+size_t layer::ParameterSize(uint32 numNeurons, uint32 numInputs)
 {
-    // un-used, since softmax is run over the entire array. 
-    return - target*exp(predicted);
+    return alignedCount<real>(numNeurons) + size_t(alignedCount<real>(numInputs)) * numNeurons;
 }
 
-double cost_function_crossEntropy_derivative(const double predicted, const double target) 
+// weights each task of Initialize fills at least, so small layers stay on one thread
+const size_t InitTaskSize = 64 * 1024;
+
+void layer::Initialize(WeightInit init, std::uint64_t seed, uint32 index, threadPool& pool)
 {
-    return predicted - target;
-}
+    // a filter reaches window.size^2 outputs from each of its inputs, a dense row one
+    const real fanIn = real(weights.cols);
+    const real fanOut = real(weights.rows) * window.size * window.size;
+    real low = 0;
+    real range = 1;
+    if (init == WeightInit::Xavier)
+        range = std::sqrt(real(6) / (fanIn + fanOut));
+    else if (init == WeightInit::He)
+        range = std::sqrt(real(6) / fanIn);
+    if (init != WeightInit::Uniform)
+    {
+        low = -range;
+        range *= 2;
+    }
 
-static CostFuncPtr costFuncPtrs[5][2] = {
-    {nullptr, nullptr},
-    {cost_function_mse, cost_function_mse_derivative},
-    {cost_function_rmse, cost_function_rmse_derivative},
-    {cost_function_crossEntropy, cost_function_crossEntropy_derivative},
-    {nullptr, nullptr}
-};
+    // weight [n][j] is value n * cols + j of the layer's stream, and bias n follows them
+    const std::uint64_t key = randomKey(seed, index);
+    const uint32 rows = weights.rows;
+    const uint32 cols = weights.cols;
+    const uint32 numTasks = uint32(std::max<size_t>(1, std::min<size_t>(rows, size_t(rows) * cols / InitTaskSize)));
+    const uint32 perTask = (rows + numTasks - 1) / numTasks;
+    pool.Run(numTasks, [&](uint32 task)
+    {
+        const uint32 last = std::min(rows, (task + 1) * perTask);
+        for (uint32 n = task * perTask; n < last; n++)
+        {
+            real* w = weights[n].data();
+            const std::uint64_t first = std::uint64_t(n) * cols;
+            for (uint32 j=0; j < cols; j++)
+                w[j] = low + range * randomAt(key, first + j);
+        }
+    });
 
-// ------------------------------- utils -------------------------------
+    const std::uint64_t first = std::uint64_t(rows) * cols;
+    for (uint32 n=0; n < biases.size(); n++)
+        biases[n] = (init == WeightInit::Uniform) ? randomAt(key, first + n) : real(0);
+}
 
-// returns a random between 0 and 1
-double random_value()
+layer::layer(uint32 numNeurons, uint32 numInputs, real* parameters)
+    : layer(numNeurons, numInputs, numNeurons, numInputs, parameters)
 {
-    return ((rand() % 1000)) * 0.001;
 }
 
-// ------------------------------- layer -------------------------------
-
-layer::layer(uint32 numNeurons)
+layer::layer(uint32 numNeurons, uint32 numInputs, uint32 weightRows, uint32 weightCols, real* parameters)
     : numNeurons(numNeurons)
+    , numInputs(numInputs)
     , forClassification(false)
+    , aFunc(ActivationFunction::None)
+    , af(nullptr)
+    , afD(nullptr)
 {
-    activationValue.resize(numNeurons);
-    gradients.resize(numNeurons);
-    errors.resize(numNeurons);
-    biases.resize(numNeurons);
+    shape.channels = numNeurons;
+
+    // one block per layer: [activations][gradients][errors][biases][weight rows...]
+    // every section and every weight row starts on a cache line. the biases and weights
+    // are left out when they live somewhere else.
+    const uint32 section = alignedCount<real>(numNeurons);
+    const uint32 stride = alignedCount<real>(weightCols);
+    storage.Allocate(size_t(section) * 3 + (parameters ? 0 : ParameterSize(weightRows, weightCols)));
+
+    real* p = storage.data();
+    activationValue = columnView(p, numNeurons);    p += section;
+    gradients = columnView(p, numNeurons);          p += section;
+    errors = columnView(p, numNeurons);             p += section;
+
+    if (parameters)
+        p = parameters;
+    biases = columnView(p, weightRows);             p += alignedCount<real>(weightRows);
+    weights = matrixView(p, weightCols ? weightRows : 0, weightCols, stride);
 }
 
-void layer::ForwardsPass(const column& inputs)
+void layer::ForwardsPass(constColumnView inputs)
 {
     // blindly copy the input values
     assert(numNeurons == inputs.size());
@@ -160,244 +203,1826 @@ void layer::ForwardsPass(const column& inputs)
 
 // ------------------------------- denseLayer -------------------------------
 
-denseLayer::denseLayer(uint32 numNeurons, ActivationFunction aFunc, layer* previous)
-    : layer(numNeurons)
-    , aFunc(aFunc)
+// the layer before, checked before the initializers read it
+static const layer& checkedPrevious(const layer* previous)
 {
     assert(previous);
+    return *previous;
+}
 
-    weights.resize(numNeurons);
-    for (auto&& w : weights)
-        w.resize(previous->numNeurons);
-
-    for (uint32 n=0; n < numNeurons; n++)
-        for (uint32 j=0; j < previous->numNeurons; j++)
-            weights[n][j] = random_value();
-
-    for (uint32 n=0; n < numNeurons; n++)
-        biases[n] = random_value();
+denseLayer::denseLayer(uint32 numNeurons, ActivationFunction aFunc, layer* previous, real* parameters)
+    : layer(numNeurons, checkedPrevious(previous).numNeurons, parameters)
+{
+    this->aFunc = aFunc;
 
     af = activationFuncPtrs[int(aFunc)][0];
     afD = activationFuncPtrs[int(aFunc)][1];
-
 }
 
-void denseLayer::ForwardsPass(const column& inputs)
+void denseLayer::ForwardsPass(constColumnView inputs)
 {
-    assert(weights[0].size() == inputs.size());
+    assert(weights.cols == inputs.size());
 
-    for (uint32 n=0; n < numNeurons; n++)
+    const kernelTable& kernels = activeKernels();
+    const real* x = inputs.data();
+    withActivation(aFunc, [&](auto act)
     {
-        double z = biases[n];
-        for (int i=0; i < inputs.size(); i++)
-            z += weights[n][i] * inputs[i];
-
-        activationValue[n] = af(z);
-        assert(!isnan(activationValue[n]) && !isinf(activationValue[n]));// && activationValue[n] < 100000);
-        //printf("ACT: %f/%f  i:%f,%f  w:%f,%f,%f,%f\n", z, activationValue[n], inputs[0], inputs[1], 
-        //    weights[0][0], weights[0][1], weights[1][0], weights[1][1]);
-    }
+        using A = decltype(act);
+        for (uint32 n=0; n < numNeurons; n++)
+        {
+            activationValue[n] = A::Apply(biases[n] + kernels.dot(weights[n].data(), x, numInputs));
+            assert(!std::isnan(activationValue[n]) && !std::isinf(activationValue[n]));
+        }
+    });
 
     if (forClassification)
-        activationValue = softmax(activationValue);
+        softmaxInPlace(activationValue);
 }
 
-double dotProduct(const column& a, const column& b)
+void denseLayer::ForwardsPass(const sparseRow& inputs)
 {
-    assert(a.size() == b.size());
-    double sum = 0;
-    for (int i=0; i < a.size(); i++)
-        sum += a[i] * b[i];
-    return sum;
+    assert(inputs.count <= numInputs);
+
+    // four neurons at a time, so their sums don't wait on each other
+    const uint32* indices = inputs.indices;
+    const real* values = inputs.values;
+    real* z = activationValue.data();
+    uint32 n = 0;
+    for (; n + 4 <= numNeurons; n += 4)
+    {
+        const real* w0 = weights[n].data();
+        const real* w1 = w0 + weights.stride;
+        const real* w2 = w1 + weights.stride;
+        const real* w3 = w2 + weights.stride;
+        real d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+        for (uint32 i=0; i < inputs.count; i++)
+        {
+            const uint32 j = indices[i];
+            const real x = values[i];
+            d0 += w0[j] * x;
+            d1 += w1[j] * x;
+            d2 += w2[j] * x;
+            d3 += w3[j] * x;
+        }
+        z[n] = d0;
+        z[n+1] = d1;
+        z[n+2] = d2;
+        z[n+3] = d3;
+    }
+    for (; n < numNeurons; n++)
+    {
+        const real* w = weights[n].data();
+        real dot = 0;
+        for (uint32 i=0; i < inputs.count; i++)
+            dot += w[indices[i]] * values[i];
+        z[n] = dot;
+    }
+
+    withActivation(aFunc, [&](auto act)
+    {
+        using A = decltype(act);
+        for (uint32 n=0; n < numNeurons; n++)
+        {
+            activationValue[n] = A::Apply(biases[n] + z[n]);
+            assert(!std::isnan(activationValue[n]) && !std::isinf(activationValue[n]));
+        }
+    });
+
+    if (forClassification)
+        softmaxInPlace(activationValue);
 }
 
 double layer::BackwardsPass(
     const layer& previousLayer,
     const layer* nextLayer,
     const double learning_rate,
-    const column& targets,
-    CostFuncPtr cf,
-    CostFuncPtr cfD)
+    constColumnView targets,
+    CostFunction cFunc)
 {
+    const double loss = Gradients(nextLayer, targets, cFunc);
+    UpdateWeights(previousLayer, learning_rate);
+    return loss;
+}
+
+double layer::Gradients(const layer* nextLayer, constColumnView targets, CostFunction cFunc)
+{
+    const kernelTable& kernels = activeKernels();
+
     double accumulatedError = 0;
-    for (uint32 n=0; n < numNeurons; n++)
+    if (nextLayer != nullptr)
     {
-        const double predicted = activationValue[n];
-        errors[n] = 0;
-        
-        if (nextLayer == nullptr)
-        {
-            // this is the output layer
-            errors[n] = cfD(predicted, targets[n]);
-
-            // only for reporting
-            accumulatedError += pow(cf(predicted, targets[n]),2);
-        }
-        else
+        // walk the next layer's weights a row at a time so they are read linearly
+        std::fill(errors.begin(), errors.end(), real(0));
+        for (uint32 k=0; k < nextLayer->numNeurons; k++)
+            kernels.axpy(errors.data(), nextLayer->weights[k].data(), nextLayer->gradients[k], numNeurons);
+    }
+    else
+    {
+        // this is the output layer
+        withCost(cFunc, [&](auto c)
         {
-            for (uint32 k=0; k < nextLayer->numNeurons; k++)
+            using C = decltype(c);
+            for (uint32 n=0; n < numNeurons; n++)
             {
-                errors[n] += nextLayer->weights[k][n] * nextLayer->gradients[k];
+                const real predicted = activationValue[n];
+                errors[n] = C::Derivative(predicted, targets[n]);
+
+                // only for reporting
+                accumulatedError += pow(C::Apply(predicted, targets[n]),2);
             }
-        }
+        });
+    }
 
-        if (!forClassification)
-        {
-            gradients[n] = errors[n] * afD(predicted);
-        }
+    std::copy(errors.begin(), errors.end(), gradients.begin());
+    ActivationGradients(
+        constMatrixView(activationValue.data(), 1, numNeurons, numNeurons),
+        matrixView(gradients.data(), 1, numNeurons, numNeurons));
+
+    return pow(accumulatedError,2);
+}
+
+void layer::UpdateWeights(const layer& previousLayer, const double learning_rate)
+{
+    // every weight row's gradient is the inputs, scaled by the row's gradient
+    const optimizer sgd;
+    const constMatrixView inputs(previousLayer.activationValue.data(), numNeurons, numInputs, 0);
+    Optimize(sgd, sgd.Step(learning_rate, 1), inputs, gradients, gradients, 1);
+}
+
+// ------------------------------- batched passes -------------------------------
+
+// the epilogue of the forward products: each value of a tile of z plus the bias of its
+// column, through the activation, while the tile is still in L1
+template <typename A>
+static void biasActivation(void* context, matrixView tile, uint32, uint32 col)
+{
+    const real* biases = static_cast<const real*>(context) + col;
+    for (uint32 r=0; r < tile.rows; r++)
+    {
+        real* z = tile[r].data();
+        for (uint32 j=0; j < tile.cols; j++)
+            z[j] = A::Apply(z[j] + biases[j]);
     }
-     
+}
+
+static gemmEpilogue biasActivationEpilogue(ActivationFunction aFunc, constColumnView biases)
+{
+    gemmEpilogue epilogue;
+    withActivation(aFunc, [&](auto act) { epilogue.fn = &biasActivation<decltype(act)>; });
+    epilogue.context = const_cast<real*>(biases.data());
+    return epilogue;
+}
+
+void layer::ForwardsBatch(constMatrixView inputs, matrixView outputs, columnView) const
+{
+    // blindly copy the input values
+    assert(inputs.cols == numNeurons && inputs.rows == outputs.rows);
+    for (uint32 b=0; b < inputs.rows; b++)
+        std::copy(inputs[b].begin(), inputs[b].end(), outputs[b].begin());
+}
+
+void denseLayer::ForwardsBatch(constMatrixView inputs, matrixView outputs, columnView pack) const
+{
+    assert(inputs.cols == numInputs && outputs.cols == numNeurons && inputs.rows == outputs.rows);
+
+    // z = x * w^T, with the biases and the activation applied to each tile of z as gemm
+    // finishes it
+    const uint32 batchSize = inputs.rows;
+    gemm(inputs, false, weights, true, outputs, false, pack, biasActivationEpilogue(aFunc, biases));
+
     if (forClassification)
     {
-        for (uint32 n=0; n < numNeurons; n++)
-        {
-             //const double predicted = activationValue[n];
-             //gradients[n] = predicted - targets[n];
-
-            const double predicted = activationValue[n];
-            column tmp(numNeurons);
-            for (uint32 j=0; j < numNeurons; j++)
-            {
-                if (j == n)
-                    tmp[j] = predicted * (1 - predicted);
-                else
-                    tmp[j] = -predicted * activationValue[j];
-            }
-            gradients[n] = dotProduct(errors, tmp);
-        }
+        for (uint32 r=0; r < batchSize; r++)
+            softmaxInPlace(outputs[r]);
     }
+}
 
+void layer::BackwardsBatch(
+    constMatrixView inputs,
+    constMatrixView outputs,
+    matrixView gradients,
+    matrixView previousErrors,
+    matrixView weightGradients,
+    columnView biasGradients,
+    columnView pack) const
+{
+    const uint32 batchSize = gradients.rows;
+    assert(inputs.rows == batchSize && outputs.rows == batchSize);
 
-    // Update weights
-    for (uint32 n=0; n < numNeurons; n++)
+    const kernelTable& kernels = activeKernels();
+
+    ActivationGradients(outputs, gradients);
+
+    // errors for the previous layer: E = G * W
+    if (!previousErrors.empty())
+        gemm(gradients, false, weights, false, previousErrors, false, pack);
+
+    // weight gradients summed over the batch: dW = G^T * X
+    gemm(gradients, true, inputs, false, weightGradients, false, pack);
+
+    std::fill(biasGradients.begin(), biasGradients.end(), real(0));
+    for (uint32 b=0; b < batchSize; b++)
+        kernels.axpy(biasGradients.data(), gradients[b].data(), 1, numNeurons);
+}
+
+void layer::ActivationGradients(constMatrixView outputs, matrixView gradients) const
+{
+    const uint32 batchSize = gradients.rows;
+    const kernelTable& kernels = activeKernels();
+
+    if (forClassification)
     {
-        for (uint32 i = 0; i < previousLayer.numNeurons; ++i)
+        for (uint32 b=0; b < batchSize; b++)
         {
-            // the input is the activation value of the neuron in the previous layer
-            const double input = previousLayer.activationValue[i];
-            weights[n][i] -= learning_rate * gradients[n] * input;
+            real* g = gradients[b].data();
+            const real* a = outputs[b].data();
+
+            // the product of the errors with the softmax jacobian, without building the jacobian:
+            // g[n] = sum_j e[j] * a[n] * (delta(n,j) - a[j]) = a[n] * (e[n] - sum_j e[j] * a[j])
+            const real s = kernels.dot(g, a, numNeurons);
+            for (uint32 n=0; n < numNeurons; n++)
+                g[n] = a[n] * (g[n] - s);
         }
-
-        // Update bias
-        biases[n] -= learning_rate * gradients[n]; // bias input is always 1, so is omitted
     }
-    return pow(accumulatedError,2);
+    else
+    {
+        withActivation(aFunc, [&](auto act)
+        {
+            using A = decltype(act);
+            for (uint32 b=0; b < batchSize; b++)
+            {
+                real* g = gradients[b].data();
+                const real* a = outputs[b].data();
+                for (uint32 n=0; n < numNeurons; n++)
+                    g[n] *= A::Derivative(a[n]);
+            }
+        });
+    }
 }
 
-// ------------------------------- model -------------------------------
+size_t layer::PackSize() const
+{
+    return gemmPackSize(std::max(numNeurons, numInputs));
+}
 
-const int MaxNeurons = 1000 * 1000;
+void layer::ApplyGradients(constMatrixView weightGradients, constColumnView biasGradients, const double scale)
+{
+    const optimizer sgd;
+    Optimize(sgd, sgd.Step(scale, 1), weightGradients, constColumnView(), biasGradients, 1);
+}
 
-model::model()
+// ------------------------------- optimizers -------------------------------
 
+uint32 optimizer::NumMoments() const
 {
-    srand(999999);
+    switch (kind)
+    {
+        case OptimizerKind::Momentum:
+        case OptimizerKind::Nesterov: return 1;
+        case OptimizerKind::Adam:
+        case OptimizerKind::AdamW: return 2;
+        default: return 0;
+    }
+}
 
-    cFunc = CostFunction::MSE;    
-    cf = costFuncPtrs[int(cFunc)][0];
-    cfD = costFuncPtrs[int(cFunc)][1];
+optimizerStep optimizer::Step(double learningRate, std::uint64_t t) const
+{
+    optimizerStep step = {};
+    step.learningRate = real(learningRate);
+    step.momentum = real(momentum);
+    step.beta1 = real(beta1);
+    step.beta2 = real(beta2);
+    step.correction1 = real(1 / (1 - std::pow(beta1, double(t))));
+    step.correction2 = real(1 / (1 - std::pow(beta2, double(t))));
+    step.epsilon = real(epsilon);
+    step.nesterov = kind == OptimizerKind::Nesterov;
+    if (kind == OptimizerKind::AdamW)
+        step.decay = real(learningRate * weightDecay);
+    else
+        step.l2 = real(weightDecay);
+    return step;
 }
 
-layer* model::AddInputLayer(uint32 numNeurons)
+// one step over a block of count values, with its moments at m and v
+static void optimizeBlock(
+    const kernelTable& kernels,
+    OptimizerKind kind,
+    const optimizerStep& step,
+    real* w,
+    real* m,
+    real* v,
+    const real* g,
+    const real scale,
+    uint32 count)
 {
-    if (!layers.empty() || numNeurons > MaxNeurons)
+    switch (kind)
     {
-        return nullptr;
+        case OptimizerKind::Momentum:
+        case OptimizerKind::Nesterov:
+            kernels.momentumStep(w, m, g, scale, step, count);
+            break;
+        case OptimizerKind::Adam:
+        case OptimizerKind::AdamW:
+            kernels.adamStep(w, m, v, g, scale, step, count);
+            break;
+        default:
+            if (step.l2 != 0)
+                kernels.axpy(w, w, -step.learningRate * step.l2, count);
+            kernels.axpy(w, g, -step.learningRate * scale, count);
+            break;
+    }
+}
+
+void layer::Optimize(
+    const optimizer& opt,
+    const optimizerStep& step,
+    constMatrixView weightGradients,
+    constColumnView rowScales,
+    constColumnView biasGradients,
+    const real scale)
+{
+    const kernelTable& kernels = activeKernels();
+    const size_t size = NumParameters();
+
+    // zeroed, so the first step starts without any history
+    if (numMoments != opt.NumMoments())
+    {
+        numMoments = opt.NumMoments();
+        moments.Allocate(size * numMoments);
     }
+    real* m = moments.data();
+    real* v = (numMoments > 1) ? m + size : nullptr;
 
-    layer* l = new layer(numNeurons);
-    layers.push_back(l);
-    return l;
+    // the moments of weight row n are where it is in the parameters, after the biases
+    const uint32 section = alignedCount<real>(biases.size());
+    for (uint32 n=0; n < weights.rows; n++)
+    {
+        const size_t offset = section + size_t(n) * weights.stride;
+        const real rowScale = rowScales.empty() ? scale : scale * rowScales[n];
+        optimizeBlock(kernels, opt.kind, step, weights[n].data(), m ? m + offset : nullptr, v ? v + offset : nullptr,
+            weightGradients[n].data(), rowScale, weights.cols);
+    }
+
+    optimizerStep biasStep = step;
+    biasStep.l2 = 0;
+    biasStep.decay = 0;
+    optimizeBlock(kernels, opt.kind, biasStep, biases.data(), m, v, biasGradients.data(), scale, biases.size());
 }
 
-layer* model::AddDenseLayer(
-    uint32 numNeurons, 
-    ActivationFunction aFunc,
-    layer* previousLayer)
+void layer::OptimizeSparse(const optimizerStep& step, const sparseRow& inputs)
 {
-    if (layers.empty() || numNeurons > MaxNeurons || previousLayer == nullptr)
+    assert(step.l2 == 0 && step.decay == 0);
+
+    // Optimize's SGD step, w -= rate * g[n] * x, over the nonzero x alone
+    const uint32* indices = inputs.indices;
+    const real* values = inputs.values;
+    for (uint32 n=0; n < weights.rows; n++)
     {
-        return nullptr;
+        real* w = weights[n].data();
+        const real scale = real(-step.learningRate) * gradients[n];
+        for (uint32 i=0; i < inputs.count; i++)
+            w[indices[i]] += scale * values[i];
     }
+    activeKernels().axpy(biases.data(), gradients.data(), -step.learningRate, biases.size());
+}
 
-    layer* l = new denseLayer(numNeurons, aFunc, previousLayer);
-    layers.push_back(l);
+// ------------------------------- softmaxCrossEntropyLayer -------------------------------
 
-    if (aFunc == ActivationFunction::Softmax)
+softmaxCrossEntropyLayer::softmaxCrossEntropyLayer(uint32 numNeurons, layer* previous, real* parameters)
+    : denseLayer(numNeurons, ActivationFunction::Softmax, previous, parameters)
+{
+    forClassification = true;
+}
+
+void softmaxCrossEntropyLayer::ActivationGradients(constMatrixView, matrixView) const
+{
+    // the cross entropy errors are already p - y, which is dCost/dz for softmax
+}
+
+// ------------------------------- images -------------------------------
+
+bool imageWindow::Fits(const imageShape& input) const
+{
+    const std::uint64_t width = std::uint64_t(input.width) + 2 * std::uint64_t(padding);
+    const std::uint64_t height = std::uint64_t(input.height) + 2 * std::uint64_t(padding);
+    return size > 0 && stride > 0 && padding < size && input.channels > 0 && size <= width && size <= height;
+}
+
+imageShape imageWindow::Output(const imageShape& input, uint32 channels) const
+{
+    assert(Fits(input));
+    imageShape output;
+    output.width = (input.width + 2 * padding - size) / stride + 1;
+    output.height = (input.height + 2 * padding - size) / stride + 1;
+    output.channels = channels;
+    return output;
+}
+
+// the span [first, last) of a window's rows or columns, at output position o, that falls
+// inside an image extent pixels across, and the image pixel first lands on
+static void windowSpan(const imageWindow& window, uint32 o, uint32 extent, uint32& first, uint32& last, int& start)
+{
+    start = int(o * window.stride) - int(window.padding);
+    first = uint32(std::max(0, -start));
+    last = uint32(std::max(int(first), std::min(int(window.size), int(extent) - start)));
+    start += int(first);
+}
+
+// ------------------------------- convLayer -------------------------------
+
+convLayer::convLayer(uint32 channels, const imageWindow& window, ActivationFunction aFunc, layer* previous, real* parameters)
+    : layer(window.Output(previous->shape, channels).Size(), previous->numNeurons,
+        channels, window.size * window.size * previous->shape.channels, parameters)
+    , input(previous->shape)
+{
+    this->aFunc = aFunc;
+    this->window = window;
+    shape = window.Output(input, channels);
+
+    af = activationFuncPtrs[int(aFunc)][0];
+    afD = activationFuncPtrs[int(aFunc)][1];
+
+    passPack.Allocate(PackSize());
+}
+
+size_t convLayer::PackSize() const
+{
+    // the patches of one sample, then the packing space for the products over them
+    const size_t patches = size_t(shape.width) * shape.height * weights.stride;
+    return patches + gemmPackSize(std::max(shape.channels, weights.cols));
+}
+
+void convLayer::Patches(const real* inputs, matrixView patches) const
+{
+    const uint32 channels = input.channels;
+    const uint32 run = window.size * channels;
+    for (uint32 oy=0; oy < shape.height; oy++)
     {
-        l->forClassification = true;
+        uint32 firstRow, lastRow;
+        int y;
+        windowSpan(window, oy, input.height, firstRow, lastRow, y);
+        for (uint32 ox=0; ox < shape.width; ox++)
+        {
+            uint32 first, last;
+            int x;
+            windowSpan(window, ox, input.width, first, last, x);
+
+            // each row of the window is one run of pixels in the image, with zeros
+            // either side of it where the window hangs over the edge
+            real* patch = patches[oy * shape.width + ox].data();
+            const real* src = inputs + (size_t(y) * input.width + x) * channels;
+            const size_t inputRow = size_t(input.width) * channels;
+            if (first == 0 && last == window.size)
+            {
+                real* dst = patch + size_t(firstRow) * run;
+                for (uint32 ky=firstRow; ky < lastRow; ky++, dst += run, src += inputRow)
+                    std::copy(src, src + run, dst);
+            }
+            else
+            {
+                for (uint32 ky=firstRow; ky < lastRow; ky++, src += inputRow)
+                {
+                    real* dst = patch + size_t(ky) * run;
+                    std::fill(dst, dst + first * channels, real(0));
+                    std::copy(src, src + (last - first) * channels, dst + first * channels);
+                    std::fill(dst + last * channels, dst + run, real(0));
+                }
+            }
+            std::fill(patch, patch + size_t(firstRow) * run, real(0));
+            std::fill(patch + size_t(lastRow) * run, patch + size_t(window.size) * run, real(0));
+        }
+    }
+}
 
-        cFunc = CostFunction::CrossEntropy;    
-        cf = costFuncPtrs[int(cFunc)][0];
-        cfD = costFuncPtrs[int(cFunc)][1];
+void convLayer::AddPatches(constMatrixView patches, real* inputs) const
+{
+    const kernelTable& kernels = activeKernels();
+    const uint32 channels = input.channels;
+    const uint32 run = window.size * channels;
+    for (uint32 oy=0; oy < shape.height; oy++)
+    {
+        uint32 firstRow, lastRow;
+        int y;
+        windowSpan(window, oy, input.height, firstRow, lastRow, y);
+        for (uint32 ox=0; ox < shape.width; ox++)
+        {
+            uint32 first, last;
+            int x;
+            windowSpan(window, ox, input.width, first, last, x);
+
+            const real* patch = patches[oy * shape.width + ox].data();
+            for (uint32 ky=firstRow; ky < lastRow; ky++)
+            {
+                real* dst = inputs + (size_t(y + int(ky - firstRow)) * input.width + x) * channels;
+                kernels.axpy(dst, patch + size_t(ky) * run + first * channels, 1, (last - first) * channels);
+            }
+        }
     }
+}
 
-    return l;
+void convLayer::ForwardsPass(constColumnView inputs)
+{
+    // turning gemm tuning on since the layer was made grows the pack
+    if (passPack.size() < PackSize())
+        passPack.Allocate(PackSize());
+    assert(inputs.size() == numInputs);
+    ForwardsBatch(
+        constMatrixView(inputs.data(), 1, numInputs, numInputs),
+        matrixView(activationValue.data(), 1, numNeurons, numNeurons),
+        columnView(passPack.data(), uint32(passPack.size())));
 }
 
-void model::ForwardsPass(const column& inputs)
+void convLayer::ForwardsBatch(constMatrixView inputs, matrixView outputs, columnView pack) const
 {
-    layers.front()->ForwardsPass(inputs);
+    assert(inputs.cols == numInputs && outputs.cols == numNeurons && inputs.rows == outputs.rows);
 
-    for (int l=1; l < layers.size(); l++)
-        layers[l]->ForwardsPass(layers[l-1]->activationValue);
+    // as gemm does, a pack that's too small is made on the heap
+    alignedArray<real> ownPack;
+    if (pack.size() < PackSize())
+    {
+        ownPack.Allocate(PackSize());
+        pack = columnView(ownPack.data(), uint32(ownPack.size()));
+    }
+    const uint32 pixels = shape.width * shape.height;
+    const matrixView patches(pack.data(), pixels, weights.cols, weights.stride);
+    const size_t patchSize = size_t(pixels) * weights.stride;
+    const columnView productPack(pack.data() + patchSize, uint32(pack.size() - patchSize));
+
+    // z = patches * w^T, a row of z for each pixel of the sample, with the biases and the
+    // activation applied as gemm finishes each tile
+    const gemmEpilogue epilogue = biasActivationEpilogue(aFunc, biases);
+    for (uint32 b=0; b < inputs.rows; b++)
+    {
+        Patches(inputs[b].data(), patches);
+        const matrixView z(outputs[b].data(), pixels, shape.channels, shape.channels);
+        gemm(patches, false, weights, true, z, false, productPack, epilogue);
+    }
+}
 
-    //for (double a : layers.back()->activationValue)
-    //    printf("a: %f ", a);
+void convLayer::BackwardsBatch(
+    constMatrixView inputs,
+    constMatrixView outputs,
+    matrixView gradients,
+    matrixView previousErrors,
+    matrixView weightGradients,
+    columnView biasGradients,
+    columnView pack) const
+{
+    const uint32 batchSize = gradients.rows;
+    assert(inputs.rows == batchSize && outputs.rows == batchSize);
 
-    //printf("\n");
+    alignedArray<real> ownPack;
+    if (pack.size() < PackSize())
+    {
+        ownPack.Allocate(PackSize());
+        pack = columnView(ownPack.data(), uint32(ownPack.size()));
+    }
+    const uint32 pixels = shape.width * shape.height;
+    const matrixView patches(pack.data(), pixels, weights.cols, weights.stride);
+    const size_t patchSize = size_t(pixels) * weights.stride;
+    const columnView productPack(pack.data() + patchSize, uint32(pack.size() - patchSize));
+
+    const kernelTable& kernels = activeKernels();
+
+    ActivationGradients(outputs, gradients);
+
+    std::fill(biasGradients.begin(), biasGradients.end(), real(0));
+    for (uint32 b=0; b < batchSize; b++)
+    {
+        const matrixView g(gradients[b].data(), pixels, shape.channels, shape.channels);
+
+        // weight gradients summed over the pixels and the batch: dW = G^T * patches
+        Patches(inputs[b].data(), patches);
+        gemm(g, true, patches, false, weightGradients, b > 0, productPack);
+        for (uint32 p=0; p < pixels; p++)
+            kernels.axpy(biasGradients.data(), g[p].data(), 1, shape.channels);
+
+        // the errors of each patch, G * W, added back onto the pixels they came from
+        if (!previousErrors.empty())
+        {
+            gemm(g, false, weights, false, patches, false, productPack);
+            std::fill(previousErrors[b].begin(), previousErrors[b].end(), real(0));
+            AddPatches(patches, previousErrors[b].data());
+        }
+    }
 }
 
-void model::PredictSingleInput(const column& inputs, column& outputs)
+// ------------------------------- poolLayer -------------------------------
+
+poolLayer::poolLayer(LayerKind kind, const imageWindow& window, layer* previous)
+    : layer(window.Output(previous->shape, previous->shape.channels).Size(), previous->numNeurons, 0, 0, nullptr)
+    , kind(kind)
+    , input(previous->shape)
 {
-    assert(inputs.size() == layers.front()->numNeurons);
-    assert(outputs.size() == layers.back()->numNeurons);
+    assert(kind == LayerKind::MaxPool || kind == LayerKind::AveragePool);
+    this->window = window;
+    shape = window.Output(input, input.channels);
+}
 
-    layers.front()->ForwardsPass(inputs);
+void poolLayer::ForwardsPass(constColumnView inputs)
+{
+    assert(inputs.size() == numInputs);
+    ForwardsBatch(
+        constMatrixView(inputs.data(), 1, numInputs, numInputs),
+        matrixView(activationValue.data(), 1, numNeurons, numNeurons));
+}
 
-    for (uint32 l=1; l < layers.size(); l++)
-        layers[l]->ForwardsPass(layers[l-1]->activationValue);
+void poolLayer::ForwardsBatch(constMatrixView inputs, matrixView outputs, columnView) const
+{
+    assert(inputs.cols == numInputs && outputs.cols == numNeurons && inputs.rows == outputs.rows);
 
-    const layer& outputLayer = *layers.back();
-    for (uint32 i=0; i < outputLayer.numNeurons; i++)
-        outputs[i] = outputLayer.activationValue[i];
+    // a whole pixel of channels at a time, which are next to each other
+    const uint32 channels = shape.channels;
+    for (uint32 b=0; b < inputs.rows; b++)
+    {
+        for (uint32 oy=0; oy < shape.height; oy++)
+        {
+            uint32 firstRow, lastRow;
+            int y;
+            windowSpan(window, oy, input.height, firstRow, lastRow, y);
+            for (uint32 ox=0; ox < shape.width; ox++)
+            {
+                uint32 first, last;
+                int x;
+                windowSpan(window, ox, input.width, first, last, x);
+
+                real* out = outputs[b].data() + (size_t(oy) * shape.width + ox) * channels;
+                for (uint32 ky=0; ky < lastRow - firstRow; ky++)
+                {
+                    for (uint32 kx=0; kx < last - first; kx++)
+                    {
+                        const real* in = inputs[b].data() + ((size_t(y) + ky) * input.width + x + kx) * channels;
+                        if (ky == 0 && kx == 0)
+                            std::copy(in, in + channels, out);
+                        else if (kind == LayerKind::MaxPool)
+                            for (uint32 c=0; c < channels; c++) out[c] = std::max(out[c], in[c]);
+                        else
+                            for (uint32 c=0; c < channels; c++) out[c] += in[c];
+                    }
+                }
+
+                if (kind == LayerKind::AveragePool)
+                {
+                    const real scale = real(1) / ((lastRow - firstRow) * (last - first));
+                    for (uint32 c=0; c < channels; c++)
+                        out[c] *= scale;
+                }
+            }
+        }
+    }
 }
 
-double model::BackwardsPass(const column& targets, double learning_rate)
+void poolLayer::BackwardsBatch(
+    constMatrixView inputs,
+    constMatrixView outputs,
+    matrixView gradients,
+    matrixView previousErrors,
+    matrixView,
+    columnView,
+    columnView) const
 {
-    layer* outputLayer = layers.back();
-    double accumlatedError = outputLayer->BackwardsPass(*layers[layers.size()-2], nullptr, learning_rate, targets, cf, cfD);
+    // nothing to learn, so only the errors for the previous layer
+    if (previousErrors.empty())
+        return;
 
-    // other layers
-    for (uint32 l =uint32(layers.size()-2); l > 0; l--)
+    const kernelTable& kernels = activeKernels();
+    const uint32 channels = shape.channels;
+    for (uint32 b=0; b < gradients.rows; b++)
     {
-        column dummytargets; // un-used
-        layer& currentLayer = *layers[l];
-        layer& previousLayer = *layers[l-1];
-        layer* nextLayer = layers[l+1];
-        currentLayer.BackwardsPass(previousLayer, nextLayer, learning_rate, dummytargets, cf, cfD);
+        real* errors = previousErrors[b].data();
+        std::fill(previousErrors[b].begin(), previousErrors[b].end(), real(0));
+        for (uint32 oy=0; oy < shape.height; oy++)
+        {
+            uint32 firstRow, lastRow;
+            int y;
+            windowSpan(window, oy, input.height, firstRow, lastRow, y);
+            for (uint32 ox=0; ox < shape.width; ox++)
+            {
+                uint32 first, last;
+                int x;
+                windowSpan(window, ox, input.width, first, last, x);
+
+                const size_t pixel = (size_t(oy) * shape.width + ox) * channels;
+                const real* g = gradients[b].data() + pixel;
+                const uint32 rows = lastRow - firstRow;
+                const uint32 cols = last - first;
+                auto offset = [&](uint32 ky, uint32 kx) { return ((size_t(y) + ky) * input.width + x + kx) * channels; };
+
+                if (kind == LayerKind::AveragePool)
+                {
+                    // the mean's gradient is shared evenly over the window
+                    const real scale = real(1) / (rows * cols);
+                    for (uint32 ky=0; ky < rows; ky++)
+                        for (uint32 kx=0; kx < cols; kx++)
+                            kernels.axpy(errors + offset(ky, kx), g, scale, channels);
+                    continue;
+                }
+
+                // the largest's gradient all goes to the first input that was the largest
+                const real* out = outputs[b].data() + pixel;
+                const real* in = inputs[b].data();
+                for (uint32 c=0; c < channels; c++)
+                {
+                    bool found = false;
+                    for (uint32 ky=0; ky < rows && !found; ky++)
+                    {
+                        for (uint32 kx=0; kx < cols && !found; kx++)
+                        {
+                            const size_t i = offset(ky, kx) + c;
+                            if (in[i] == out[c])
+                            {
+                                errors[i] += g[c];
+                                found = true;
+                            }
+                        }
+                    }
+                }
+            }
+        }
     }
-    return accumlatedError;
 }
 
-void model::Train(const matrix& allInputs, const matrix& allTargets, const int epochs, const double learningRate)
+// ------------------------------- batchWorkspace -------------------------------
+
+// the packing space the batched passes of every layer can share
+static size_t largestPack(const std::vector<layer*>& layers)
 {
-    assert(allInputs.size() == allTargets.size());
+    size_t largest = 0;
+    for (const layer* l : layers)
+        largest = std::max(largest, l->PackSize());
+    return largest;
+}
 
-    for (int e=0; e < epochs; e++)
+size_t batchWorkspace::StorageSize(const std::vector<layer*>& layers, uint32 batchSize, bool forTraining)
+{
+    // prediction only needs the activations
+    size_t total = 0;
+    for (const layer* l : layers)
     {
-        loss = 0;
-        const size_t sz = allInputs.size();
-        for (size_t i = 0; i < sz; i++)
+        const size_t section = alignedCount<real>(l->numNeurons);
+        total += section * batchSize;
+        if (forTraining)
         {
-            ForwardsPass(allInputs[i]);
-            loss += BackwardsPass(allTargets[i], learningRate);
+            total += section * batchSize;
+            total += l->NumParameters();
         }
-        // run just one of the inputs
-        // int I = rand() % allInputs.size();
-        // ForwardsPass(allInputs[I]);
-        // loss = BackwardsPass(allTargets[I], learningRate);
-
     }
-    epoch += epochs;
+    if (forTraining)
+        total += size_t(alignedCount<real>(layers.back()->numNeurons)) * batchSize;
+    return total + largestPack(layers);
+}
+
+void batchWorkspace::Carve(const std::vector<layer*>& layers, uint32 newBatchSize, bool newForTraining, real* p)
+{
+    batchSize = newBatchSize;
+    numLayers = uint32(layers.size());
+    forTraining = newForTraining;
+
+    activations.resize(numLayers);
+    gradients.resize(numLayers);
+    weightGradients.resize(numLayers);
+    biasGradients.resize(numLayers);
+
+    for (uint32 l=0; l < numLayers; l++)
+    {
+        const layer& current = *layers[l];
+        const uint32 numNeurons = current.numNeurons;
+        const uint32 section = alignedCount<real>(numNeurons);
+        const uint32 rows = current.weights.rows;
+        const uint32 cols = current.weights.cols;
+        const uint32 stride = alignedCount<real>(cols);
+
+        activations[l] = matrixView(p, batchSize, numNeurons, section);         p += size_t(section) * batchSize;
+        if (!forTraining)
+            continue;
+
+        gradients[l] = matrixView(p, batchSize, numNeurons, section);           p += size_t(section) * batchSize;
+        weightGradients[l] = matrixView(p, rows, cols, stride);                 p += size_t(stride) * rows;
+        biasGradients[l] = columnView(p, current.biases.size());                p += alignedCount<real>(current.biases.size());
+    }
+
+    const uint32 numOutputs = layers.back()->numNeurons;
+    if (forTraining)
+    {
+        targets = matrixView(p, batchSize, numOutputs, alignedCount<real>(numOutputs));
+        p += size_t(alignedCount<real>(numOutputs)) * batchSize;
+    }
+    pack = columnView(p, uint32(largestPack(layers)));
+}
+
+void batchWorkspace::Resize(const std::vector<layer*>& layers, uint32 newBatchSize, bool newForTraining)
+{
+    if (storage.data() && newBatchSize == batchSize && layers.size() == numLayers && newForTraining == forTraining)
+        return;
+
+    storage.Allocate(StorageSize(layers, newBatchSize, newForTraining));
+    Carve(layers, newBatchSize, newForTraining, storage.data());
+}
+
+// ------------------------------- model -------------------------------
+
+const int MaxNeurons = 1000 * 1000;
+
+// a layer of a kind, as the model's Add functions would make it
+static layer* newLayer(
+    LayerKind kind,
+    uint32 numNeurons,
+    ActivationFunction aFunc,
+    const imageShape& shape,
+    const imageWindow& window,
+    layer* previous,
+    real* parameters)
+{
+    switch (kind)
+    {
+        case LayerKind::Dense: return new denseLayer(numNeurons, aFunc, previous, parameters);
+        case LayerKind::SoftmaxCrossEntropy: return new softmaxCrossEntropyLayer(numNeurons, previous, parameters);
+        case LayerKind::Convolution: return new convLayer(shape.channels, window, aFunc, previous, parameters);
+        case LayerKind::MaxPool:
+        case LayerKind::AveragePool: return new poolLayer(kind, window, previous);
+        default:
+        {
+            layer* l = new layer(numNeurons, 0, parameters);
+            l->shape = shape;
+            return l;
+        }
+    }
+}
+
+// whether a window over an image is one the layers can be built with, without any of
+// their sizes overflowing
+static bool usableWindow(const imageWindow& window, const imageShape& input)
+{
+    return window.Fits(input) && std::uint64_t(window.size) * window.size * input.channels <= std::uint64_t(MaxNeurons);
+}
+
+// whether the first layer has sparse passes
+static bool takesSparseInputs(const std::vector<layer*>& layers)
+{
+    return layers.size() > 1 && (layers[1]->Kind() == LayerKind::Dense || layers[1]->Kind() == LayerKind::SoftmaxCrossEntropy);
+}
+
+// per-sample training runs in the layers, through the next layer's weights, which only
+// dense layers have. models with any other layers train on mini-batches of one instead.
+static bool trainsPerSample(const std::vector<layer*>& layers)
+{
+    for (uint32 l=1; l < layers.size(); l++)
+    {
+        const LayerKind kind = layers[l]->Kind();
+        if (kind != LayerKind::Dense && kind != LayerKind::SoftmaxCrossEntropy)
+            return false;
+    }
+    return true;
+}
+
+model::model()
+{
+    cFunc = CostFunction::MSE;    
+}
+
+model::~model()
+{
+    for (layer* l : layers)
+        delete l;
+}
+
+layer* model::AddInputLayer(uint32 numNeurons)
+{
+    if (!layers.empty() || numNeurons > MaxNeurons)
+    {
+        return nullptr;
+    }
+
+    layer* l = new layer(numNeurons);
+    layers.push_back(l);
+    return l;
+}
+
+layer* model::AddInputLayer(const imageShape& shape)
+{
+    if (std::uint64_t(shape.width) * shape.height * shape.channels > std::uint64_t(MaxNeurons))
+        return nullptr;
+
+    layer* l = AddInputLayer(shape.Size());
+    if (l)
+        l->shape = shape;
+    return l;
+}
+
+layer* model::AddConvLayer(
+    uint32 channels,
+    const imageWindow& window,
+    ActivationFunction aFunc,
+    layer* previousLayer,
+    WeightInit init)
+{
+    if (layers.empty() || previousLayer == nullptr || channels == 0 || aFunc == ActivationFunction::Softmax
+        || !usableWindow(window, previousLayer->shape) || init >= WeightInit::Last)
+    {
+        return nullptr;
+    }
+
+    const imageShape output = window.Output(previousLayer->shape, channels);
+    if (std::uint64_t(output.width) * output.height * channels > std::uint64_t(MaxNeurons))
+        return nullptr;
+
+    layer* l = new convLayer(channels, window, aFunc, previousLayer);
+    l->Initialize(init, seed, uint32(layers.size()), pool);
+    layers.push_back(l);
+    return l;
+}
+
+layer* model::AddPoolLayer(
+    LayerKind kind,
+    const imageWindow& window,
+    layer* previousLayer)
+{
+    if (layers.empty() || previousLayer == nullptr || (kind != LayerKind::MaxPool && kind != LayerKind::AveragePool)
+        || !usableWindow(window, previousLayer->shape))
+    {
+        return nullptr;
+    }
+
+    layer* l = new poolLayer(kind, window, previousLayer);
+    layers.push_back(l);
+    return l;
+}
+
+layer* model::AddSoftmaxCrossEntropyLayer(
+    uint32 numNeurons,
+    layer* previousLayer,
+    WeightInit init)
+{
+    if (layers.empty() || numNeurons > MaxNeurons || previousLayer == nullptr || init >= WeightInit::Last)
+    {
+        return nullptr;
+    }
+
+    layer* l = new softmaxCrossEntropyLayer(numNeurons, previousLayer);
+    l->Initialize(init, seed, uint32(layers.size()), pool);
+    layers.push_back(l);
+
+    cFunc = CostFunction::CrossEntropy;
+
+    return l;
+}
+
+layer* model::AddDenseLayer(
+    uint32 numNeurons, 
+    ActivationFunction aFunc,
+    layer* previousLayer,
+    WeightInit init)
+{
+    if (layers.empty() || numNeurons > MaxNeurons || previousLayer == nullptr || init >= WeightInit::Last)
+    {
+        return nullptr;
+    }
+
+    layer* l = new denseLayer(numNeurons, aFunc, previousLayer);
+    l->Initialize(init, seed, uint32(layers.size()), pool);
+    layers.push_back(l);
+
+    if (aFunc == ActivationFunction::Softmax)
+    {
+        l->forClassification = true;
+
+        cFunc = CostFunction::CrossEntropy;    
+    }
+
+    return l;
+}
+
+void model::ForwardsPass(constColumnView inputs)
+{
+    TRACE_SCOPE("ForwardsPass");
+    inputsSparse = false;
+    layers.front()->ForwardsPass(inputs);
+
+    for (int l=1; l < layers.size(); l++)
+    {
+        TRACE_LAYER("forwards", l);
+        layers[l]->ForwardsPass(layers[l-1]->activationValue);
+    }
+
+    //for (real a : layers.back()->activationValue)
+    //    printf("a: %f ", a);
+
+    //printf("\n");
+}
+
+void model::ForwardsPass(const sparseRow& inputs)
+{
+    TRACE_SCOPE("ForwardsPass");
+    assert(takesSparseInputs(layers));
+
+    // the input layer's values are only read by a dense update
+    inputsSparse = true;
+    sparseInputs = inputs;
+    if (!opt.SparseUpdates())
+    {
+        layer& inputLayer = *layers.front();
+        std::fill(inputLayer.activationValue.begin(), inputLayer.activationValue.end(), real(0));
+        for (uint32 i=0; i < inputs.count; i++)
+            inputLayer.activationValue[inputs.indices[i]] = inputs.values[i];
+    }
+
+    {
+        TRACE_LAYER("forwards", 1);
+        static_cast<denseLayer*>(layers[1])->ForwardsPass(inputs);
+    }
+    for (uint32 l=2; l < layers.size(); l++)
+    {
+        TRACE_LAYER("forwards", l);
+        layers[l]->ForwardsPass(layers[l-1]->activationValue);
+    }
+}
+
+bool model::SparseInputs(constColumnView inputs, sparseRow& nonzeros)
+{
+    if (!takesSparseInputs(layers))
+        return false;
+
+    const uint32 numInputs = layers.front()->numNeurons;
+    if (nonzeroIndices.size() != numInputs)
+    {
+        nonzeroIndices.Allocate(numInputs);
+        nonzeroValues.Allocate(numInputs);
+    }
+
+    // gives up as soon as there are too many nonzeros for the sparse passes to be quicker
+    const uint32 limit = uint32(numInputs * SparseInputDensity);
+    const real* x = inputs.data();
+    uint32 count = 0;
+    for (uint32 i=0; i < numInputs; i++)
+    {
+        if (x[i] == 0)
+            continue;
+        if (count == limit)
+            return false;
+        nonzeroIndices.data()[count] = i;
+        nonzeroValues.data()[count] = x[i];
+        count++;
+    }
+
+    nonzeros.indices = nonzeroIndices.data();
+    nonzeros.values = nonzeroValues.data();
+    nonzeros.count = count;
+    return true;
+}
+
+bool model::ReadInputs(const sampleSource& source, uint32 r, constColumnView& inputs, sparseRow& nonzeros)
+{
+    if (source.SparseRow(r, nonzeros))
+    {
+        if (takesSparseInputs(layers) && nonzeros.count <= uint32(source.Cols() * SparseInputDensity))
+            return true;
+        inputs = source.Row(r, inputScratch);
+        return false;
+    }
+
+    inputs = source.Row(r, inputScratch);
+    return SparseInputs(inputs, nonzeros);
+}
+
+void model::PredictSingleInput(constColumnView inputs, columnView outputs)
+{
+    assert(inputs.size() == layers.front()->numNeurons);
+    assert(outputs.size() == layers.back()->numNeurons);
+
+    sparseRow nonzeros;
+    if (SparseInputs(inputs, nonzeros))
+    {
+        PredictSingleInput(nonzeros, outputs);
+        return;
+    }
+
+    TRACE_SCOPE("PredictSingleInput");
+    layers.front()->ForwardsPass(inputs);
+
+    for (uint32 l=1; l < layers.size(); l++)
+    {
+        TRACE_LAYER("forwards", l);
+        layers[l]->ForwardsPass(layers[l-1]->activationValue);
+    }
+
+    const layer& outputLayer = *layers.back();
+    for (uint32 i=0; i < outputLayer.numNeurons; i++)
+        outputs[i] = outputLayer.activationValue[i];
+}
+
+void model::PredictSingleInput(const sparseRow& inputs, columnView outputs)
+{
+    assert(takesSparseInputs(layers));
+    assert(outputs.size() == layers.back()->numNeurons);
+    TRACE_SCOPE("PredictSingleInput");
+
+    static_cast<denseLayer*>(layers[1])->ForwardsPass(inputs);
+    for (uint32 l=2; l < layers.size(); l++)
+    {
+        TRACE_LAYER("forwards", l);
+        layers[l]->ForwardsPass(layers[l-1]->activationValue);
+    }
+
+    const layer& outputLayer = *layers.back();
+    for (uint32 i=0; i < outputLayer.numNeurons; i++)
+        outputs[i] = outputLayer.activationValue[i];
+}
+
+double model::BackwardsPass(constColumnView targets, double learning_rate)
+{
+    TRACE_SCOPE("BackwardsPass");
+    layer* outputLayer = layers.back();
+    double accumlatedError;
+    {
+        TRACE_LAYER("backwards", layers.size() - 1);
+        accumlatedError = outputLayer->Gradients(nullptr, targets, cFunc);
+    }
+
+    // other layers, through the next layer's weights as they were for the forward pass
+    for (uint32 l =uint32(layers.size()-2); l > 0; l--)
+    {
+        TRACE_LAYER("backwards", l);
+        layers[l]->Gradients(layers[l+1], constColumnView(), cFunc);
+    }
+
+    // each weight row's gradient is the layer's inputs, scaled by the row's gradient
+    const optimizerStep step = opt.Step(learning_rate, ++optimizerSteps);
+    for (uint32 l=1; l < layers.size(); l++)
+    {
+        TRACE_LAYER("update", l);
+        layer& current = *layers[l];
+        if (l == 1 && inputsSparse && opt.SparseUpdates())
+        {
+            current.OptimizeSparse(step, sparseInputs);
+            continue;
+        }
+        const constMatrixView inputs(layers[l-1]->activationValue.data(), current.numNeurons, current.numInputs, 0);
+        current.Optimize(opt, step, inputs, current.gradients, current.gradients, 1);
+    }
+
+    return accumlatedError;
+}
+
+// runs the first count samples in a workspace through every layer
+void model::ForwardsBatch(batchWorkspace& ws, uint32 count) const
+{
+    for (uint32 l=1; l < layers.size(); l++)
+    {
+        TRACE_LAYER("forwards", l);
+        layers[l]->ForwardsBatch(ws.activations[l-1].subRows(0, count), ws.activations[l].subRows(0, count), ws.pack);
+    }
+}
+
+// runs the first count samples in a workspace forwards and backwards through the model,
+// leaving the weight and bias gradients summed over those samples in the workspace.
+// only reads the model, and returns the same loss that BackwardsPass reports per sample.
+double model::BatchGradients(batchWorkspace& ws, uint32 count) const
+{
+    assert(count > 0 && count <= ws.batchSize && ws.forTraining);
+    const uint32 numLayers = uint32(layers.size());
+
+    ForwardsBatch(ws, count);
+
+    // output layer errors
+    const layer& outputLayer = *layers.back();
+    double accumulatedLoss = 0;
+    withCost(cFunc, [&](auto c)
+    {
+        TRACE_SCOPE("cost");
+        using C = decltype(c);
+        for (uint32 b=0; b < count; b++)
+        {
+            const real* predicted = ws.activations.back()[b].data();
+            const real* targets = ws.targets[b].data();
+            real* errors = ws.gradients.back()[b].data();
+
+            double accumulatedError = 0;
+            for (uint32 n=0; n < outputLayer.numNeurons; n++)
+            {
+                errors[n] = C::Derivative(predicted[n], targets[n]);
+                const double e = C::Apply(predicted[n], targets[n]);
+                accumulatedError += e * e;
+            }
+            accumulatedLoss += accumulatedError * accumulatedError;
+        }
+    });
+
+    for (uint32 l=numLayers-1; l > 0; l--)
+    {
+        TRACE_LAYER("backwards", l);
+        const matrixView previousErrors = (l > 1) ? ws.gradients[l-1].subRows(0, count) : matrixView();
+        layers[l]->BackwardsBatch(
+            ws.activations[l-1].subRows(0, count),
+            ws.activations[l].subRows(0, count),
+            ws.gradients[l].subRows(0, count),
+            previousErrors,
+            ws.weightGradients[l],
+            ws.biasGradients[l],
+            ws.pack);
+    }
+
+    return accumulatedLoss;
+}
+
+// trains on count samples starting at first, with one update using the gradients averaged
+// over those samples. the samples are split into one contiguous shard per workspace, each
+// shard's gradients are computed on its own thread, then summed pairwise in a fixed order.
+double model::TrainBatch(const sampleSource& allInputs, const sampleSource& allTargets, uint32 first, uint32 count, const double learningRate)
+{
+    TRACE_SCOPE("TrainBatch");
+    const uint32 numShards = uint32(workspaces.size());
+    const uint32 perShard = (count + numShards - 1) / numShards;
+
+    pool.Run(numShards, [&](uint32 s)
+    {
+        batchWorkspace& ws = workspaces[s];
+        const uint32 begin = std::min(count, s * perShard);
+        ws.count = std::min(perShard, count - begin);
+        ws.loss = 0;
+        if (ws.count == 0)
+            return;
+
+        {
+            TRACE_SCOPE("read samples");
+            for (uint32 b=0; b < ws.count; b++)
+            {
+                readRow(allInputs, first + begin + b, ws.activations[0][b]);
+                readRow(allTargets, first + begin + b, ws.targets[b]);
+            }
+        }
+        ws.loss = BatchGradients(ws, ws.count);
+    });
+
+    // tree reduction into the first workspace. shards are filled in order, so an empty
+    // shard is never followed by one with samples in it.
+    const kernelTable& kernels = activeKernels();
+    for (uint32 step=1; step < numShards; step *= 2)
+    {
+        pool.Run((numShards + 2*step - 1) / (2*step), [&](uint32 pair)
+        {
+            TRACE_SCOPE("reduce");
+            batchWorkspace& dst = workspaces[pair * 2 * step];
+            const uint32 src = pair * 2 * step + step;
+            if (src >= numShards || workspaces[src].count == 0)
+                return;
+
+            const batchWorkspace& other = workspaces[src];
+            for (uint32 l=1; l < layers.size(); l++)
+            {
+                const matrixView weights = dst.weightGradients[l];
+                for (uint32 n=0; n < weights.rows; n++)
+                    kernels.axpy(weights[n].data(), other.weightGradients[l][n].data(), 1, weights.cols);
+                kernels.axpy(dst.biasGradients[l].data(), other.biasGradients[l].data(), 1, dst.biasGradients[l].size());
+            }
+            dst.count += other.count;
+            dst.loss += other.loss;
+        });
+    }
+
+    const batchWorkspace& total = workspaces[0];
+    assert(total.count == count);
+
+    const optimizerStep step = opt.Step(learningRate, ++optimizerSteps);
+    for (uint32 l=1; l < layers.size(); l++)
+    {
+        TRACE_LAYER("update", l);
+        layers[l]->Optimize(opt, step, total.weightGradients[l], constColumnView(), total.biasGradients[l], real(1) / count);
+    }
+
+    return total.loss;
+}
+
+void model::PredictBatch(const matrix& inputs, matrix& outputs)
+{
+    TRACE_SCOPE("PredictBatch");
+    const uint32 count = uint32(inputs.size());
+    const uint32 numOutputs = layers.back()->numNeurons;
+
+    outputs.resize(count);
+    for (column& row : outputs)
+        row.resize(numOutputs);
+
+    // one contiguous part per thread, each worked through a chunk at a time so the
+    // activations stay in cache
+    const uint32 numParts = std::max(1u, std::min(pool.NumThreads(), count / PredictChunkSize));
+    const uint32 perPart = (count + numParts - 1) / numParts;
+
+    ReserveWorkspaces(0);
+
+    pool.Run(numParts, [&](uint32 part)
+    {
+        batchWorkspace& ws = predictWorkspaces[part];
+        const uint32 begin = std::min(count, part * perPart);
+        const uint32 end = std::min(count, begin + perPart);
+
+        for (uint32 first = begin; first < end; first += PredictChunkSize)
+        {
+            const uint32 n = std::min(PredictChunkSize, end - first);
+            for (uint32 b=0; b < n; b++)
+            {
+                const column& row = inputs[first + b];
+                assert(row.size() == layers.front()->numNeurons);
+                std::copy(row.begin(), row.end(), ws.activations[0][b].begin());
+            }
+
+            ForwardsBatch(ws, n);
+
+            for (uint32 b=0; b < n; b++)
+            {
+                const constColumnView result = ws.activations.back()[b];
+                std::copy(result.begin(), result.end(), outputs[first + b].begin());
+            }
+        }
+    });
+}
+
+void model::SetNumThreads(uint32 numThreads)
+{
+    pool.SetNumThreads(numThreads);
+}
+
+void model::SetOptimizer(const optimizer& newOptimizer)
+{
+    opt = newOptimizer;
+    optimizerSteps = 0;
+    for (layer* l : layers)
+    {
+        l->moments.Free();
+        l->numMoments = 0;
+    }
+}
+
+bool model::CopyFrom(const model& source)
+{
+    TRACE_SCOPE("CopyFrom");
+    if (layers.empty())
+    {
+        for (const layer* l : source.layers)
+        {
+            layer* copy = newLayer(l->Kind(), l->numNeurons, l->aFunc, l->shape, l->window, layers.empty() ? nullptr : layers.back(), nullptr);
+            copy->forClassification = l->forClassification;
+            layers.push_back(copy);
+        }
+    }
+
+    if (layers.size() != source.layers.size())
+        return false;
+    for (uint32 i=0; i < layers.size(); i++)
+    {
+        const layer& from = *source.layers[i];
+        const layer& to = *layers[i];
+        if (from.Kind() != to.Kind() || from.numNeurons != to.numNeurons || from.numInputs != to.numInputs || from.aFunc != to.aFunc
+            || !(from.shape == to.shape) || !(from.window == to.window))
+            return false;
+    }
+
+    // the parameters are one block per layer, and the per-sample values three columns
+    for (uint32 i=0; i < layers.size(); i++)
+    {
+        const layer& from = *source.layers[i];
+        layer& to = *layers[i];
+        std::copy(from.activationValue.begin(), from.activationValue.end(), to.activationValue.begin());
+        std::copy(from.gradients.begin(), from.gradients.end(), to.gradients.begin());
+        std::copy(from.errors.begin(), from.errors.end(), to.errors.begin());
+        std::copy(from.Parameters(), from.Parameters() + from.NumParameters(), to.Parameters());
+    }
+
+    cFunc = source.cFunc;
+    loss = source.loss;
+    epoch = source.epoch;
+    return true;
+}
+
+void model::ReserveWorkspaces(uint32 batchSize)
+{
+    if (batchSize == 0)
+        batchSize = std::max(1u, reservedBatchSize);
+
+    const uint32 numThreads = pool.NumThreads();
+    const bool tuning = gemmTuning();
+    if (arena.data() && batchSize == reservedBatchSize && numThreads == reservedThreads && layers.size() == reservedLayers &&
+        tuning == reservedTuning)
+        return;
+
+    reservedBatchSize = batchSize;
+    reservedThreads = numThreads;
+    reservedLayers = uint32(layers.size());
+    reservedTuning = tuning;
+
+    // mini-batches are split into one shard per thread, and prediction runs a chunk
+    // per thread. per-sample training (batchSize 1) runs in the layers and needs neither,
+    // when the layers can do it.
+    const bool batched = batchSize > 1 || !trainsPerSample(layers);
+    const uint32 numShards = batched ? std::min(numThreads, batchSize) : 0;
+    const uint32 perShard = numShards ? (batchSize + numShards - 1) / numShards : 0;
+    const size_t trainSize = numShards ? batchWorkspace::StorageSize(layers, perShard, true) : 0;
+    const size_t predictSize = batchWorkspace::StorageSize(layers, PredictChunkSize, false);
+    const size_t inputSize = alignedCount<real>(layers.front()->numNeurons);
+    const size_t targetSize = alignedCount<real>(layers.back()->numNeurons);
+    arena.Allocate(inputSize + targetSize + trainSize * numShards + predictSize * numThreads);
+
+    real* p = arena.data();
+    inputScratch = columnView(p, layers.front()->numNeurons);     p += inputSize;
+    targetScratch = columnView(p, layers.back()->numNeurons);     p += targetSize;
+    workspaces.resize(numShards);
+    for (batchWorkspace& ws : workspaces)
+    {
+        ws.Carve(layers, perShard, true, p);
+        p += trainSize;
+    }
+    predictWorkspaces.resize(numThreads);
+    for (batchWorkspace& ws : predictWorkspaces)
+    {
+        ws.Carve(layers, PredictChunkSize, false, p);
+        p += predictSize;
+    }
+}
+
+void model::Train(
+    const matrix& allInputs,
+    const matrix& allTargets,
+    const int epochs,
+    const double learningRate,
+    const uint32 batchSize)
+{
+    Train(matrixSource(allInputs), matrixSource(allTargets), epochs, learningRate, batchSize);
+}
+
+void model::Train(
+    const sampleSource& allInputs,
+    const sampleSource& allTargets,
+    const int epochs,
+    const double learningRate,
+    const uint32 batchSize)
+{
+    assert(allInputs.Rows() == allTargets.Rows());
+    assert(allInputs.Cols() == layers.front()->numNeurons && allTargets.Cols() == layers.back()->numNeurons);
+
+    const bool batched = batchSize > 1 || !trainsPerSample(layers);
+    ReserveWorkspaces(batched ? batchSize : 0);
+
+    const uint32 sz = allInputs.Rows();
+    if (batched)
+    {
+        for (int e=0; e < epochs; e++)
+        {
+            TRACE_SCOPE("epoch");
+            loss = 0;
+            for (uint32 first = 0; first < sz; first += batchSize)
+                loss += TrainBatch(allInputs, allTargets, first, std::min(batchSize, sz - first), learningRate);
+        }
+        epoch += epochs;
+        return;
+    }
+
+    // the sparse passes only pay off when the update can skip the zeros too
+    const bool sparseUpdates = opt.SparseUpdates();
+    for (int e=0; e < epochs; e++)
+    {
+        TRACE_SCOPE("epoch");
+        loss = 0;
+        for (uint32 i = 0; i < sz; i++)
+        {
+            constColumnView inputs;
+            constColumnView targets;
+            sparseRow nonzeros;
+            bool sparse = false;
+            {
+                TRACE_SCOPE("read sample");
+                if (sparseUpdates)
+                    sparse = ReadInputs(allInputs, i, inputs, nonzeros);
+                else
+                    inputs = allInputs.Row(i, inputScratch);
+                targets = allTargets.Row(i, targetScratch);
+            }
+            if (sparse)
+                ForwardsPass(nonzeros);
+            else
+                ForwardsPass(inputs);
+            loss += BackwardsPass(targets, learningRate);
+        }
+        // run just one of the inputs
+        // int I = rand() % allInputs.size();
+        // ForwardsPass(allInputs[I]);
+        // loss = BackwardsPass(allTargets[I], learningRate);
+
+    }
+    epoch += epochs;
+}
+
+// ------------------------------- evaluation -------------------------------
+
+evaluation model::Evaluate(const matrix& inputs, const matrix& targets, uint32 topK)
+{
+    return Evaluate(matrixSource(inputs), matrixSource(targets), topK);
+}
+
+evaluation model::Evaluate(const sampleSource& inputs, const sampleSource& targets, uint32 topK)
+{
+    TRACE_SCOPE("Evaluate");
+    assert(inputs.Rows() == targets.Rows());
+    assert(inputs.Rows() == 0 || (inputs.Cols() == layers.front()->numNeurons && targets.Cols() == layers.back()->numNeurons));
+    const uint32 count = inputs.Rows();
+    const uint32 numClasses = layers.back()->numNeurons;
+    const bool crossEntropy = layers.back()->forClassification;
+
+    // split as PredictBatch splits, each part scoring its own samples into its own counts
+    const uint32 numParts = std::max(1u, std::min(pool.NumThreads(), count / PredictChunkSize));
+    const uint32 perPart = (count + numParts - 1) / numParts;
+
+    ReserveWorkspaces(0);
+
+    std::vector<evaluation> parts(numParts);
+    std::vector<column> targetRows(numParts, column(numClasses));
+    pool.Run(numParts, [&](uint32 part)
+    {
+        const kernelTable& kernels = activeKernels();
+        batchWorkspace& ws = predictWorkspaces[part];
+        evaluation& e = parts[part];
+        e.confusion.assign(size_t(numClasses) * numClasses, 0);
+        const uint32 begin = std::min(count, part * perPart);
+        const uint32 end = std::min(count, begin + perPart);
+
+        for (uint32 first = begin; first < end; first += PredictChunkSize)
+        {
+            const uint32 n = std::min(PredictChunkSize, end - first);
+            for (uint32 b=0; b < n; b++)
+                readRow(inputs, first + b, ws.activations[0][b]);
+
+            ForwardsBatch(ws, n);
+
+            withCost(cFunc, [&](auto c)
+            {
+                using C = decltype(c);
+                for (uint32 b=0; b < n; b++)
+                {
+                    const real* target = targets.Row(first + b, targetRows[part]).data();
+                    const real* outputs = ws.activations.back()[b].data();
+                    const uint32 actual = kernels.argmax(target, numClasses);
+                    const uint32 predicted = kernels.argmax(outputs, numClasses);
+
+                    // the class is in the top k when fewer than k outputs beat it
+                    e.correct += (predicted == actual) ? 1 : 0;
+                    e.topKCorrect += (kernels.countGreater(outputs, outputs[actual], numClasses) < topK) ? 1 : 0;
+                    e.confusion[size_t(actual) * numClasses + predicted]++;
+
+                    double sampleLoss = 0;
+                    for (uint32 i=0; i < numClasses; i++)
+                    {
+                        if (!crossEntropy)
+                            sampleLoss += C::Apply(outputs[i], target[i]);
+                        else if (target[i] > 0)
+                            sampleLoss -= target[i] * std::log(std::max(double(outputs[i]), 1e-30));
+                    }
+                    e.loss += sampleLoss;
+                }
+            });
+        }
+        e.count = end - begin;
+    });
+
+    // summed in part order, so a thread count always gives the same loss
+    evaluation total;
+    total.numClasses = numClasses;
+    total.topK = topK;
+    total.confusion.assign(size_t(numClasses) * numClasses, 0);
+    for (const evaluation& e : parts)
+    {
+        total.count += e.count;
+        total.correct += e.correct;
+        total.topKCorrect += e.topKCorrect;
+        total.loss += e.loss;
+        for (size_t i=0; i < total.confusion.size(); i++)
+            total.confusion[i] += e.confusion[i];
+    }
+    total.loss = count ? total.loss / count : 0;
+    return total;
+}
+
+// ------------------------------- saving and loading -------------------------------
+
+// a saved model is a modelHeader, a layerRecord per layer, then the parameters of each
+// layer (see layer::ParameterSize) starting on a cache line, in the order of the layers.
+// every block is a whole number of cache lines, so the parameters can be used in place
+// from a mapping of the file. little endian.
+const char ModelMagic[4] = { 'A', 'G', 'M', 'D' };
+const uint32 ModelVersion = 1;
+
+struct modelHeader
+{
+    char magic[4];
+    uint32 version;
+    TensorType type;            // the real the model was trained with
+    uint32 numLayers;
+    uint32 costFunction;
+    uint32 reserved[11];
+};
+static_assert(sizeof(modelHeader) == CacheLineSize, "the header fills one cache line");
+
+struct layerRecord
+{
+    LayerKind kind;
+    uint32 numNeurons;
+    uint32 numInputs;
+    uint32 activationFunction;
+    uint32 forClassification;
+    uint32 reserved0;
+    std::uint64_t dataOffset;   // bytes from the start of the file to the parameters
+    uint32 width;               // the layer's imageShape, all zero in older files
+    uint32 height;
+    uint32 channels;
+    uint32 windowSize;          // the imageWindow of convolution and pooling layers
+    uint32 windowStride;
+    uint32 windowPadding;
+    uint32 reserved[2];
+};
+static_assert(sizeof(layerRecord) == CacheLineSize, "each record fills one cache line");
+
+static TensorType realType()
+{
+    return (sizeof(real) == 4) ? TensorType::Float32 : TensorType::Float64;
+}
+
+static imageShape recordShape(const layerRecord& r)
+{
+    imageShape shape;
+    shape.channels = r.numNeurons;
+    if (r.channels != 0)
+    {
+        shape.width = r.width;
+        shape.height = r.height;
+        shape.channels = r.channels;
+    }
+    return shape;
+}
+
+static imageWindow recordWindow(const layerRecord& r)
+{
+    imageWindow window;
+    window.size = r.windowSize;
+    window.stride = r.windowStride;
+    window.padding = r.windowPadding;
+    return window;
+}
+
+bool model::Save(const char* filename) const
+{
+    TRACE_SCOPE("Save");
+    if (layers.empty())
+        return false;
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp)
+        return false;
+
+    modelHeader header = {};
+    memcpy(header.magic, ModelMagic, sizeof(header.magic));
+    header.version = ModelVersion;
+    header.type = realType();
+    header.numLayers = uint32(layers.size());
+    header.costFunction = uint32(cFunc);
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    std::uint64_t offset = sizeof(modelHeader) + sizeof(layerRecord) * layers.size();
+    for (const layer* l : layers)
+    {
+        layerRecord record = {};
+        record.kind = l->Kind();
+        record.numNeurons = l->numNeurons;
+        record.numInputs = l->numInputs;
+        record.activationFunction = uint32(l->aFunc);
+        record.forClassification = l->forClassification ? 1 : 0;
+        record.dataOffset = offset;
+        record.width = l->shape.width;
+        record.height = l->shape.height;
+        record.channels = l->shape.channels;
+        record.windowSize = l->window.size;
+        record.windowStride = l->window.stride;
+        record.windowPadding = l->window.padding;
+        ok = ok && fwrite(&record, sizeof(record), 1, fp) == 1;
+        offset += l->NumParameters() * sizeof(real);
+    }
+
+    for (const layer* l : layers)
+    {
+        const size_t count = l->NumParameters();
+        ok = ok && fwrite(l->Parameters(), sizeof(real), count, fp) == count;
+    }
+
+    return (fclose(fp) == 0) && ok;
+}
+
+bool model::Load(const char* filename, bool mapWeights)
+{
+    TRACE_SCOPE("Load");
+    if (!layers.empty() || !parameterFile.Open(filename, mapWeights))
+        return false;
+
+    const uint8* data = parameterFile.data();
+    const size_t size = parameterFile.size();
+    const modelHeader& header = *reinterpret_cast<const modelHeader*>(data);
+    bool ok = size >= sizeof(modelHeader)
+        && memcmp(header.magic, ModelMagic, sizeof(header.magic)) == 0
+        && header.version == ModelVersion
+        && header.type == realType()
+        && header.numLayers > 0
+        && header.costFunction < uint32(CostFunction::Last)
+        && size >= sizeof(modelHeader) + sizeof(layerRecord) * size_t(header.numLayers);
+
+    // check the whole topology before building any of it
+    const layerRecord* records = reinterpret_cast<const layerRecord*>(data + sizeof(modelHeader));
+    size_t totalParameters = 0;
+    std::vector<size_t> counts(ok ? header.numLayers : 0);
+    std::uint64_t used = ok ? sizeof(modelHeader) + sizeof(layerRecord) * std::uint64_t(header.numLayers) : 0;
+    imageShape previous;
+    for (uint32 i=0; ok && i < header.numLayers; i++)
+    {
+        const layerRecord& r = records[i];
+        const imageShape shape = recordShape(r);
+        const imageWindow window = recordWindow(r);
+        const bool input = (i == 0);
+
+        // the shape has to be the one the layer would make from the previous layer's
+        imageShape flat;
+        flat.channels = r.numNeurons;
+        bool fits = false;
+        size_t count = layer::ParameterSize(r.numNeurons, r.numInputs);
+        switch (r.kind)
+        {
+            case LayerKind::Input:
+                fits = input;
+                break;
+            case LayerKind::Dense:
+            case LayerKind::SoftmaxCrossEntropy:
+                fits = !input && shape == flat;
+                break;
+            case LayerKind::Convolution:
+                fits = !input && usableWindow(window, previous) && shape.channels <= uint32(MaxNeurons)
+                    && shape == window.Output(previous, shape.channels);
+                count = fits ? layer::ParameterSize(shape.channels, window.size * window.size * previous.channels) : 0;
+                break;
+            case LayerKind::MaxPool:
+            case LayerKind::AveragePool:
+                fits = !input && usableWindow(window, previous) && shape == window.Output(previous, previous.channels);
+                count = 0;
+                break;
+            default:
+                break;
+        }
+
+        // each layer's parameters start past the records and the layer before's, and end
+        // inside the file, checked so that no sum can wrap
+        const size_t bytes = count * sizeof(real);
+        ok = fits
+            && r.numNeurons > 0 && r.numNeurons <= uint32(MaxNeurons)
+            && std::uint64_t(shape.width) * shape.height * shape.channels == r.numNeurons
+            && r.numInputs == (input ? 0 : records[i-1].numNeurons)
+            && r.activationFunction < uint32(ActivationFunction::Last)
+            && r.dataOffset % CacheLineSize == 0
+            && r.dataOffset >= used && r.dataOffset <= size && bytes <= size - r.dataOffset;
+        used = r.dataOffset + bytes;
+        counts[i] = count;
+        totalParameters += count;
+        previous = shape;
+    }
+    if (!ok)
+    {
+        parameterFile.Close();
+        return false;
+    }
+
+    // the layers point at their parameters in the mapping, or in one copy of them all
+    real* copy = nullptr;
+    if (!mapWeights)
+    {
+        parameterCopy.Allocate(totalParameters);
+        copy = parameterCopy.data();
+    }
+
+    for (uint32 i=0; i < header.numLayers; i++)
+    {
+        const layerRecord& r = records[i];
+        real* parameters;
+        if (mapWeights)
+        {
+            parameters = reinterpret_cast<real*>(parameterFile.WritableData() + r.dataOffset);
+        }
+        else
+        {
+            memcpy(copy, data + r.dataOffset, counts[i] * sizeof(real));
+            parameters = copy;
+            copy += counts[i];
+        }
+
+        layer* l = newLayer(r.kind, r.numNeurons, ActivationFunction(r.activationFunction), recordShape(r), recordWindow(r),
+            layers.empty() ? nullptr : layers.back(), parameters);
+        l->forClassification = r.forClassification != 0;
+        layers.push_back(l);
+    }
+
+    cFunc = CostFunction(header.costFunction);
+
+    if (!mapWeights)
+        parameterFile.Close();
+    return true;
 }
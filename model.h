@@ -1,5 +1,10 @@
 #pragma once
 
+#include <cstdint>
+
+#include "dataset.h"
+#include "kernels.h"
+#include "threads.h"
 #include "utils.h"
 
 enum class ActivationFunction : short
@@ -10,7 +15,7 @@ enum class ActivationFunction : short
     Softmax,
     Last
 };
-using ActivationFuncPtr = double (*)(const double);
+using ActivationFuncPtr = real (*)(const real);
 
 enum class CostFunction : short
 {
@@ -20,72 +25,517 @@ enum class CostFunction : short
     CrossEntropy,
     Last
 };
-using CostFuncPtr = double (*)(const double, const double);
+
+enum class OptimizerKind : short
+{
+    SGD,
+    Momentum,
+    Nesterov,
+    Adam,
+    AdamW,
+    Last
+};
+
+// how the weights follow their gradients, at the learning rate given to Train. weightDecay
+// adds weightDecay * w to each weight's gradient, except with AdamW which takes it off the
+// weight directly instead, so it isn't scaled by the moments. biases are never decayed.
+struct optimizer
+{
+    OptimizerKind kind = OptimizerKind::SGD;
+    double momentum = 0.9;      // Momentum and Nesterov
+    double beta1 = 0.9;         // Adam and AdamW
+    double beta2 = 0.999;
+    double epsilon = 1e-8;
+    double weightDecay = 0;
+
+    // blocks of state the optimizer keeps per parameter
+    uint32 NumMoments() const;
+
+    // whether a weight with no gradient keeps its value, so a step can skip those weights
+    bool SparseUpdates() const { return kind == OptimizerKind::SGD && weightDecay == 0; }
+
+    // the constants for step t, counting from 1
+    optimizerStep Step(double learningRate, std::uint64_t t) const;
+};
+
+// how a layer's weights start. Uniform draws the weights and biases from [0, 1), as dense
+// layers always have. Xavier draws the weights from +-sqrt(6 / (fan in + fan out)), for
+// sigmoid layers, and He from +-sqrt(6 / fan in), for relu ones, and both zero the biases.
+enum class WeightInit : short
+{
+    Uniform,
+    Xavier,
+    He,
+    Last
+};
+
+// what a layer is, so a saved model can be rebuilt with the same layers
+enum class LayerKind : uint32
+{
+    Input,
+    Dense,
+    SoftmaxCrossEntropy,
+    Convolution,
+    MaxPool,
+    AveragePool,
+    Last
+};
+
+// a layer's values as an image, height rows of width pixels with each pixel's channels
+// next to each other. layers that aren't images are 1 x 1 with a channel per neuron.
+struct imageShape
+{
+    uint32 width = 1;
+    uint32 height = 1;
+    uint32 channels = 0;
+
+    uint32 Size() const { return width * height * channels; }
+    bool operator==(const imageShape& other) const { return width == other.width && height == other.height && channels == other.channels; }
+};
+
+// a square window moved over an image stride pixels at a time, as convolution and
+// pooling layers do, over the image with padding pixels of zeros around it
+struct imageWindow
+{
+    uint32 size = 1;
+    uint32 stride = 1;
+    uint32 padding = 0;
+
+    bool operator==(const imageWindow& other) const { return size == other.size && stride == other.stride && padding == other.padding; }
+
+    // whether the window fits the padded image at least once
+    bool Fits(const imageShape& input) const;
+
+    // the image with a pixel for each place the window goes, and the given channels
+    imageShape Output(const imageShape& input, uint32 channels) const;
+};
 
 struct layer
 {
-    layer(uint32 numNeurons);
-    ~layer() {}
+    // the biases and weights live in parameters when it's given, which must hold
+    // ParameterSize() values and outlive the layer, otherwise in the layer's own storage
+    layer(uint32 numNeurons, uint32 numInputs = 0, real* parameters = nullptr);
+
+    // as above, for layers whose weights aren't a row per neuron and a column per input
+    layer(uint32 numNeurons, uint32 numInputs, uint32 weightRows, uint32 weightCols, real* parameters);
+    virtual ~layer() {}
+
+    layer(const layer&) = delete;
+    layer& operator=(const layer&) = delete;
 
-    virtual void ForwardsPass(const column& inputs);
+    virtual void ForwardsPass(constColumnView inputs);
 
     double BackwardsPass(
         const layer& previousLayer,
         const layer* nextLayer,
         const double learning_rate,
-        const column& targets,
-        CostFuncPtr cf,
-        CostFuncPtr cfD);
+        constColumnView targets,
+        CostFunction cFunc);
+
+    // the two halves of BackwardsPass. Gradients reads the next layer's weights, so a
+    // model finds the gradients of every layer before it updates any of them. these
+    // per-sample passes are for dense layers only.
+    double Gradients(const layer* nextLayer, constColumnView targets, CostFunction cFunc);
+    void UpdateWeights(const layer& previousLayer, const double learning_rate);
+
+    // batched passes over a mini-batch, one sample per row. these only read the layer,
+    // all per-sample state lives in the views passed in.
+    // the matrix products pack their inputs into pack, see gemm.h, which holds PackSize()
+    // values, and any other scratch the passes need is carved from the front of it
+    virtual void ForwardsBatch(constMatrixView inputs, matrixView outputs, columnView pack = columnView()) const;
+
+    // on entry gradients holds dCost/dActivation for each sample, on exit the gradient
+    // with respect to z. accumulates the weight and bias gradients over the batch, and
+    // writes the errors for the previous layer unless previousErrors is empty.
+    virtual void BackwardsBatch(
+        constMatrixView inputs,
+        constMatrixView outputs,
+        matrixView gradients,
+        matrixView previousErrors,
+        matrixView weightGradients,
+        columnView biasGradients,
+        columnView pack = columnView()) const;
+
+    // values of pack the batched passes want, so their products don't allocate
+    virtual size_t PackSize() const;
+
+    void ApplyGradients(constMatrixView weightGradients, constColumnView biasGradients, const double scale);
+
+    // one step of opt over the biases and weights, each block in one pass that updates
+    // the weights and their moments together. the gradient of weights[n][i] is
+    // scale * rowScales[n] * weightGradients[n][i], with rowScales taken as 1 when empty,
+    // and the gradient of biases[n] is scale * biasGradients[n].
+    void Optimize(
+        const optimizer& opt,
+        const optimizerStep& step,
+        constMatrixView weightGradients,
+        constColumnView rowScales,
+        constColumnView biasGradients,
+        const real scale);
+
+    // the per-sample step of an optimizer with SparseUpdates, from the gradients after
+    // a pass over sparse inputs. the weights of the zero inputs have no gradient, so
+    // only those of the nonzeros are touched.
+    void OptimizeSparse(const optimizerStep& step, const sparseRow& inputs);
+
+    // fills the biases and weights by init, each value from a counter based random stream
+    // keyed by seed, the layer's index in its model and the value's place in the layer.
+    // no value depends on another, so the rows are split between the pool's threads and
+    // the weights come out the same on any number of them.
+    void Initialize(WeightInit init, std::uint64_t seed, uint32 index, threadPool& pool);
+
+    // turns dCost/dActivation into dCost/dz in place, one sample per row
+    virtual void ActivationGradients(constMatrixView outputs, matrixView gradients) const;
+
+    virtual LayerKind Kind() const { return LayerKind::Input; }
+
+    // the biases then the padded weight rows, one contiguous cache line aligned block
+    static size_t ParameterSize(uint32 numNeurons, uint32 numInputs);
+    size_t NumParameters() const { return ParameterSize(biases.size(), weights.cols); }
+    real* Parameters() const { return biases.data(); }
 
     const uint32 numNeurons;
+    const uint32 numInputs;
 
-    column activationValue;
-    column gradients;
-    column errors;
-    matrix weights;
-    column biases;
+    // all per-layer values live in one cache line aligned block, see layer::layer()
+    columnView activationValue;
+    columnView gradients;
+    columnView errors;
+    columnView biases;
+    matrixView weights; // [numNeurons][numInputs] when dense, rows padded to a cache line
     bool forClassification;
 
+    // the layer's values as an image, and for convolution and pooling the window that
+    // made them from the previous layer's
+    imageShape shape;
+    imageWindow window;
+
+    // the passes dispatch on aFunc once per layer; af and afD are the same functions
+    // for callers that want a single value
+    ActivationFunction aFunc;
     ActivationFuncPtr af;
     ActivationFuncPtr afD;
 
+    alignedArray<real> storage;
 
+    // the optimizer's state, numMoments blocks laid out like the parameters
+    alignedArray<real> moments;
+    uint32 numMoments = 0;
 };
 
 struct denseLayer : layer
 {
+    // the weights are zeros until they're initialized, unless they come from parameters
     denseLayer(
         uint32 numNeurons, 
         ActivationFunction aFunc,
-        layer* previous = nullptr);
+        layer* previous = nullptr,
+        real* parameters = nullptr);
 
-    void ForwardsPass(const column& inputs) override;
+    void ForwardsPass(constColumnView inputs) override;
+    void ForwardsBatch(constMatrixView inputs, matrixView outputs, columnView pack = columnView()) const override;
 
-    ActivationFunction aFunc;
+    // as above, reading only the weights of the nonzero inputs
+    void ForwardsPass(const sparseRow& inputs);
+
+    LayerKind Kind() const override { return LayerKind::Dense; }
+};
+
+// softmax output layer trained with cross entropy. the softmax jacobian and the cross
+// entropy derivative cancel down to dCost/dz = p - y, which is what the cross entropy
+// cost already hands back as the errors, so the backward pass is O(n) and in place.
+struct softmaxCrossEntropyLayer : denseLayer
+{
+    softmaxCrossEntropyLayer(uint32 numNeurons, layer* previous, real* parameters = nullptr);
+
+    void ActivationGradients(constMatrixView outputs, matrixView gradients) const override;
+
+    LayerKind Kind() const override { return LayerKind::SoftmaxCrossEntropy; }
+};
+
+// channels filters of window.size x window.size pixels over all the channels of the
+// previous layer's image, each making a channel of this one's. the passes turn the
+// patches each filter sees into the rows of a matrix (im2col), one sample at a time,
+// and run the same matrix products as the dense layers over them. the weights are a
+// row per filter, laid out like the patches, [y][x][input channel].
+struct convLayer : layer
+{
+    // the filters are zeros until they're initialized, unless they come from parameters
+    convLayer(
+        uint32 channels,
+        const imageWindow& window,
+        ActivationFunction aFunc,
+        layer* previous,
+        real* parameters = nullptr);
+
+    void ForwardsPass(constColumnView inputs) override;
+    void ForwardsBatch(constMatrixView inputs, matrixView outputs, columnView pack = columnView()) const override;
+    void BackwardsBatch(
+        constMatrixView inputs,
+        constMatrixView outputs,
+        matrixView gradients,
+        matrixView previousErrors,
+        matrixView weightGradients,
+        columnView biasGradients,
+        columnView pack = columnView()) const override;
+    size_t PackSize() const override;
+
+    LayerKind Kind() const override { return LayerKind::Convolution; }
+
+    // the patch of one sample's image under each output pixel, a row per pixel, and
+    // the reverse, adding each value of the patches back onto the pixel it came from
+    void Patches(const real* inputs, matrixView patches) const;
+    void AddPatches(constMatrixView patches, real* inputs) const;
+
+    imageShape input;
+    alignedArray<real> passPack;    // for ForwardsPass
+};
+
+// the largest or the mean of each channel under the window, with no parameters. padding
+// pixels are left out rather than counted as zeros.
+struct poolLayer : layer
+{
+    // kind is MaxPool or AveragePool
+    poolLayer(LayerKind kind, const imageWindow& window, layer* previous);
+
+    void ForwardsPass(constColumnView inputs) override;
+    void ForwardsBatch(constMatrixView inputs, matrixView outputs, columnView pack = columnView()) const override;
+    void BackwardsBatch(
+        constMatrixView inputs,
+        constMatrixView outputs,
+        matrixView gradients,
+        matrixView previousErrors,
+        matrixView weightGradients,
+        columnView biasGradients,
+        columnView pack = columnView()) const override;
+    size_t PackSize() const override { return 0; }
+
+    LayerKind Kind() const override { return kind; }
+
+    const LayerKind kind;
+    imageShape input;
+};
+
+// scratch buffers for running a mini-batch through the model, carved out of one aligned
+// block. workspaces only used for prediction leave out the gradients and targets.
+struct batchWorkspace
+{
+    // values of storage a workspace of this shape needs, a whole number of cache lines
+    static size_t StorageSize(const std::vector<layer*>& layers, uint32 batchSize, bool forTraining);
+
+    // points the workspace at StorageSize() values of someone else's storage
+    void Carve(const std::vector<layer*>& layers, uint32 batchSize, bool forTraining, real* p);
+
+    // as Carve, but with storage of its own
+    void Resize(const std::vector<layer*>& layers, uint32 batchSize, bool forTraining = true);
+
+    uint32 batchSize = 0;
+    uint32 numLayers = 0;
+    bool forTraining = false;
+
+    // samples currently in the workspace, and the loss over them
+    uint32 count = 0;
+    double loss = 0;
+
+    std::vector<matrixView> activations;        // per layer, [batchSize][numNeurons]
+    std::vector<matrixView> gradients;          // per layer, [batchSize][numNeurons]
+    std::vector<matrixView> weightGradients;    // per layer, shaped as its weights
+    std::vector<columnView> biasGradients;      // per layer, shaped as its biases
+    matrixView targets;                         // [batchSize][output numNeurons]
+    columnView pack;                            // packing space for the matrix products
+
+    alignedArray<real> storage;
+};
+
+// the seed of a new model's weights, see model::SetSeed
+const std::uint64_t DefaultSeed = 999999;
+
+// rows each thread pushes through the layers at a time in PredictBatch
+const uint32 PredictChunkSize = 64;
+
+// samples with no more than this share of nonzeros go through the first layer's sparse
+// passes, which take a weight per nonzero where the dense ones take a vector at a time.
+// past it, a 784 input layer predicts faster dense, and trains little faster sparse.
+const double SparseInputDensity = 0.05;
+
+// how a model did over a labelled set, from model::Evaluate. a sample's class is the
+// largest of its targets, and its prediction the largest of the model's outputs.
+struct evaluation
+{
+    uint32 count = 0;
+    uint32 numClasses = 0;
+    uint32 topK = 0;
+    uint32 correct = 0;         // samples whose prediction is their class
+    uint32 topKCorrect = 0;     // samples whose class is among the topK largest outputs
+    double loss = 0;            // mean over the samples, see model::Evaluate
+
+    // [actual][predicted], numClasses x numClasses counts of samples
+    std::vector<uint32> confusion;
+
+    double Accuracy() const { return count ? double(correct) / count : 0; }
+    double TopKAccuracy() const { return count ? double(topKCorrect) / count : 0; }
+    uint32 Confusion(uint32 actual, uint32 predicted) const { return confusion[size_t(actual) * numClasses + predicted]; }
 };
 
 struct model
 {
     model();
+    ~model();
+
+    model(const model&) = delete;
+    model& operator=(const model&) = delete;
 
     layer* AddInputLayer(uint32 numNeurons);
 
+    // an input layer of images, such as width x height x 3 for rgb
+    layer* AddInputLayer(const imageShape& shape);
+
+    // the layers with weights start them by init, from the model's seed
     layer* AddDenseLayer(
         uint32 numNeurons, 
         ActivationFunction aFunc, 
+        layer* previousLayer,
+        WeightInit init = WeightInit::Uniform);
+
+    // channels filters moved over the previous layer's image, see convLayer. a model
+    // with these trains on mini-batches, and a batchSize of 1 is a mini-batch of one.
+    layer* AddConvLayer(
+        uint32 channels,
+        const imageWindow& window,
+        ActivationFunction aFunc,
+        layer* previousLayer,
+        WeightInit init = WeightInit::He);
+
+    // kind is MaxPool or AveragePool, see poolLayer
+    layer* AddPoolLayer(
+        LayerKind kind,
+        const imageWindow& window,
         layer* previousLayer);
 
-    void ForwardsPass(const column& inputs);
-    double BackwardsPass(const column& targets, double learning_rate);
-    void Train(const matrix& allInputs, const matrix& allTargets, const int epochs, const double learningRate);
+    // a softmax output layer with the fused cross entropy gradient, for classification
+    layer* AddSoftmaxCrossEntropyLayer(
+        uint32 numNeurons,
+        layer* previousLayer,
+        WeightInit init = WeightInit::Uniform);
+
+    void ForwardsPass(constColumnView inputs);
+    double BackwardsPass(constColumnView targets, double learning_rate);
+
+    // as ForwardsPass, from the nonzeros of the inputs. a dense first layer only reads
+    // their weights, and when the optimizer has SparseUpdates, the next BackwardsPass
+    // only updates those.
+    void ForwardsPass(const sparseRow& inputs);
+
+    void ForwardsBatch(batchWorkspace& ws, uint32 count) const;
+    double BatchGradients(batchWorkspace& ws, uint32 count) const;
+    double TrainBatch(const sampleSource& allInputs, const sampleSource& allTargets, uint32 first, uint32 count, const double learningRate);
+
+    // batchSize of 1 updates the weights after every sample, otherwise the gradients
+    // are averaged over each mini-batch of batchSize samples before one update. samples
+    // trained one at a time go through the sparse passes when they are mostly zeros,
+    // see SparseInputDensity, whether they come from a sparseSource or not.
+    void Train(
+        const matrix& allInputs,
+        const matrix& allTargets,
+        const int epochs,
+        const double learningRate,
+        const uint32 batchSize = 1);
+
+    // as above, reading the samples from anywhere, such as a mapped tensor file
+    void Train(
+        const sampleSource& allInputs,
+        const sampleSource& allTargets,
+        const int epochs,
+        const double learningRate,
+        const uint32 batchSize = 1);
+
+    // sparse inputs go through the sparse passes, as when training
+    void PredictSingleInput(constColumnView inputs, columnView outputs);
+    void PredictSingleInput(const sparseRow& inputs, columnView outputs);
+
+    // predicts every row of inputs at once, one row of outputs per input. the rows are
+    // pushed through each layer together, and large batches are split across threads.
+    void PredictBatch(const matrix& inputs, matrix& outputs);
 
-    void PredictSingleInput(const column& inputs, column& outputs);
+    // runs every sample through the model, split across threads a chunk at a time as
+    // PredictBatch does, and scores the outputs against the targets. the loss is the
+    // cross entropy of a classification output layer, otherwise the cost function.
+    evaluation Evaluate(const sampleSource& inputs, const sampleSource& targets, uint32 topK = 5);
+    evaluation Evaluate(const matrix& inputs, const matrix& targets, uint32 topK = 5);
+
+    // threads used to train each mini-batch, 0 for one per hardware thread. each batch
+    // is split into one shard per thread, so results only depend on the thread count.
+    void SetNumThreads(uint32 numThreads);
+
+    // the optimizer used by Train, BackwardsPass and TrainBatch. starts it afresh, so the
+    // moments it keeps are zeroed on its first step.
+    void SetOptimizer(const optimizer& newOptimizer);
+
+    // the seed the weights of the layers added after this start from. two models with the
+    // same seed and layers start with the same weights, whatever their thread counts.
+    void SetSeed(std::uint64_t newSeed) { seed = newSeed; }
+
+    // copies source's weights, cost function, loss and epoch, and the values its layers
+    // hold from the last sample, into this model. a model with no layers yet is given
+    // the same layers first, and after that copying only overwrites values, so it doesn't
+    // allocate. false if the layers aren't the same shape as source's.
+    bool CopyFrom(const model& source);
+
+    // writes the layers and their weights to a versioned binary file. not over the file
+    // a model's weights are mapped from, which would pull them out from under it.
+    bool Save(const char* filename) const;
+
+    // rebuilds a saved model into this one, which must have no layers yet. with mapWeights
+    // the weights are used in place from a private mapping of the file, so loading costs
+    // nothing up front and training afterwards never writes back to the file. otherwise
+    // they are read into memory. false if the file isn't a model this build can load.
+    bool Load(const char* filename, bool mapWeights = true);
+
+    // carves the training and prediction workspaces out of the arena, for mini-batches
+    // of batchSize (1 for none, 0 to keep the current size) on the current thread count.
+    // Train and PredictBatch call this, and it only reallocates when that shape or the
+    // layers change, so training and prediction don't touch the heap once they have run.
+    void ReserveWorkspaces(uint32 batchSize);
+
+    // the nonzeros of a sample, when the first layer has sparse passes and the sample
+    // is sparse enough for them, picked out into nonzeroIndices and nonzeroValues
+    bool SparseInputs(constColumnView inputs, sparseRow& nonzeros);
+
+    // row r of a source for the per-sample passes: its nonzeros when SparseInputs would
+    // take them, read straight from a source that stores them, otherwise the whole row
+    bool ReadInputs(const sampleSource& source, uint32 r, constColumnView& inputs, sparseRow& nonzeros);
 
     std::vector<layer*> layers;
 
     CostFunction cFunc;
-    CostFuncPtr cf;
-    CostFuncPtr cfD;
+
+    optimizer opt;
+    std::uint64_t optimizerSteps = 0;
+    std::uint64_t seed = DefaultSeed;
+
+    // one workspace per shard of a mini-batch, and one per thread for prediction,
+    // all carved from the arena
+    std::vector<batchWorkspace> workspaces;
+    std::vector<batchWorkspace> predictWorkspaces;
+    columnView inputScratch;        // a converted sample for per-sample training
+    columnView targetScratch;
+
+    // the nonzeros of the last inputs, when they went through the sparse passes, and
+    // the space to pick them out of a dense sample
+    sparseRow sparseInputs;
+    bool inputsSparse = false;
+    alignedArray<uint32> nonzeroIndices;
+    alignedArray<real> nonzeroValues;
+    alignedArray<real> arena;
+
+    // backing for the weights of a loaded model
+    mappedFile parameterFile;
+    alignedArray<real> parameterCopy;
+    uint32 reservedBatchSize = 0;
+    uint32 reservedThreads = 0;
+    uint32 reservedLayers = 0;
+    bool reservedTuning = false;    // gemm packs are bigger with tuning on
+    threadPool pool;
 
     double loss;
     int epoch = 0;
@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "activations.h"
+#include "kernels.h"
+#include "quantized.h"
+#include "trace.h"
+
+// ------------------------------- quantization -------------------------------
+
+static uint8 quantizeInput(const real value, const real invScale, const int32 zero)
+{
+    const int32 q = int32(std::floor(value * invScale + real(0.5))) + zero;
+    return uint8(std::min(255, std::max(0, q)));
+}
+
+// the uint8 mapping for values in [lo, hi]. the range always takes in 0 so that zero,
+// which relu and the padding produce a lot of, is stored exactly.
+static void chooseInputRange(real lo, real hi, real& scale, int32& zero)
+{
+    lo = std::min(lo, real(0));
+    hi = std::max(hi, real(0));
+    if (hi - lo <= real(0))
+        hi = lo + 1;
+
+    scale = (hi - lo) / 255;
+    zero = std::min(255, std::max(0, int32(std::floor(-lo / scale + real(0.5)))));
+}
+
+static void quantizeWeights(const layer& l, quantizedLayer& q)
+{
+    q.numNeurons = l.numNeurons;
+    q.numInputs = l.numInputs;
+    q.stride = alignedCount<int8>(l.numInputs);
+    q.aFunc = l.aFunc;
+    q.forClassification = l.forClassification;
+
+    q.weights.Allocate(size_t(q.stride) * q.numNeurons);
+    q.rowScales.Allocate(q.numNeurons);
+    q.rowSums.Allocate(q.numNeurons);
+    q.biases.Allocate(q.numNeurons);
+
+    // symmetric per row, so a row's few large weights don't squash every other row
+    for (uint32 n=0; n < q.numNeurons; n++)
+    {
+        const real* w = l.weights[n].data();
+        real largest = 0;
+        for (uint32 i=0; i < q.numInputs; i++)
+            largest = std::max(largest, std::abs(w[i]));
+
+        const real scale = (largest > 0) ? largest / 127 : real(1);
+        const real invScale = 1 / scale;
+        int8* qw = q.weights.data() + size_t(n) * q.stride;
+        int32 sum = 0;
+        for (uint32 i=0; i < q.numInputs; i++)
+        {
+            const int32 v = std::min(127, std::max(-127, int32(std::floor(w[i] * invScale + real(0.5)))));
+            qw[i] = int8(v);
+            sum += v;
+        }
+
+        q.rowScales.data()[n] = scale;
+        q.rowSums.data()[n] = sum;
+        q.biases.data()[n] = l.biases[n];
+    }
+}
+
+// ------------------------------- quantizedModel -------------------------------
+
+bool quantizedModel::Build(const model& m, const sampleSource& calibration)
+{
+    TRACE_SCOPE("quantize");
+    const uint32 numLayers = uint32(m.layers.size());
+    if (numLayers < 2 || calibration.Cols() != m.layers.front()->numNeurons)
+        return false;
+
+    for (uint32 l=1; l < numLayers; l++)
+    {
+        const LayerKind kind = m.layers[l]->Kind();
+        if (kind != LayerKind::Dense && kind != LayerKind::SoftmaxCrossEntropy)
+            return false;
+    }
+
+    // the range of every layer's inputs over the calibration set, from the float model
+    std::vector<real> lo(numLayers, 0);
+    std::vector<real> hi(numLayers, 0);
+    batchWorkspace ws;
+    ws.Resize(m.layers, PredictChunkSize, false);
+    for (uint32 first = 0; first < calibration.Rows(); first += PredictChunkSize)
+    {
+        const uint32 count = std::min(PredictChunkSize, calibration.Rows() - first);
+        for (uint32 b=0; b < count; b++)
+            readRow(calibration, first + b, ws.activations[0][b]);
+
+        m.ForwardsBatch(ws, count);
+
+        for (uint32 l=0; l + 1 < numLayers; l++)
+        {
+            for (uint32 b=0; b < count; b++)
+            {
+                for (const real v : ws.activations[l][b])
+                {
+                    lo[l] = std::min(lo[l], v);
+                    hi[l] = std::max(hi[l], v);
+                }
+            }
+        }
+    }
+
+    layers.clear();
+    layers.resize(numLayers - 1);
+    for (uint32 l=1; l < numLayers; l++)
+    {
+        quantizedLayer& q = layers[l-1];
+        quantizeWeights(*m.layers[l], q);
+        chooseInputRange(lo[l-1], hi[l-1], q.inputScale, q.inputZero);
+    }
+
+    reservedThreads = 0;
+    return true;
+}
+
+void quantizedModel::SetNumThreads(uint32 numThreads)
+{
+    pool.SetNumThreads(numThreads);
+}
+
+size_t quantizedModel::WeightBytes() const
+{
+    size_t total = 0;
+    for (const quantizedLayer& q : layers)
+    {
+        total += q.weights.size() * sizeof(int8);
+        total += q.rowScales.size() * sizeof(real);
+        total += q.rowSums.size() * sizeof(int32);
+        total += q.biases.size() * sizeof(real);
+    }
+    return total;
+}
+
+void quantizedModel::Reserve()
+{
+    const uint32 numThreads = pool.NumThreads();
+    if (numThreads == reservedThreads)
+        return;
+    reservedThreads = numThreads;
+
+    // every layer's inputs fit in a chunk of the widest one
+    uint32 widest = 0;
+    for (const quantizedLayer& q : layers)
+        widest = std::max(widest, q.stride);
+    activationChunkSize = size_t(widest) * PredictChunkSize;
+    resultStride = alignedCount<real>(layers.back().numNeurons);
+
+    activations.Allocate(activationChunkSize * 2 * numThreads);
+    results.Allocate(size_t(resultStride) * PredictChunkSize * numThreads);
+}
+
+void quantizedModel::ForwardsChunk(uint32 thread, uint32 count) const
+{
+    const int8KernelTable& kernels = activeInt8Kernels();
+
+    uint8* x = activations.data() + activationChunkSize * 2 * thread;
+    uint8* y = activations.data() + activationChunkSize * (2 * thread + 1);
+    real* out = results.data() + size_t(resultStride) * PredictChunkSize * thread;
+
+    for (uint32 l=0; l < layers.size(); l++)
+    {
+        TRACE_LAYER("int8 forwards", l + 1);
+        const quantizedLayer& q = layers[l];
+        const quantizedLayer* next = (l + 1 < layers.size()) ? &layers[l+1] : nullptr;
+        const real nextInvScale = next ? 1 / next->inputScale : real(0);
+
+        // each weight row stays in cache while every sample in the chunk is run against it.
+        // the rows are padded with zero weights, so the padding of x drops out of the sums.
+        withActivation(q.aFunc, [&](auto act)
+        {
+            using A = decltype(act);
+            for (uint32 n=0; n < q.numNeurons; n++)
+            {
+                const int8* w = q.weights.data() + size_t(n) * q.stride;
+                const real scale = q.rowScales.data()[n] * q.inputScale;
+                const int32 offset = q.inputZero * q.rowSums.data()[n];
+                const real bias = q.biases.data()[n];
+                for (uint32 b=0; b < count; b++)
+                {
+                    const int32 acc = kernels.dot(x + size_t(b) * q.stride, w, q.stride) - offset;
+                    const real a = A::Apply(bias + scale * real(acc));
+                    if (next)
+                        y[size_t(b) * next->stride + n] = quantizeInput(a, nextInvScale, next->inputZero);
+                    else
+                        out[size_t(b) * resultStride + n] = a;
+                }
+            }
+        });
+
+        if (next)
+            std::swap(x, y);
+        else if (q.forClassification)
+        {
+            for (uint32 b=0; b < count; b++)
+                softmaxInPlace(columnView(out + size_t(b) * resultStride, q.numNeurons));
+        }
+    }
+}
+
+void quantizedModel::PredictBatch(const matrix& inputs, matrix& outputs)
+{
+    TRACE_SCOPE("int8 PredictBatch");
+    assert(!layers.empty());
+    const uint32 count = uint32(inputs.size());
+    const quantizedLayer& first = layers.front();
+    const uint32 numOutputs = layers.back().numNeurons;
+
+    outputs.resize(count);
+    for (column& row : outputs)
+        row.resize(numOutputs);
+
+    const uint32 numParts = std::max(1u, std::min(pool.NumThreads(), count / PredictChunkSize));
+    const uint32 perPart = (count + numParts - 1) / numParts;
+
+    Reserve();
+
+    const real invScale = 1 / first.inputScale;
+    pool.Run(numParts, [&](uint32 part)
+    {
+        const uint32 begin = std::min(count, part * perPart);
+        const uint32 end = std::min(count, begin + perPart);
+        uint8* x = activations.data() + activationChunkSize * 2 * part;
+        const real* out = results.data() + size_t(resultStride) * PredictChunkSize * part;
+
+        for (uint32 firstRow = begin; firstRow < end; firstRow += PredictChunkSize)
+        {
+            const uint32 n = std::min(PredictChunkSize, end - firstRow);
+            for (uint32 b=0; b < n; b++)
+            {
+                const column& row = inputs[firstRow + b];
+                assert(row.size() == first.numInputs);
+                uint8* qx = x + size_t(b) * first.stride;
+                for (uint32 i=0; i < first.numInputs; i++)
+                    qx[i] = quantizeInput(row[i], invScale, first.inputZero);
+            }
+
+            ForwardsChunk(part, n);
+
+            for (uint32 b=0; b < n; b++)
+            {
+                const real* result = out + size_t(b) * resultStride;
+                std::copy(result, result + numOutputs, outputs[firstRow + b].begin());
+            }
+        }
+    });
+}
+
+void quantizedModel::PredictSingleInput(constColumnView inputs, columnView outputs)
+{
+    assert(!layers.empty());
+    const quantizedLayer& first = layers.front();
+    assert(inputs.size() == first.numInputs && outputs.size() == layers.back().numNeurons);
+
+    Reserve();
+
+    const real invScale = 1 / first.inputScale;
+    for (uint32 i=0; i < first.numInputs; i++)
+        activations.data()[i] = quantizeInput(inputs[i], invScale, first.inputZero);
+
+    ForwardsChunk(0, 1);
+    std::copy(results.data(), results.data() + outputs.size(), outputs.begin());
+}
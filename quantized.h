@@ -0,0 +1,65 @@
+#pragma once
+
+#include "model.h"
+
+// ------------------------------- quantizedModel -------------------------------
+
+// one dense layer of a quantized model. each weight row is scaled into int8 on its own,
+// and the layer's inputs are mapped onto uint8 over the range they took on a calibration
+// set. dot products are summed exactly in int32, then scaled back to real for the bias
+// and activation, and the results mapped onto the next layer's uint8 inputs.
+struct quantizedLayer
+{
+    uint32 numNeurons = 0;
+    uint32 numInputs = 0;
+    uint32 stride = 0;              // bytes from one weight row to the next, and one input row to the next
+    ActivationFunction aFunc = ActivationFunction::None;
+    bool forClassification = false;
+
+    // an input x is stored as round(x / inputScale) + inputZero, clamped to 0-255
+    real inputScale = 1;
+    int32 inputZero = 0;
+
+    alignedArray<int8> weights;     // [numNeurons][stride], padded with zeros
+    alignedArray<real> rowScales;   // a weight is weights[n][i] * rowScales[n]
+    alignedArray<int32> rowSums;    // sum of each row of weights, to take inputZero back out
+    alignedArray<real> biases;
+};
+
+// an inference only copy of a trained model with 8 bit weights and activations. the
+// weights take an eighth of the memory of double ones and a quarter of float ones, and
+// the inner loops use the cpu's int8 dot product instructions where it has them.
+struct quantizedModel
+{
+    // quantizes m, which must only have dense layers after its input layer, using the
+    // activations it produces for the calibration samples. false if it can't be.
+    bool Build(const model& m, const sampleSource& calibration);
+
+    // as model::PredictBatch, a chunk of rows per thread at a time
+    void PredictBatch(const matrix& inputs, matrix& outputs);
+    void PredictSingleInput(constColumnView inputs, columnView outputs);
+
+    // threads used by PredictBatch, 0 for one per hardware thread
+    void SetNumThreads(uint32 numThreads);
+
+    // memory taken by the weights, scales and biases
+    size_t WeightBytes() const;
+
+    // sizes the per-thread scratch for the current layers and thread count
+    void Reserve();
+
+    // runs the first count rows of a thread's quantized inputs through every layer,
+    // leaving the outputs in its results
+    void ForwardsChunk(uint32 thread, uint32 count) const;
+
+    std::vector<quantizedLayer> layers;
+
+    // per thread, two chunks of quantized activations to pass between the layers, then
+    // a chunk of real outputs
+    alignedArray<uint8> activations;
+    alignedArray<real> results;
+    size_t activationChunkSize = 0;
+    uint32 resultStride = 0;
+    uint32 reservedThreads = 0;
+    threadPool pool;
+};
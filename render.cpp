@@ -1,8 +1,13 @@
+#include <algorithm>
+
 #include "render.h"
 
 renderWindow::renderWindow() 
     : window(sf::VideoMode(1100, 1100), "again", sf::Style::Close)
 {
+    // the apps train on another thread, so drawing only needs as many frames as show
+    window.setFramerateLimit(60);
+
     font.loadFromFile("Resources/Fonts/arial.ttf");
 
     titleStr.setFont(font);
@@ -13,9 +18,6 @@ renderWindow::renderWindow()
 
     gradientStr.setFont(font);
 
-    rect.setSize(sf::Vector2f(8.0f, 8.0f));
-    rect.setFillColor(sf::Color::White);
-
     imageTexture.create(32,32);
     imageSprite.setPosition(40,160);
     pixels = new sf::Uint8[32 * 32 * 4];
@@ -59,7 +61,7 @@ void renderWindow::DisplayImage(
 }
 
 void renderWindow::DisplayGrid(
-    const column& gradients,
+    constColumnView gradients,
     const column& activations1,
     const column& activations2,
     const column& activations3,    
@@ -104,23 +106,30 @@ void renderWindow::DisplayGrid(
         window.draw(gradientStr);
     }
 
-    for (int y=0; y < gridSize; y++)
+    // the cells go into one texture of a pixel each, drawn scaled up in a single call,
+    // so a finer grid costs no more draw calls than a coarse one
+    if (gridTexture.getSize().x != unsigned(gridSize))
     {
-        for (int x=0; x < gridSize; x++)
-        {
-            const int i = y * gridSize + x;
-            const column& rgb = values[i];
-
-            sf::Uint8 r = sf::Uint8(rgb[0] * 255);
-            sf::Uint8 g = sf::Uint8(rgb[1] * 255);
-            sf::Uint8 b = sf::Uint8(rgb[2] * 255);
-
-            rect.setPosition(sf::Vector2f(20 + x*10*1.0f, 100 + y*10*1.0f));
-            rect.setFillColor(sf::Color(r, g, b,  255));
+        gridTexture.create(gridSize, gridSize);
+        gridPixels.resize(size_t(gridSize) * gridSize * 4);
+        gridSprite.setTexture(gridTexture, true);
+        gridSprite.setScale(GridPixels / gridSize, GridPixels / gridSize);
+    }
 
-            window.draw(rect);
-        }
+    auto channel = [](real v) { return sf::Uint8(std::min(real(1), std::max(real(0), v)) * 255); };
+    for (int i=0; i < gridSize * gridSize; i++)
+    {
+        const column& rgb = values[i];
+        sf::Uint8* p = &gridPixels[size_t(i) * 4];
+        p[0] = channel(rgb[0]);
+        p[1] = channel(rgb[1]);
+        p[2] = channel(rgb[2]);
+        p[3] = 255;
     }
+
+    gridTexture.update(gridPixels.data());
+    gridSprite.setPosition(20, 100);
+    window.draw(gridSprite);
 }
 
 void renderWindow::EndDisplay()
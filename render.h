@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include <SFML/Graphics.hpp>
 
 #include "utils.h"
@@ -25,7 +27,7 @@ class renderWindow
       int y);
 
     void DisplayGrid(
-      const column& gradients,
+      constColumnView gradients,
       const column& activations1,
       const column& activations2,
       const column& activations3,      
@@ -46,5 +48,9 @@ class renderWindow
     sf::Sprite imageSprite;
      sf::Uint8* pixels;
 
-    sf::RectangleShape rect;
+    // the decision grid, a pixel per cell scaled up to GridPixels across
+    static constexpr float GridPixels = 800.0f;
+    sf::Texture gridTexture;
+    sf::Sprite gridSprite;
+    std::vector<sf::Uint8> gridPixels;
 };
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "activations.h"
+#include "model.h"
+
+// ------------------------------- staticLayer -------------------------------
+
+// a dense layer of a staticModel, numNeurons wide with activation aFunc
+template <uint32 Neurons, ActivationFunction A>
+struct staticLayer
+{
+    static const uint32 numNeurons = Neurons;
+    static const ActivationFunction aFunc = A;
+};
+
+// the values of a dense layer whose sizes are known at compile time. the weights are
+// stored an input at a time, weights[i][n], so the loops over the neurons run along
+// contiguous values and the compiler can unroll and vectorize them.
+template <uint32 Inputs, uint32 Neurons, ActivationFunction A>
+struct staticDense
+{
+    alignas(CacheLineSize) std::array<std::array<real, Neurons>, Inputs> weights{};
+    alignas(CacheLineSize) std::array<real, Neurons> biases{};
+    std::array<real, Neurons> activationValue{};
+    std::array<real, Neurons> gradients{};
+
+    void ForwardsPass(const real* inputs)
+    {
+        std::array<real, Neurons> z = biases;
+        for (uint32 i=0; i < Inputs; i++)
+        {
+            for (uint32 n=0; n < Neurons; n++)
+                z[n] += weights[i][n] * inputs[i];
+        }
+        for (uint32 n=0; n < Neurons; n++)
+            activationValue[n] = activation<A>::Apply(z[n]);
+
+        if constexpr (A == ActivationFunction::Softmax)
+            softmaxInPlace(columnView(activationValue.data(), Neurons));
+    }
+
+    // the gradients from the errors of the activations, as layer::ActivationGradients
+    void ActivationGradients(const std::array<real, Neurons>& errors)
+    {
+        if constexpr (A == ActivationFunction::Softmax)
+        {
+            real s = 0;
+            for (uint32 n=0; n < Neurons; n++)
+                s += errors[n] * activationValue[n];
+            for (uint32 n=0; n < Neurons; n++)
+                gradients[n] = activationValue[n] * (errors[n] - s);
+        }
+        else
+        {
+            for (uint32 n=0; n < Neurons; n++)
+                gradients[n] = errors[n] * activation<A>::Derivative(activationValue[n]);
+        }
+    }
+
+    // one step of SGD, as layer::UpdateWeights
+    void UpdateWeights(const real* inputs, const real learningRate)
+    {
+        std::array<real, Neurons> step;
+        for (uint32 n=0; n < Neurons; n++)
+            step[n] = -learningRate * gradients[n];
+        for (uint32 i=0; i < Inputs; i++)
+        {
+            for (uint32 n=0; n < Neurons; n++)
+                weights[i][n] += step[n] * inputs[i];
+        }
+        for (uint32 n=0; n < Neurons; n++)
+            biases[n] += step[n];
+    }
+
+    // whether l is a dense layer this one can hold the weights of
+    static bool Matches(const layer& l)
+    {
+        return l.Kind() == LayerKind::Dense && l.aFunc == A && l.numNeurons == Neurons && l.numInputs == Inputs;
+    }
+
+    void CopyFrom(const layer& l)
+    {
+        for (uint32 n=0; n < Neurons; n++)
+        {
+            for (uint32 i=0; i < Inputs; i++)
+                weights[i][n] = l.weights[n][i];
+            biases[n] = l.biases[n];
+            activationValue[n] = l.activationValue[n];
+            gradients[n] = l.gradients[n];
+        }
+    }
+
+    void CopyTo(layer& l) const
+    {
+        for (uint32 n=0; n < Neurons; n++)
+        {
+            for (uint32 i=0; i < Inputs; i++)
+                l.weights[n][i] = weights[i][n];
+            l.biases[n] = biases[n];
+            l.activationValue[n] = activationValue[n];
+            l.gradients[n] = gradients[n];
+        }
+    }
+};
+
+// ------------------------------- staticLayers -------------------------------
+
+// the layers after Inputs values, one staticDense for the first of Layers and the rest
+// after it. every pass recurses down them, so each layer's loops are their own code.
+template <uint32 Inputs, typename... Layers>
+struct staticLayers
+{
+    static const uint32 numOutputs = Inputs;
+    static const uint32 numLayers = 0;
+
+    const real* ForwardsPass(const real* inputs) { return inputs; }
+    void UpdateWeights(const real*, const real) {}
+    static bool Matches(const std::vector<layer*>&, uint32) { return true; }
+    void CopyFrom(const std::vector<layer*>&, uint32) {}
+    void CopyTo(const std::vector<layer*>&, uint32) const {}
+    static void AddLayers(model&, layer*) {}
+};
+
+template <uint32 Inputs, typename L, typename... Rest>
+struct staticLayers<Inputs, L, Rest...>
+{
+    using next = staticLayers<L::numNeurons, Rest...>;
+    static const uint32 numNeurons = L::numNeurons;
+    static const uint32 numOutputs = next::numOutputs;
+    static const uint32 numLayers = next::numLayers + 1;
+
+    staticDense<Inputs, L::numNeurons, L::aFunc> current;
+    next rest;
+
+    const real* ForwardsPass(const real* inputs)
+    {
+        current.ForwardsPass(inputs);
+        return rest.ForwardsPass(current.activationValue.data());
+    }
+
+    // every layer's gradients, back from the output layer's errors against the targets.
+    // they all go through the next layer's weights before any of them are updated.
+    template <CostFunction C>
+    double Gradients(const real* targets)
+    {
+        std::array<real, L::numNeurons> errors;
+        double loss = 0;
+        if constexpr (sizeof...(Rest) == 0)
+        {
+            for (uint32 n=0; n < L::numNeurons; n++)
+            {
+                const real predicted = current.activationValue[n];
+                errors[n] = cost<C>::Derivative(predicted, targets[n]);
+
+                // only for reporting, as layer::Gradients
+                loss += std::pow(cost<C>::Apply(predicted, targets[n]), 2);
+            }
+            loss = std::pow(loss, 2);
+        }
+        else
+        {
+            loss = rest.template Gradients<C>(targets);
+            const auto& nextLayer = rest.current;
+            for (uint32 n=0; n < L::numNeurons; n++)
+            {
+                real e = 0;
+                for (uint32 k=0; k < next::numNeurons; k++)
+                    e += nextLayer.weights[n][k] * nextLayer.gradients[k];
+                errors[n] = e;
+            }
+        }
+        current.ActivationGradients(errors);
+        return loss;
+    }
+
+    void UpdateWeights(const real* inputs, const real learningRate)
+    {
+        current.UpdateWeights(inputs, learningRate);
+        rest.UpdateWeights(current.activationValue.data(), learningRate);
+    }
+
+    // whether layers[l] onwards are the dense layers these are
+    static bool Matches(const std::vector<layer*>& layers, uint32 l)
+    {
+        return l < layers.size() && decltype(current)::Matches(*layers[l]) && next::Matches(layers, l + 1);
+    }
+
+    void CopyFrom(const std::vector<layer*>& layers, uint32 l)
+    {
+        current.CopyFrom(*layers[l]);
+        rest.CopyFrom(layers, l + 1);
+    }
+
+    void CopyTo(const std::vector<layer*>& layers, uint32 l) const
+    {
+        current.CopyTo(*layers[l]);
+        rest.CopyTo(layers, l + 1);
+    }
+
+    static void AddLayers(model& m, layer* previous)
+    {
+        next::AddLayers(m, m.AddDenseLayer(L::numNeurons, L::aFunc, previous));
+    }
+};
+
+// ------------------------------- staticModel -------------------------------
+
+// a model of dense layers whose sizes and activations are template parameters, such as
+// staticModel<2, staticLayer<8, Sigmoid>, staticLayer<3, Sigmoid>>. the values are held
+// in arrays inside it, and the passes are plain loops of known length with the activation
+// inlined, with no layer objects, virtual calls or function pointers in between. it trains
+// one sample at a time with SGD and the cost function a model of the same layers would
+// pick, so for small models it stands in for one: CopyFrom and CopyTo move the weights
+// between the two.
+template <uint32 Inputs, typename... Layers>
+struct staticModel
+{
+    static_assert(sizeof...(Layers) > 0, "a model needs an output layer");
+
+    using stack = staticLayers<Inputs, Layers...>;
+    static const uint32 numInputs = Inputs;
+    static const uint32 numOutputs = stack::numOutputs;
+
+    // as model::AddDenseLayer, softmax anywhere makes the cost cross entropy
+    static const CostFunction cFunc =
+        ((Layers::aFunc == ActivationFunction::Softmax) || ...) ? CostFunction::CrossEntropy : CostFunction::MSE;
+
+    // starts from the weights a model of the same layers starts with
+    staticModel()
+    {
+        model m;
+        AddLayers(m);
+        CopyFrom(m);
+    }
+
+    // adds these layers to a model with none yet
+    static void AddLayers(model& m)
+    {
+        stack::AddLayers(m, m.AddInputLayer(Inputs));
+    }
+
+    // whether m's layers are these, so the weights can be copied either way
+    static bool Matches(const model& m)
+    {
+        return m.layers.size() == stack::numLayers + 1 && m.layers.front()->numNeurons == Inputs &&
+            stack::Matches(m.layers, 1) && m.cFunc == cFunc;
+    }
+
+    // copies source's weights, loss and epoch, and the values its layers hold from the
+    // last sample. false if its layers aren't these.
+    bool CopyFrom(const model& source)
+    {
+        if (!Matches(source))
+            return false;
+
+        for (uint32 i=0; i < Inputs; i++)
+            inputs[i] = source.layers.front()->activationValue[i];
+        layers.CopyFrom(source.layers, 1);
+        loss = source.loss;
+        epoch = source.epoch;
+        return true;
+    }
+
+    // the other way, into a model that is given these layers first if it has none
+    bool CopyTo(model& target) const
+    {
+        if (target.layers.empty())
+            AddLayers(target);
+        if (!Matches(target))
+            return false;
+
+        for (uint32 i=0; i < Inputs; i++)
+            target.layers.front()->activationValue[i] = inputs[i];
+        layers.CopyTo(target.layers, 1);
+        target.loss = loss;
+        target.epoch = epoch;
+        return true;
+    }
+
+    // returns the numOutputs outputs, which stay in the model until the next pass
+    const real* ForwardsPass(const real* values)
+    {
+        std::copy(values, values + Inputs, inputs.begin());
+        return layers.ForwardsPass(inputs.data());
+    }
+
+    // after a ForwardsPass, one SGD step towards numOutputs targets
+    double BackwardsPass(const real* targets, const double learningRate)
+    {
+        const double sampleLoss = layers.template Gradients<cFunc>(targets);
+        layers.UpdateWeights(inputs.data(), real(learningRate));
+        return sampleLoss;
+    }
+
+    // as model::Train with a batchSize of 1
+    void Train(const matrix& allInputs, const matrix& allTargets, const int epochs, const double learningRate)
+    {
+        assert(allInputs.size() == allTargets.size());
+        for (int e=0; e < epochs; e++)
+        {
+            loss = 0;
+            for (uint32 i=0; i < allInputs.size(); i++)
+            {
+                assert(allInputs[i].size() == Inputs && allTargets[i].size() == numOutputs);
+                ForwardsPass(allInputs[i].data());
+                loss += BackwardsPass(allTargets[i].data(), learningRate);
+            }
+        }
+        epoch += epochs;
+    }
+
+    void PredictSingleInput(constColumnView values, columnView outputs)
+    {
+        assert(values.size() == Inputs && outputs.size() == numOutputs);
+        const real* results = ForwardsPass(values.data());
+        std::copy(results, results + numOutputs, outputs.begin());
+    }
+
+    // a row at a time on this thread, which for a model this small is quicker than
+    // splitting the rows between threads
+    void PredictBatch(const matrix& allInputs, matrix& outputs)
+    {
+        outputs.resize(allInputs.size());
+        for (uint32 i=0; i < allInputs.size(); i++)
+        {
+            outputs[i].resize(numOutputs);
+            PredictSingleInput(allInputs[i], outputs[i]);
+        }
+    }
+
+    std::array<real, Inputs> inputs{};
+    stack layers;
+
+    double loss = 0;
+    int epoch = 0;
+};
@@ -1,6 +1,86 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
-
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include "gemm.h"
+#include "kernels.h"
 #include "model.h"
+#include "quantized.h"
+#include "staticmodel.h"
+#include "trace.h"
+#include "trainer.h"
+
+// ------------------------------ precision ------------------------------
+
+// the tests build in double, and with AGAIN_FLOAT in float, as the apps run. the checks
+// that need double, such as the gradient checks against central differences, only run
+// in double, and the rest allow for float's rounding.
+const bool DoublePrecision = std::is_same_v<real, double>;
+const double Rounding = DoublePrecision ? 1e-12 : 1e-5;
+
+// ------------------------------ allocation counting ------------------------------
+
+// every heap allocation in the tests comes through here, so a test can check that
+// a stretch of code doesn't allocate by comparing the count either side of it
+static std::atomic<uint64> allocationCount{0};
+
+// gcc pairs the new expressions it inlines against the free() below and warns
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size)
+{
+    allocationCount++;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    allocationCount++;
+    const size_t a = size_t(alignment);
+    const size_t rounded = (size + a - 1) / a * a;
+#if defined(_MSC_VER)
+    if (void* p = _aligned_malloc(rounded ? rounded : a, a))
+#else
+    if (void* p = std::aligned_alloc(a, rounded ? rounded : a))
+#endif
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+#if defined(_MSC_VER)
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void operator delete(void* p, size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(p, alignment);
+}
 
 bool nothing()
 {
@@ -103,7 +183,7 @@ bool predict()
         layer il(2);
         denseLayer dl(1, ActivationFunction::Sigmoid, &il);
 
-        dl.biases = {0.3};
+        dl.biases[0] = 0.3;
         dl.weights[0][0] = 0.23;
         dl.weights[0][1] = -0.1;
 
@@ -118,14 +198,14 @@ bool predict()
     }
 
     {
-        // just to get cfD
+        // just to get cFunc
         model m;
 
         layer il(1);
         denseLayer dl(1, ActivationFunction::Sigmoid, &il);
         denseLayer ol(1, ActivationFunction::Sigmoid, &dl);        
 
-        dl.biases = {0.3};
+        dl.biases[0] = 0.3;
         dl.weights[0][0] = 0.3;
 
         column inputs(1);
@@ -136,8 +216,8 @@ bool predict()
 
         dl.ForwardsPass(inputs);
         
-        ol.BackwardsPass(dl, nullptr, 0.5, targets, m.cf, m.cfD);
-        dl.BackwardsPass(il, &ol, 0.5, ol.activationValue, m.cf, m.cfD);
+        ol.BackwardsPass(dl, nullptr, 0.5, targets, m.cFunc);
+        dl.BackwardsPass(il, &ol, 0.5, ol.activationValue, m.cFunc);
 
     }
 
@@ -332,6 +412,1712 @@ bool seeds()
     return true;
 }
 
+// ------------------------------ mini-batch test ------------------------------
+
+bool sameWeights(const model& a, const model& b, double tolerance);
+
+bool batches()
+{
+    // the batched forward pass gives the same outputs as the single sample one
+    for (ActivationFunction af : {ActivationFunction::Sigmoid, ActivationFunction::Relu, ActivationFunction::Softmax})
+    {
+        model m;
+        layer* l = m.AddInputLayer(2);
+        l = m.AddDenseLayer(5, ActivationFunction::Sigmoid, l);
+        l = m.AddDenseLayer(3, af, l);
+
+        const uint32 count = uint32(seedsDataset.size());
+        batchWorkspace ws;
+        ws.Resize(m.layers, count);
+        for (uint32 b=0; b < count; b++)
+            std::copy(seedsDataset[b].begin(), seedsDataset[b].end(), ws.activations[0][b].begin());
+
+        for (uint32 i=1; i < m.layers.size(); i++)
+            m.layers[i]->ForwardsBatch(ws.activations[i-1], ws.activations[i]);
+
+        column out(3);
+        for (uint32 b=0; b < count; b++)
+        {
+            m.PredictSingleInput(seedsDataset[b], out);
+            for (uint32 n=0; n < 3; n++)
+            {
+                if (fabs(out[n] - ws.activations.back()[b][n]) > Rounding)
+                    return false;
+            }
+        }
+    }
+
+    // a batch of two copies of a sample makes the same update as that one sample, in
+    // the hidden layers too, which only holds if every layer's gradients are found from
+    // the weights as they were before the update
+    {
+        model single;
+        single.SetSeed(4242);
+        layer* l = single.AddInputLayer(2);
+        l = single.AddDenseLayer(3, ActivationFunction::Relu, l);
+        single.AddDenseLayer(2, ActivationFunction::Sigmoid, l);
+
+        model batched;
+        batched.SetSeed(4242);
+        l = batched.AddInputLayer(2);
+        l = batched.AddDenseLayer(3, ActivationFunction::Relu, l);
+        batched.AddDenseLayer(2, ActivationFunction::Sigmoid, l);
+
+        single.Train({seedsDataset[0]}, {seedsOutputs[0]}, 1, 0.5);
+        batched.Train({seedsDataset[0], seedsDataset[0]}, {seedsOutputs[0], seedsOutputs[0]}, 1, 0.5, 2);
+
+        if (!sameWeights(single, batched, Rounding))
+            return false;
+    }
+
+    return true;
+}
+
+// ------------------------------ threads test ------------------------------
+
+void initThreadsModel(model& m, uint32 numThreads)
+{
+    m.SetNumThreads(numThreads);
+    layer* l = m.AddInputLayer(2);
+    l = m.AddDenseLayer(7, ActivationFunction::Sigmoid, l);
+    l = m.AddDenseLayer(2, ActivationFunction::Softmax, l);
+}
+
+bool sameWeights(const model& a, const model& b, double tolerance)
+{
+    for (uint32 i=1; i < a.layers.size(); i++)
+    {
+        const layer& la = *a.layers[i];
+        const layer& lb = *b.layers[i];
+        for (uint32 n=0; n < la.biases.size(); n++)
+        {
+            if (fabs(la.biases[n] - lb.biases[n]) > tolerance)
+                return false;
+            for (uint32 j=0; j < la.weights.cols; j++)
+            {
+                if (fabs(la.weights[n][j] - lb.weights[n][j]) > tolerance)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool threads()
+{
+    // the same thread count gives bitwise identical weights, and any thread count
+    // matches the single threaded result up to the order the gradients are summed in
+    model single;
+    initThreadsModel(single, 1);
+    model first;
+    initThreadsModel(first, 3);
+    model second;
+    initThreadsModel(second, 3);
+
+    for (uint32 e=0; e < 10; e++)
+    {
+        single.Train(seedsDataset, seedsOutputs, 1, 0.5, 8);
+        first.Train(seedsDataset, seedsOutputs, 1, 0.5, 8);
+        second.Train(seedsDataset, seedsOutputs, 1, 0.5, 8);
+    }
+
+    return sameWeights(first, second, 0) && sameWeights(single, first, Rounding) && first.loss == second.loss;
+}
+
+bool threadPoolRuns()
+{
+    // loops run back to back run every task exactly once, each with its own context,
+    // however late a worker wakes for the loop before. the counts are only checked at
+    // the end, so a task run late with an old context shows up too.
+    threadPool pool;
+    pool.SetNumThreads(4);
+
+    const uint32 MaxTasks = 17;
+    const uint32 Loops = 20000;
+    struct loopCounts
+    {
+        std::atomic<uint32> runs[MaxTasks]{};
+    };
+    std::vector<loopCounts> loops(Loops);
+    for (uint32 l=0; l < Loops; l++)
+    {
+        auto task = [](void* context, uint32 i) { static_cast<loopCounts*>(context)->runs[i]++; };
+        pool.Run(2 + l % (MaxTasks - 1), task, &loops[l]);
+    }
+
+    for (uint32 l=0; l < Loops; l++)
+    {
+        const uint32 numTasks = 2 + l % (MaxTasks - 1);
+        for (uint32 i=0; i < MaxTasks; i++)
+        {
+            if (loops[l].runs[i] != (i < numTasks ? 1u : 0u))
+                return false;
+        }
+    }
+    return true;
+}
+
+// ------------------------------ initialization test ------------------------------
+
+bool initialization()
+{
+    // the weights only depend on the seed and where they are, so a layer big enough to
+    // be split between threads starts the same on any number of them
+    for (short init = 0; init < short(WeightInit::Last); init++)
+    {
+        model models[3];
+        const uint32 threadCounts[3] = { 1, 2, 5 };
+        for (uint32 i=0; i < 3; i++)
+        {
+            models[i].SetNumThreads(threadCounts[i]);
+            layer* l = models[i].AddInputLayer(500);
+            l = models[i].AddDenseLayer(600, ActivationFunction::Relu, l, WeightInit(init));
+            models[i].AddDenseLayer(600, ActivationFunction::Relu, l, WeightInit(init));
+        }
+        if (!sameWeights(models[0], models[1], 0) || !sameWeights(models[0], models[2], 0))
+            return false;
+
+        // each scheme fills its range, and the two layers aren't copies of each other
+        const layer& first = *models[0].layers[1];
+        const layer& second = *models[0].layers[2];
+        const double range = (WeightInit(init) == WeightInit::Xavier) ? std::sqrt(6.0 / (500 + 600))
+            : (WeightInit(init) == WeightInit::He) ? std::sqrt(6.0 / 500) : 1;
+        const double low = (WeightInit(init) == WeightInit::Uniform) ? 0 : -range;
+        // float rounds low + width * u onto, or just past, either end
+        const double slack = DoublePrecision ? 0 : Rounding * range;
+        double smallest = range;
+        double largest = low;
+        double sum = 0;
+        for (uint32 n=0; n < first.numNeurons; n++)
+        {
+            for (uint32 j=0; j < first.numInputs; j++)
+            {
+                const double w = first.weights[n][j];
+                if (w < low - slack || w >= range + slack)
+                    return false;
+                smallest = std::min(smallest, w);
+                largest = std::max(largest, w);
+                sum += w;
+            }
+            const double bias = first.biases[n];
+            if ((WeightInit(init) == WeightInit::Uniform) ? (bias < 0 || bias >= 1 + slack) : bias != 0)
+                return false;
+        }
+        const double count = double(first.numNeurons) * first.numInputs;
+        if (smallest > low + 0.01 * range || largest < 0.99 * range || fabs(sum / count - (low + range) / 2) > 0.01 * range)
+            return false;
+        if (first.weights[0][0] == second.weights[0][0] || first.weights[0][0] == first.weights[1][0])
+            return false;
+    }
+
+    // and another seed starts elsewhere
+    model seeded;
+    seeded.SetSeed(DefaultSeed + 1);
+    model unseeded;
+    for (model* m : {&seeded, &unseeded})
+    {
+        layer* l = m->AddInputLayer(4);
+        m->AddDenseLayer(4, ActivationFunction::Sigmoid, l);
+    }
+    return !sameWeights(seeded, unseeded, 0.1);
+}
+
+// ------------------------------ background trainer test ------------------------------
+
+bool backgroundTraining()
+{
+    // every snapshot the reader sees is whole: the weights of the model after exactly the
+    // epochs it says, never part way through a copy. the last one is the finished model.
+    model m;
+    m.SetSeed(8080);
+    initThreadsModel(m, 1);
+    model reference;
+    reference.SetSeed(8080);
+    initThreadsModel(reference, 1);
+
+    backgroundTrainer trainer;
+    trainer.Start(m, [](model& trained) { trained.Train(seedsDataset, seedsOutputs, 1, 0.5); });
+
+    matrix outputs;
+    int lastEpoch = 0;
+    bool ok = true;
+    while (ok && lastEpoch < 30)
+    {
+        model& snapshot = trainer.Latest();
+        ok = snapshot.epoch >= lastEpoch;
+        lastEpoch = snapshot.epoch;
+        while (reference.epoch < snapshot.epoch)
+            reference.Train(seedsDataset, seedsOutputs, 1, 0.5);
+        ok = ok && sameWeights(reference, snapshot, 0) && (snapshot.epoch == 0 || reference.loss == snapshot.loss);
+        snapshot.PredictBatch(seedsDataset, outputs);
+    }
+    trainer.Stop();
+
+    const model& last = trainer.Latest();
+    printf("backgroundTraining: %d epochs, last seen at %d\n", m.epoch, lastEpoch);
+    return ok && lastEpoch > 0 && last.epoch == m.epoch && sameWeights(m, last, 0);
+}
+
+// ------------------------------ predict batch test ------------------------------
+
+bool predictBatch()
+{
+    // batched prediction matches one sample at a time, for sizes either side of the
+    // chunk size and split over several threads
+    model m;
+    m.SetNumThreads(3);
+    layer* l = m.AddInputLayer(2);
+    l = m.AddDenseLayer(9, ActivationFunction::Relu, l);
+    l = m.AddDenseLayer(4, ActivationFunction::Softmax, l);
+
+    for (uint32 count : {1u, 5u, PredictChunkSize + 3, 5 * PredictChunkSize + 1})
+    {
+        matrix inputs(count);
+        for (uint32 i=0; i < count; i++)
+            inputs[i] = { real((i % 17) * 0.1), real((i % 5) * 0.3 - 0.5) };
+
+        matrix outputs;
+        m.PredictBatch(inputs, outputs);
+
+        column expected(4);
+        for (uint32 i=0; i < count; i++)
+        {
+            m.PredictSingleInput(inputs[i], expected);
+            for (uint32 n=0; n < 4; n++)
+            {
+                if (fabs(outputs[i][n] - expected[n]) > Rounding)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+// ------------------------------ evaluation test ------------------------------
+
+bool evaluate()
+{
+    // the batched, threaded scores match scoring the samples one at a time, for sizes
+    // either side of the chunk size
+    model m;
+    m.SetNumThreads(3);
+    layer* l = m.AddInputLayer(3);
+    l = m.AddDenseLayer(8, ActivationFunction::Relu, l);
+    l = m.AddSoftmaxCrossEntropyLayer(5, l);
+
+    const uint32 topK = 2;
+    for (uint32 count : {0u, 7u, PredictChunkSize + 3, 4 * PredictChunkSize + 9})
+    {
+        matrix inputs(count);
+        matrix targets(count, column(5, 0));
+        for (uint32 i=0; i < count; i++)
+        {
+            inputs[i] = { real((i % 13) * 0.1 - 0.6), real((i % 7) * 0.2), real((i % 3) * -0.4) };
+            targets[i][(i * 7) % 5] = 1;
+        }
+
+        uint32 correct = 0, topKCorrect = 0;
+        double loss = 0;
+        std::vector<uint32> confusion(25, 0);
+        column outputs(5);
+        for (uint32 i=0; i < count; i++)
+        {
+            m.PredictSingleInput(inputs[i], outputs);
+            const uint32 actual = (i * 7) % 5;
+            const uint32 predicted = uint32(std::max_element(outputs.begin(), outputs.end()) - outputs.begin());
+            uint32 rank = 0;
+            for (double o : outputs)
+                rank += (o > outputs[actual]) ? 1 : 0;
+
+            correct += (predicted == actual) ? 1 : 0;
+            topKCorrect += (rank < topK) ? 1 : 0;
+            confusion[actual * 5 + predicted]++;
+            loss -= log(outputs[actual]);
+        }
+
+        const evaluation e = m.Evaluate(inputs, targets, topK);
+        if (e.count != count || e.numClasses != 5 || e.correct != correct || e.topKCorrect != topKCorrect ||
+            e.confusion != confusion || fabs(e.loss - (count ? loss / count : 0)) > Rounding)
+            return false;
+    }
+    return true;
+}
+
+// ------------------------------ softmax cross entropy test ------------------------------
+
+void initSoftmaxModel(model& m, bool fused)
+{
+    layer* l = m.AddInputLayer(3);
+    l = m.AddDenseLayer(5, ActivationFunction::Sigmoid, l);
+    if (fused)
+        m.AddSoftmaxCrossEntropyLayer(4, l);
+    else
+        m.AddDenseLayer(4, ActivationFunction::Softmax, l);
+}
+
+bool softmaxCrossEntropy()
+{
+    // the fused p - y gradient matches the full softmax jacobian path when that is given
+    // the true cross entropy derivative, -y/p. both models get the same starting weights.
+    // the jacobian model's backwards pass is done a layer at a time here, as the model
+    // would do it, with that derivative in place of the model's cost function.
+    model jacobian;
+    initSoftmaxModel(jacobian, false);
+    model fused;
+    initSoftmaxModel(fused, true);
+
+    const column targets = { 0.1, 0.6, 0.0, 0.3 };
+    for (uint32 i=0; i < 10; i++)
+    {
+        const column inputs = { real((i % 3) * 0.4), real((i % 4) * -0.2), real(i * 0.05) };
+        jacobian.ForwardsPass(inputs);
+        fused.ForwardsPass(inputs);
+
+        layer& output = *jacobian.layers[2];
+        for (uint32 n=0; n < output.numNeurons; n++)
+            output.gradients[n] = -targets[n] / output.activationValue[n];
+        output.ActivationGradients(
+            constMatrixView(output.activationValue.data(), 1, output.numNeurons, output.numNeurons),
+            matrixView(output.gradients.data(), 1, output.numNeurons, output.numNeurons));
+        jacobian.layers[1]->Gradients(&output, constColumnView(), jacobian.cFunc);
+        for (uint32 l=1; l < 3; l++)
+            jacobian.layers[l]->UpdateWeights(*jacobian.layers[l-1], 0.1);
+        fused.BackwardsPass(targets, 0.1);
+
+        const layer& a = *jacobian.layers.back();
+        const layer& b = *fused.layers.back();
+        for (uint32 n=0; n < a.numNeurons; n++)
+        {
+            if (fabs(a.gradients[n] - b.gradients[n]) > Rounding)
+                return false;
+        }
+    }
+    return sameWeights(jacobian, fused, Rounding);
+}
+
+// ------------------------------ allocations test ------------------------------
+
+bool allocations()
+{
+    // once each path has run once, training and prediction don't touch the heap
+    model m;
+    m.SetNumThreads(3);
+    layer* l = m.AddInputLayer(2);
+    l = m.AddDenseLayer(7, ActivationFunction::Sigmoid, l);
+    l = m.AddSoftmaxCrossEntropyLayer(2, l);
+
+    column outputs(2);
+    matrix predictions;
+    auto steadyState = [&]()
+    {
+        m.Train(seedsDataset, seedsOutputs, 1, 0.1);
+        m.Train(seedsDataset, seedsOutputs, 1, 0.1, 8);
+        for (const column& row : seedsDataset)
+            m.PredictSingleInput(row, outputs);
+        m.PredictBatch(seedsDataset, predictions);
+    };
+
+    steadyState();
+    const uint64 before = allocationCount;
+    steadyState();
+    return allocationCount == before;
+}
+
+// ------------------------------ sparse inputs test ------------------------------
+
+static void initSparseModel(model& m)
+{
+    m.SetSeed(6161);
+    layer* l = m.AddInputLayer(100);
+    l = m.AddDenseLayer(6, ActivationFunction::Sigmoid, l);
+    m.AddSoftmaxCrossEntropyLayer(3, l);
+}
+
+// the per-sample passes on the whole rows, whatever their density
+static void trainDense(model& m, const matrix& inputs, const matrix& targets, double rate)
+{
+    for (uint32 i=0; i < inputs.size(); i++)
+    {
+        m.ForwardsPass(inputs[i]);
+        m.BackwardsPass(targets[i], rate);
+    }
+}
+
+bool sparseInputs()
+{
+    // mostly a few nonzeros a row, with the odd dense row that has to take the dense passes
+    srand(7272);
+    matrix inputs(40, column(100, 0));
+    matrix targets(40, column(3, 0));
+    for (uint32 i=0; i < inputs.size(); i++)
+    {
+        const uint32 count = (i % 10 == 9) ? 100 : 1 + i % 6;
+        for (uint32 k=0; k < count; k++)
+            inputs[i][rand() % 100] = real(rand() % 1000) / 1000 + real(0.1);
+        targets[i][i % 3] = 1;
+    }
+
+    const sparseSource source(inputs);
+    if (source.Rows() != inputs.size() || source.Cols() != 100 || source.Density() <= 0 || source.Density() >= 0.5)
+        return false;
+    column scratch(100);
+    for (uint32 i=0; i < inputs.size(); i++)
+    {
+        sparseRow row;
+        const constColumnView expanded = source.Row(i, scratch);
+        if (!source.SparseRow(i, row) || !std::equal(expanded.begin(), expanded.end(), inputs[i].begin()))
+            return false;
+        for (uint32 k=0; k < row.count; k++)
+        {
+            if (row.values[k] == 0 || inputs[i][row.indices[k]] != row.values[k] || (k && row.indices[k-1] >= row.indices[k]))
+                return false;
+        }
+    }
+
+    // training on a sparse source, or on the dense rows, matches the dense passes up to
+    // the order the dot products are summed in
+    model dense;
+    model fromSource;
+    model fromRows;
+    for (model* m : {&dense, &fromSource, &fromRows})
+        initSparseModel(*m);
+    for (uint32 e=0; e < 3; e++)
+    {
+        trainDense(dense, inputs, targets, 0.2);
+        fromSource.Train(source, matrixSource(targets), 1, 0.2);
+        fromRows.Train(inputs, targets, 1, 0.2);
+    }
+    if (!sameWeights(dense, fromSource, Rounding) || !sameWeights(dense, fromRows, Rounding))
+        return false;
+
+    column outputs(3);
+    for (uint32 i=0; i < inputs.size(); i++)
+    {
+        sparseRow row;
+        source.SparseRow(i, row);
+        dense.ForwardsPass(inputs[i]);
+        const constColumnView expected = dense.layers.back()->activationValue;
+        fromRows.PredictSingleInput(inputs[i], outputs);
+        for (uint32 n=0; n < 3; n++)
+        {
+            if (fabs(outputs[n] - expected[n]) > Rounding)
+                return false;
+        }
+        fromSource.PredictSingleInput(row, outputs);
+        for (uint32 n=0; n < 3; n++)
+        {
+            if (fabs(outputs[n] - expected[n]) > Rounding)
+                return false;
+        }
+    }
+
+    // an optimizer that moves every weight takes the dense update after a sparse pass
+    optimizer adam;
+    adam.kind = OptimizerKind::Adam;
+    model denseAdam;
+    model sparseAdam;
+    for (model* m : {&denseAdam, &sparseAdam})
+    {
+        initSparseModel(*m);
+        m->SetOptimizer(adam);
+    }
+    trainDense(denseAdam, inputs, targets, 0.01);
+    for (uint32 i=0; i < inputs.size(); i++)
+    {
+        sparseRow row;
+        source.SparseRow(i, row);
+        sparseAdam.ForwardsPass(row);
+        sparseAdam.BackwardsPass(targets[i], 0.01);
+    }
+    if (!sameWeights(denseAdam, sparseAdam, Rounding))
+        return false;
+
+    // neither path touches the heap once it has run
+    auto steadyState = [&]()
+    {
+        fromSource.Train(source, matrixSource(targets), 1, 0.2);
+        fromRows.Train(inputs, targets, 1, 0.2);
+        for (const column& row : inputs)
+            fromRows.PredictSingleInput(row, outputs);
+    };
+    steadyState();
+    const uint64 before = allocationCount;
+    steadyState();
+    return allocationCount == before;
+}
+
+// ------------------------------ tensor files test ------------------------------
+
+bool writeTensor(const char* filename, TensorType type, const matrix& values)
+{
+    std::vector<double> packed;
+    for (const column& row : values)
+        packed.insert(packed.end(), row.begin(), row.end());
+    return WriteTensorFile(filename, type, uint32(values.size()), uint32(values[0].size()), packed.data());
+}
+
+bool tensorFiles()
+{
+    // the seeds data written out and mapped back in, both stored as real, which is used
+    // in place, and as the other float type, which is converted a row at a time. training
+    // from either gives the same weights as training from the matrices.
+    const char* inputsName = "test_tensor_inputs.bin";
+    const char* targetsName = "test_tensor_targets.bin";
+    const TensorType inPlace = DoublePrecision ? TensorType::Float64 : TensorType::Float32;
+    const TensorType converted = DoublePrecision ? TensorType::Float32 : TensorType::Float64;
+    if (!writeTensor(inputsName, inPlace, seedsDataset) ||
+        !writeTensor(targetsName, converted, seedsOutputs))
+        return false;
+
+    bool ok = false;
+    {
+        tensorFile inputs;
+        tensorFile targets;
+        ok = inputs.Open(inputsName) && targets.Open(targetsName) && !targets.Open("missing.bin") && targets.Open(targetsName);
+
+        const constMatrixView values = inputs.Values();
+        ok = ok && values.rows == seedsDataset.size() && values.cols == 2 && targets.Values().empty();
+        ok = ok && (uintptr_t(values.data()) % CacheLineSize) == 0 && (values.stride * sizeof(real)) % CacheLineSize == 0;
+        for (uint32 r=0; ok && r < values.rows; r++)
+            ok = values[r][0] == seedsDataset[r][0] && values[r][1] == seedsDataset[r][1];
+
+        model fromMatrix;
+        initThreadsModel(fromMatrix, 1);
+        model fromFile;
+        initThreadsModel(fromFile, 1);
+        for (uint32 batchSize : {1u, 8u})
+        {
+            fromMatrix.Train(seedsDataset, seedsOutputs, 2, 0.5, batchSize);
+            fromFile.Train(inputs, targets, 2, 0.5, batchSize);
+        }
+        ok = ok && sameWeights(fromMatrix, fromFile, 0);
+    }
+
+    // a header whose rows would start inside it, or off a cache line, or run past the end of
+    // the file, is rejected
+    const char* corruptName = "test_tensor_corrupt.bin";
+    std::vector<char> bytes;
+    FILE* fp = fopen(inputsName, "rb");
+    for (int c; fp && (c = fgetc(fp)) != EOF; )
+        bytes.push_back(char(c));
+    if (fp)
+        fclose(fp);
+    auto opens = [&](const tensorHeader& h, size_t size)
+    {
+        std::vector<char> corrupt = bytes;
+        corrupt.resize(size);
+        memcpy(corrupt.data(), &h, sizeof(h));
+        FILE* out = fopen(corruptName, "wb");
+        const bool written = out && fwrite(corrupt.data(), 1, corrupt.size(), out) == corrupt.size();
+        if (out)
+            fclose(out);
+        tensorFile file;
+        return written && file.Open(corruptName);
+    };
+    ok = ok && bytes.size() > sizeof(tensorHeader);
+    if (ok)
+    {
+        tensorHeader h;
+        memcpy(&h, bytes.data(), sizeof(h));
+        for (uint32 dataOffset : { 0u, 8u, 64u })
+        {
+            tensorHeader moved = h;
+            moved.dataOffset = dataOffset;
+            ok = ok && opens(moved, bytes.size()) == (dataOffset == sizeof(tensorHeader));
+        }
+
+        // one row too many, rows that don't move on, and a size in bytes that wraps to 0
+        // in a file of one cache line of rows
+        tensorHeader longer = h;
+        longer.rows++;
+        tensorHeader flat = h;
+        flat.cols = flat.stride = 0;
+        tensorHeader huge = h;
+        huge.rows = huge.stride = 1u << 31;
+        ok = ok && !opens(longer, bytes.size()) && !opens(flat, bytes.size()) && !opens(huge, 2 * CacheLineSize);
+    }
+
+    remove(corruptName);
+    remove(inputsName);
+    remove(targetsName);
+    return ok;
+}
+
+// ------------------------------ image sets test ------------------------------
+
+bool writeImages(const char* filename, uint32 count, uint32 seed)
+{
+    FILE* fp = fopen(filename, "wb");
+    if (!fp)
+        return false;
+    std::vector<uint8> record(ImageRecordSize);
+    for (uint32 i=0; i < count; i++)
+    {
+        record[0] = uint8((seed + i) % ImageCategories);
+        for (uint32 p=1; p < ImageRecordSize; p++)
+            record[p] = uint8(p * 7 + i * 13 + seed);
+        fwrite(record.data(), 1, record.size(), fp);
+    }
+    return fclose(fp) == 0;
+}
+
+bool imageSets()
+{
+    // images from several files end up in one set, and come out as interleaved rgb
+    // in 0-1 with their categories one-hot encoded
+    const char* firstName = "test_images_1.bin";
+    const char* secondName = "test_images_2.bin";
+    if (!writeImages(firstName, 3, 5) || !writeImages(secondName, 2, 40))
+        return false;
+
+    imageSet images;
+    bool ok = images.Load({ firstName, secondName }) && images.Rows() == 5 && images.Cols() == 3 * ImagePixels;
+    ok = ok && !imageSet().Load({ firstName, "missing.bin" });
+
+    column row(images.Cols());
+    column categories(ImageCategories);
+    for (uint32 r=0; ok && r < images.Rows(); r++)
+    {
+        const uint32 i = (r < 3) ? r : r - 3;
+        const uint32 seed = (r < 3) ? 5 : 40;
+
+        const constColumnView values = images.Row(r, row);
+        for (uint32 p=0; ok && p < ImagePixels; p++)
+        {
+            for (uint32 c=0; ok && c < 3; c++)
+                ok = values[p * 3 + c] == uint8((1 + c * ImagePixels + p) * 7 + i * 13 + seed) * real(1.0 / 255);
+        }
+
+        const constColumnView oneHot = images.Categories().Row(r, categories);
+        for (uint32 c=0; ok && c < ImageCategories; c++)
+            ok = oneHot[c] == ((c == (seed + i) % ImageCategories) ? 1 : 0);
+    }
+
+    remove(firstName);
+    remove(secondName);
+    return ok;
+}
+
+// ------------------------------ save and load test ------------------------------
+
+bool samePredictions(model& a, model& b)
+{
+    matrix pa, pb;
+    a.PredictBatch(seedsDataset, pa);
+    b.PredictBatch(seedsDataset, pb);
+    return pa == pb;
+}
+
+bool saveLoad()
+{
+    // a saved model loads back with the same layers and weights, mapped or copied. training
+    // the mapped one afterwards leaves the file as it was.
+    const char* filename = "test_model.bin";
+    model trained;
+    initThreadsModel(trained, 1);
+    trained.Train(seedsDataset, seedsOutputs, 5, 0.5, 8);
+    if (!trained.Save(filename))
+        return false;
+
+    model mapped;
+    model copied;
+    model untouched;
+    bool ok = mapped.Load(filename) && copied.Load(filename, false) && untouched.Load(filename, false) && !mapped.Load(filename);
+    ok = ok && mapped.layers.size() == trained.layers.size() && mapped.cFunc == trained.cFunc;
+    for (uint32 i=0; ok && i < trained.layers.size(); i++)
+    {
+        const layer& a = *trained.layers[i];
+        const layer& b = *mapped.layers[i];
+        ok = a.Kind() == b.Kind() && a.numNeurons == b.numNeurons && a.aFunc == b.aFunc && a.forClassification == b.forClassification;
+    }
+    ok = ok && sameWeights(trained, mapped, 0) && sameWeights(trained, copied, 0);
+    ok = ok && samePredictions(trained, mapped) && samePredictions(trained, copied);
+
+    // carries on training the same way from either
+    trained.Train(seedsDataset, seedsOutputs, 2, 0.5, 8);
+    mapped.Train(seedsDataset, seedsOutputs, 2, 0.5, 8);
+    copied.Train(seedsDataset, seedsOutputs, 2, 0.5, 8);
+    ok = ok && sameWeights(trained, mapped, 0) && sameWeights(trained, copied, 0);
+
+    model reloaded;
+    ok = ok && reloaded.Load(filename) && sameWeights(reloaded, untouched, 0) && !sameWeights(reloaded, mapped, 0);
+
+    // a truncated file is refused, as is one whose records point past its end, wrap around,
+    // or overlap the header or each other
+    std::vector<char> saved;
+    FILE* fp = fopen(filename, "rb");
+    ok = ok && fp;
+    if (fp)
+    {
+        char buffer[256];
+        for (size_t read; (read = fread(buffer, 1, sizeof(buffer), fp)) > 0; )
+            saved.insert(saved.end(), buffer, buffer + read);
+        fclose(fp);
+    }
+    auto refused = [&](const std::vector<char>& bytes)
+    {
+        FILE* out = fopen(filename, "wb");
+        if (!out)
+            return false;
+        const bool written = fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+        fclose(out);
+        model corrupt;
+        return written && !corrupt.Load(filename) && !corrupt.Load(filename, false) && corrupt.layers.empty();
+    };
+    // the records follow the 64 byte header, one cache line each, with the offset of the
+    // layer's parameters at byte 24
+    auto withOffset = [&](uint32 layer, std::uint64_t offset)
+    {
+        std::vector<char> bytes = saved;
+        memcpy(bytes.data() + 64 * (1 + layer) + 24, &offset, sizeof(offset));
+        return bytes;
+    };
+    std::uint64_t hiddenOffset = 0;
+    ok = ok && saved.size() > 64 * 5;
+    if (ok)
+    {
+        memcpy(&hiddenOffset, saved.data() + 64 * 2 + 24, sizeof(hiddenOffset));
+        ok = !refused(saved) && refused(withOffset(1, saved.size() + 64)) && refused(withOffset(1, ~std::uint64_t(63))) &&
+            refused(withOffset(1, 0)) && refused(withOffset(1, 64 * 3)) && refused(withOffset(2, hiddenOffset)) &&
+            refused(std::vector<char>(saved.begin(), saved.begin() + 64 * 3)) &&
+            refused(std::vector<char>(saved.begin(), saved.end() - 64));
+    }
+
+    remove(filename);
+    return ok;
+}
+
+// ------------------------------ quantized test ------------------------------
+
+bool quantized()
+{
+    // an int8 copy of a model predicts nearly the same probabilities and classes as the
+    // full precision one, from a fraction of the memory
+    model m;
+    m.SetNumThreads(3);
+    layer* l = m.AddInputLayer(64);
+    l = m.AddDenseLayer(48, ActivationFunction::Relu, l);
+    l = m.AddSoftmaxCrossEntropyLayer(10, l);
+
+    srand(30303);
+    for (uint32 i=1; i < m.layers.size(); i++)
+    {
+        layer& current = *m.layers[i];
+        for (uint32 n=0; n < current.numNeurons; n++)
+        {
+            current.biases[n] = (rand() % 2000) * 0.0001 - 0.1;
+            for (uint32 j=0; j < current.numInputs; j++)
+                current.weights[n][j] = (rand() % 2000) * 0.0003 - 0.3;
+        }
+    }
+
+    // calibrate on one set of samples and test on another
+    auto randomInputs = [](uint32 count)
+    {
+        matrix inputs(count, column(64));
+        for (column& row : inputs)
+            for (real& v : row) v = (rand() % 1000) * 0.001;
+        return inputs;
+    };
+    const matrix calibration = randomInputs(200);
+    const matrix inputs = randomInputs(5 * PredictChunkSize + 7);
+
+    quantizedModel q;
+    q.SetNumThreads(3);
+    model empty;
+    empty.AddInputLayer(64);
+    if (q.Build(empty, matrixSource(calibration)) || !q.Build(m, matrixSource(calibration)))
+        return false;
+
+    matrix expected;
+    matrix outputs;
+    m.PredictBatch(inputs, expected);
+    q.PredictBatch(inputs, outputs);
+
+    uint32 agree = 0;
+    double largest = 0;
+    column single(10);
+    for (uint32 i=0; i < inputs.size(); i++)
+    {
+        for (uint32 n=0; n < 10; n++)
+            largest = std::max(largest, fabs(outputs[i][n] - expected[i][n]));
+        agree += (argmax(outputs[i]) == argmax(expected[i])) ? 1 : 0;
+
+        // one at a time takes the same integer path as the batches
+        q.PredictSingleInput(inputs[i], single);
+        if (single != outputs[i])
+            return false;
+    }
+
+    size_t realBytes = 0;
+    for (uint32 i=1; i < m.layers.size(); i++)
+        realBytes += layer::ParameterSize(m.layers[i]->numNeurons, m.layers[i]->numInputs) * sizeof(real);
+
+    // over 5x smaller than double, and so over 2.5x smaller than float
+    printf("quantized: %u of %u classes agree, largest difference %.4f, %.1fx smaller\n",
+        agree, uint32(inputs.size()), largest, double(realBytes) / q.WeightBytes());
+    return largest < 0.05 && agree >= inputs.size() * 95 / 100 && q.WeightBytes() * 5 * sizeof(real) < realBytes * sizeof(double);
+}
+
+// ------------------------------ static model test ------------------------------
+
+// trains a static model and a model with its weights side by side, and compares them
+template <typename S>
+bool staticMatchesModel(S& s, model& m, double tolerance)
+{
+    if (!s.CopyFrom(m))
+        return false;
+
+    for (uint32 e=0; e < 20; e++)
+    {
+        s.Train(seedsDataset, seedsOutputs, 1, 0.1);
+        m.Train(seedsDataset, seedsOutputs, 1, 0.1);
+        if (fabs(s.loss - m.loss) > tolerance * std::max(1.0, fabs(m.loss)))
+            return false;
+    }
+
+    matrix fromStatic, fromModel;
+    s.PredictBatch(seedsDataset, fromStatic);
+    m.PredictBatch(seedsDataset, fromModel);
+    for (uint32 i=0; i < seedsDataset.size(); i++)
+    {
+        for (uint32 n=0; n < S::numOutputs; n++)
+        {
+            if (fabs(fromStatic[i][n] - fromModel[i][n]) > tolerance)
+                return false;
+        }
+    }
+
+    // and back into a model, which then holds the same weights
+    model copy;
+    return s.CopyTo(copy) && sameWeights(copy, m, tolerance) && copy.epoch == m.epoch;
+}
+
+bool staticModels()
+{
+    using A = ActivationFunction;
+
+    // trains as a model of the same layers does, up to the order the sums are added in
+    {
+        staticModel<2, staticLayer<8, A::Sigmoid>, staticLayer<2, A::Sigmoid>> s;
+        model m;
+        layer* l = m.AddInputLayer(2);
+        l = m.AddDenseLayer(8, A::Sigmoid, l);
+        m.AddDenseLayer(2, A::Sigmoid, l);
+        if (!staticMatchesModel(s, m, 100 * Rounding))
+            return false;
+    }
+    {
+        staticModel<2, staticLayer<5, A::Relu>, staticLayer<4, A::Sigmoid>, staticLayer<2, A::Softmax>> s;
+        model m;
+        layer* l = m.AddInputLayer(2);
+        l = m.AddDenseLayer(5, A::Relu, l);
+        l = m.AddDenseLayer(4, A::Sigmoid, l);
+        m.AddDenseLayer(2, A::Softmax, l);
+        if (!staticMatchesModel(s, m, 100 * Rounding))
+            return false;
+    }
+
+    // starts from the weights a model of the same layers starts with
+    using small = staticModel<2, staticLayer<3, A::Relu>, staticLayer<2, A::Sigmoid>>;
+    small fresh;
+    model m;
+    small::AddLayers(m);
+    model copy;
+    if (!fresh.CopyTo(copy) || !sameWeights(copy, m, 0))
+        return false;
+
+    // the weights only go between models of the same layers
+    model other;
+    layer* l = other.AddInputLayer(2);
+    l = other.AddDenseLayer(3, A::Sigmoid, l);
+    other.AddDenseLayer(2, A::Sigmoid, l);
+    model wider;
+    l = wider.AddInputLayer(2);
+    l = wider.AddDenseLayer(4, A::Relu, l);
+    wider.AddDenseLayer(2, A::Sigmoid, l);
+    return !fresh.CopyFrom(other) && !fresh.CopyTo(other) && !fresh.CopyFrom(wider);
+}
+
+// ------------------------------ tracing test ------------------------------
+
+bool tracing()
+{
+    // nothing is recorded until tracing is on, then every pass through every layer is
+    const char* filename = "test_trace.json";
+    model m;
+    initThreadsModel(m, 3);
+    m.Train(seedsDataset, seedsOutputs, 1, 0.5, 8);
+
+    setTracing(true);
+    m.Train(seedsDataset, seedsOutputs, 1, 0.5, 8);
+    m.Train(seedsDataset, seedsOutputs, 1, 0.5);
+    setTracing(false);
+    m.Train(seedsDataset, seedsOutputs, 1, 0.5);
+
+    const bool written = writeTrace(filename);
+#if !defined(AGAIN_TRACE)
+    return !written;
+#else
+    std::string json;
+    if (FILE* fp = fopen(filename, "r"))
+    {
+        char buffer[4096];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+            json.append(buffer, n);
+        fclose(fp);
+    }
+    remove(filename);
+
+    auto count = [&](const char* text)
+    {
+        uint32 found = 0;
+        for (size_t p = json.find(text); p != std::string::npos; p = json.find(text, p + 1))
+            found++;
+        return found;
+    };
+
+    // one epoch in mini-batches, each split into shards that read their samples and run
+    // them through the layers, then one epoch a sample at a time
+    const uint32 samples = uint32(seedsDataset.size());
+    const uint32 batches = (samples + 7) / 8;
+    const uint32 shards = count("\"read samples\"");
+    return written
+        && json.size() > 4 && json.find("{\"displayTimeUnit") == 0
+        && json.compare(json.size() - 4, 4, "\n]}\n") == 0
+        && count("\"epoch\"") == 2
+        && count("\"TrainBatch\"") == batches
+        && shards >= batches && shards <= batches * 3
+        && count("\"forwards 1\"") == shards + samples
+        && count("\"forwards 2\"") == shards + samples
+        && count("\"BackwardsPass\"") == samples
+        && count("\"update 2\"") == batches + samples;
+#endif
+}
+
+// ------------------------------ gradient check ------------------------------
+
+// the cost the model is minimising for one sample
+double sampleCost(model& m, const column& inputs, const column& targets)
+{
+    column outputs(targets.size());
+    m.PredictSingleInput(inputs, outputs);
+
+    double cost = 0;
+    withCost(m.cFunc, [&](auto c)
+    {
+        for (uint32 i=0; i < outputs.size(); i++)
+            cost += decltype(c)::Apply(outputs[i], targets[i]);
+    });
+    return cost;
+}
+
+bool gradientCheck()
+{
+    // the batched backward pass agrees with central differences of the cost. this needs
+    // double precision, so it only runs in double.
+
+    model m;
+    layer* l = m.AddInputLayer(2);
+    l = m.AddDenseLayer(3, ActivationFunction::Sigmoid, l);
+    l = m.AddDenseLayer(2, ActivationFunction::Sigmoid, l);
+
+    const column& inputs = seedsDataset[3];
+    const column& targets = seedsOutputs[3];
+
+    batchWorkspace ws;
+    ws.Resize(m.layers, 1);
+    std::copy(inputs.begin(), inputs.end(), ws.activations[0][0].begin());
+    std::copy(targets.begin(), targets.end(), ws.targets[0].begin());
+    m.BatchGradients(ws, 1);
+
+    const double h = 1e-6;
+    auto matches = [](double analytic, double numeric)
+    {
+        return fabs(analytic - numeric) <= 1e-6 * std::max(1.0, fabs(numeric));
+    };
+
+    for (uint32 i=1; i < m.layers.size(); i++)
+    {
+        layer& current = *m.layers[i];
+        for (uint32 n=0; n < current.numNeurons; n++)
+        {
+            for (uint32 j=0; j < current.numInputs; j++)
+            {
+                const double w = current.weights[n][j];
+                current.weights[n][j] = w + h;
+                const double up = sampleCost(m, inputs, targets);
+                current.weights[n][j] = w - h;
+                const double down = sampleCost(m, inputs, targets);
+                current.weights[n][j] = w;
+
+                if (!matches(ws.weightGradients[i][n][j], (up - down) / (2 * h)))
+                    return false;
+            }
+
+            const double b = current.biases[n];
+            current.biases[n] = b + h;
+            const double up = sampleCost(m, inputs, targets);
+            current.biases[n] = b - h;
+            const double down = sampleCost(m, inputs, targets);
+            current.biases[n] = b;
+
+            if (!matches(ws.biasGradients[i][n], (up - down) / (2 * h)))
+                return false;
+        }
+    }
+    return true;
+}
+
+// ------------------------------ convolution test ------------------------------
+
+// one output of a convolution layer straight from the definition
+static double referenceConvolution(const convLayer& conv, const real* inputs, uint32 oy, uint32 ox, uint32 filter)
+{
+    const imageShape& in = conv.input;
+    double z = conv.biases[filter];
+    for (uint32 ky=0; ky < conv.window.size; ky++)
+    {
+        for (uint32 kx=0; kx < conv.window.size; kx++)
+        {
+            const int y = int(oy * conv.window.stride + ky) - int(conv.window.padding);
+            const int x = int(ox * conv.window.stride + kx) - int(conv.window.padding);
+            if (y < 0 || x < 0 || y >= int(in.height) || x >= int(in.width))
+                continue;
+            for (uint32 c=0; c < in.channels; c++)
+                z += conv.weights[filter][(ky * conv.window.size + kx) * in.channels + c] * inputs[(y * in.width + x) * in.channels + c];
+        }
+    }
+    return z;
+}
+
+// one output of a pooling layer straight from the definition
+static double referencePool(const poolLayer& pool, const real* inputs, uint32 oy, uint32 ox, uint32 c)
+{
+    const imageShape& in = pool.input;
+    double result = (pool.kind == LayerKind::MaxPool) ? -1e300 : 0;
+    uint32 count = 0;
+    for (uint32 ky=0; ky < pool.window.size; ky++)
+    {
+        for (uint32 kx=0; kx < pool.window.size; kx++)
+        {
+            const int y = int(oy * pool.window.stride + ky) - int(pool.window.padding);
+            const int x = int(ox * pool.window.stride + kx) - int(pool.window.padding);
+            if (y < 0 || x < 0 || y >= int(in.height) || x >= int(in.width))
+                continue;
+            const double v = inputs[(y * in.width + x) * in.channels + c];
+            result = (pool.kind == LayerKind::MaxPool) ? std::max(result, v) : result + v;
+            count++;
+        }
+    }
+    return (pool.kind == LayerKind::MaxPool) ? result : result / count;
+}
+
+bool convolution()
+{
+    // convolution and pooling layers, padded and strided, agree with the definitions
+    // forwards and with central differences of the cost backwards. they save and load,
+    // and train on mini-batches without touching the heap once they have run. the
+    // gradient checks need double precision, so it only runs in double.
+
+    imageShape image;
+    image.width = 7;
+    image.height = 6;
+    image.channels = 3;
+    imageWindow strided;
+    strided.size = 3;
+    strided.stride = 2;
+    strided.padding = 1;
+    imageWindow same;
+    same.size = 3;
+    same.padding = 1;
+    imageWindow pool;
+    pool.size = 2;
+    imageWindow paddedPool;
+    paddedPool.size = 2;
+    paddedPool.padding = 1;
+
+    srand(4242);
+    model m;
+    m.SetNumThreads(2);
+    layer* l = m.AddInputLayer(image);
+    l = m.AddConvLayer(4, strided, ActivationFunction::Sigmoid, l);         // 4 x 3 x 4
+    l = m.AddPoolLayer(LayerKind::MaxPool, pool, l);                        // 3 x 2 x 4
+    l = m.AddConvLayer(3, same, ActivationFunction::Sigmoid, l);            // 3 x 2 x 3
+    l = m.AddPoolLayer(LayerKind::AveragePool, paddedPool, l);              // 4 x 3 x 3
+    l = m.AddDenseLayer(2, ActivationFunction::Sigmoid, l);
+
+    imageWindow tooBig;
+    tooBig.size = 9;
+    bool ok = l && m.layers[4]->shape.Size() == 36 && m.layers[1]->weights.cols == 27
+        && !m.AddConvLayer(2, tooBig, ActivationFunction::Relu, m.layers[1])
+        && !m.AddPoolLayer(LayerKind::Dense, pool, m.layers[1]);
+
+    const uint32 count = 12;
+    matrix inputs(count, column(image.Size()));
+    matrix targets(count, column(2));
+    for (uint32 i=0; i < count; i++)
+    {
+        for (real& v : inputs[i]) v = (rand() % 1000) * 0.001;
+        targets[i][i % 2] = 1;
+    }
+
+    // forwards, both layers of each kind
+    batchWorkspace ws;
+    ws.Resize(m.layers, count);
+    for (uint32 b=0; b < count; b++)
+        std::copy(inputs[b].begin(), inputs[b].end(), ws.activations[0][b].begin());
+    m.ForwardsBatch(ws, count);
+    for (uint32 i=1; ok && i < 5; i++)
+    {
+        const layer& current = *m.layers[i];
+        const imageShape& out = current.shape;
+        for (uint32 b=0; b < count; b++)
+        {
+            const real* in = ws.activations[i-1][b].data();
+            for (uint32 p=0; p < out.width * out.height; p++)
+            {
+                for (uint32 c=0; c < out.channels; c++)
+                {
+                    const double expected = (current.Kind() == LayerKind::Convolution)
+                        ? current.af(real(referenceConvolution(static_cast<const convLayer&>(current), in, p / out.width, p % out.width, c)))
+                        : referencePool(static_cast<const poolLayer&>(current), in, p / out.width, p % out.width, c);
+                    ok = ok && fabs(ws.activations[i][b][p * out.channels + c] - expected) < Rounding;
+                }
+            }
+        }
+    }
+
+    // backwards, for one sample through every layer
+    const column& sampleInputs = inputs[5];
+    const column& sampleTargets = targets[5];
+    std::copy(sampleInputs.begin(), sampleInputs.end(), ws.activations[0][0].begin());
+    std::copy(sampleTargets.begin(), sampleTargets.end(), ws.targets[0].begin());
+    m.BatchGradients(ws, 1);
+
+    const double h = 1e-6;
+    auto matches = [](double analytic, double numeric)
+    {
+        return fabs(analytic - numeric) <= 1e-6 * std::max(1.0, fabs(numeric));
+    };
+    auto numeric = [&](real& parameter)
+    {
+        const double w = parameter;
+        parameter = w + h;
+        const double up = sampleCost(m, sampleInputs, sampleTargets);
+        parameter = w - h;
+        const double down = sampleCost(m, sampleInputs, sampleTargets);
+        parameter = w;
+        return (up - down) / (2 * h);
+    };
+    for (uint32 i=1; ok && i < m.layers.size(); i++)
+    {
+        layer& current = *m.layers[i];
+        for (uint32 n=0; ok && n < current.weights.rows; n++)
+        {
+            for (uint32 j=0; ok && j < current.weights.cols; j++)
+                ok = matches(ws.weightGradients[i][n][j], numeric(current.weights[n][j]));
+            ok = ok && matches(ws.biasGradients[i][n], numeric(current.biases[n]));
+        }
+    }
+
+    // a batch's gradients are the sum of its samples'
+    std::vector<column> sums(m.layers.size());
+    for (uint32 b=0; b < 3; b++)
+    {
+        std::copy(inputs[b].begin(), inputs[b].end(), ws.activations[0][0].begin());
+        std::copy(targets[b].begin(), targets[b].end(), ws.targets[0].begin());
+        m.BatchGradients(ws, 1);
+        for (uint32 i=1; i < m.layers.size(); i++)
+        {
+            sums[i].resize(ws.weightGradients[i].rows * ws.weightGradients[i].cols);
+            for (uint32 n=0; n < ws.weightGradients[i].rows; n++)
+                for (uint32 j=0; j < ws.weightGradients[i].cols; j++)
+                    sums[i][n * ws.weightGradients[i].cols + j] += ws.weightGradients[i][n][j];
+        }
+    }
+    for (uint32 b=0; b < 3; b++)
+    {
+        std::copy(inputs[b].begin(), inputs[b].end(), ws.activations[0][b].begin());
+        std::copy(targets[b].begin(), targets[b].end(), ws.targets[b].begin());
+    }
+    m.BatchGradients(ws, 3);
+    for (uint32 i=1; i < m.layers.size(); i++)
+        for (uint32 n=0; n < ws.weightGradients[i].rows; n++)
+            for (uint32 j=0; j < ws.weightGradients[i].cols; j++)
+                ok = ok && fabs(ws.weightGradients[i][n][j] - sums[i][n * ws.weightGradients[i].cols + j]) < Rounding;
+
+    // a batch of one sample at a time is the same as a mini-batch of one
+    model single;
+    model batched;
+    if (!ok || !single.CopyFrom(m) || !batched.CopyFrom(m))
+        return false;
+    single.Train(inputs, targets, 2, 0.5);
+    for (uint32 i=0; i < 2 * count; i++)
+        batched.Train(matrix(1, inputs[i % count]), matrix(1, targets[i % count]), 1, 0.5, 2);
+    ok = ok && sameWeights(single, batched, 0);
+
+    // saved and loaded, the layers come back the same and predict the same
+    const char* filename = "test_conv_model.bin";
+    model loaded;
+    ok = ok && m.Save(filename) && loaded.Load(filename, false);
+    remove(filename);
+    if (!ok || loaded.layers.size() != m.layers.size())
+        return false;
+    ok = sameWeights(m, loaded, 0);
+    for (uint32 i=0; ok && i < m.layers.size(); i++)
+    {
+        const layer& a = *m.layers[i];
+        const layer& b = *loaded.layers[i];
+        ok = a.Kind() == b.Kind() && a.shape == b.shape && a.window == b.window && a.aFunc == b.aFunc;
+    }
+    matrix expected;
+    matrix predicted;
+    m.PredictBatch(inputs, expected);
+    loaded.PredictBatch(inputs, predicted);
+    column singleOutputs(2);
+    m.PredictSingleInput(inputs[3], singleOutputs);
+    ok = ok && predicted == expected && singleOutputs == expected[3];
+
+    // once it has run, training and prediction don't allocate
+    auto steadyState = [&]()
+    {
+        m.Train(inputs, targets, 1, 0.1, 4);
+        m.PredictBatch(inputs, predicted);
+    };
+    steadyState();
+    const uint64 before = allocationCount;
+    steadyState();
+    return ok && allocationCount == before;
+}
+
+// ------------------------------ optimizers test ------------------------------
+
+// the gradients of every bias then every weight of layer l for one sample, found from the
+// model's weights as they are
+static column sampleGradients(model& m, uint32 l, const column& inputs, const column& targets)
+{
+    m.ForwardsPass(inputs);
+    const uint32 last = uint32(m.layers.size() - 1);
+    m.layers[last]->Gradients(nullptr, targets, m.cFunc);
+    for (uint32 i=last-1; i > 0; i--)
+        m.layers[i]->Gradients(m.layers[i+1], constColumnView(), m.cFunc);
+
+    const layer& current = *m.layers[l];
+    const layer& previous = *m.layers[l-1];
+    column g;
+    for (uint32 n=0; n < current.numNeurons; n++)
+        g.push_back(current.gradients[n]);
+    for (uint32 n=0; n < current.numNeurons; n++)
+        for (uint32 i=0; i < current.numInputs; i++)
+            g.push_back(current.gradients[n] * previous.activationValue[i]);
+    return g;
+}
+
+// the textbook form of each optimizer, one value at a time
+static void referenceStep(const optimizer& o, double rate, uint64 t, bool decays, real& w, real& m, real& v, double g)
+{
+    const double l2 = (decays && o.kind != OptimizerKind::AdamW) ? o.weightDecay : 0;
+    g += l2 * w;
+    switch (o.kind)
+    {
+        case OptimizerKind::Momentum:
+        case OptimizerKind::Nesterov:
+            m = o.momentum * m + g;
+            w -= rate * ((o.kind == OptimizerKind::Nesterov) ? g + o.momentum * m : m);
+            break;
+        case OptimizerKind::Adam:
+        case OptimizerKind::AdamW:
+        {
+            if (decays && o.kind == OptimizerKind::AdamW)
+                w -= rate * o.weightDecay * w;
+            m = o.beta1 * m + (1 - o.beta1) * g;
+            v = o.beta2 * v + (1 - o.beta2) * g * g;
+            const double mHat = m / (1 - std::pow(o.beta1, double(t)));
+            const double vHat = v / (1 - std::pow(o.beta2, double(t)));
+            w -= rate * mHat / (std::sqrt(vHat) + o.epsilon);
+            break;
+        }
+        default:
+            w -= rate * g;
+            break;
+    }
+}
+
+bool optimizers()
+{
+    // every optimizer, per sample and over mini-batches on two threads, matches the
+    // textbook update made from the gradients of a copy of the model
+    const double rate = 0.05;
+    for (short kind = 0; kind < short(OptimizerKind::Last); kind++)
+    {
+        for (uint32 batchSize : {1u, 4u})
+        {
+            optimizer o;
+            o.kind = OptimizerKind(kind);
+            o.weightDecay = 0.01;
+
+            model trained;
+            model copy;
+            for (model* m : {&trained, &copy})
+            {
+                m->SetSeed(5151);
+                m->SetNumThreads(2);
+                layer* l = m->AddInputLayer(2);
+                l = m->AddDenseLayer(3, ActivationFunction::Sigmoid, l);
+                m->AddDenseLayer(2, ActivationFunction::Sigmoid, l);
+            }
+            trained.SetOptimizer(o);
+
+            const uint32 count = 8;
+            const matrix inputs(seedsDataset.begin(), seedsDataset.begin() + count);
+            const matrix targets(seedsOutputs.begin(), seedsOutputs.begin() + count);
+            trained.Train(inputs, targets, 2, rate, batchSize);
+
+            // the copy's parameters and moments, bias then weights per layer
+            const uint32 numLayers = uint32(copy.layers.size());
+            std::vector<column> moment1(numLayers), moment2(numLayers);
+            for (uint32 l=1; l < numLayers; l++)
+            {
+                const layer& current = *copy.layers[l];
+                moment1[l].assign(current.numNeurons * (current.numInputs + 1), 0);
+                moment2[l] = moment1[l];
+            }
+
+            uint64 t = 0;
+            for (uint32 e=0; e < 2; e++)
+            {
+                for (uint32 first=0; first < count; first += batchSize)
+                {
+                    // every gradient comes from the weights before this step's update
+                    std::vector<column> total(numLayers);
+                    for (uint32 l=1; l < numLayers; l++)
+                    {
+                        total[l].assign(moment1[l].size(), 0);
+                        for (uint32 b=first; b < first + batchSize; b++)
+                        {
+                            const column g = sampleGradients(copy, l, inputs[b], targets[b]);
+                            for (size_t i=0; i < g.size(); i++)
+                                total[l][i] += g[i] / batchSize;
+                        }
+                    }
+
+                    t++;
+                    for (uint32 l=1; l < numLayers; l++)
+                    {
+                        layer& current = *copy.layers[l];
+                        for (size_t i=0; i < total[l].size(); i++)
+                        {
+                            const bool bias = i < current.numNeurons;
+                            const size_t n = bias ? i : (i - current.numNeurons) / current.numInputs;
+                            real& w = bias ? current.biases[uint32(i)] : current.weights[uint32(n)][uint32((i - current.numNeurons) % current.numInputs)];
+                            referenceStep(o, rate, t, !bias, w, moment1[l][i], moment2[l][i], total[l][i]);
+                        }
+                    }
+                }
+            }
+
+            if (trained.optimizerSteps != t || !sameWeights(trained, copy, 100 * Rounding))
+                return false;
+        }
+    }
+
+    // SetOptimizer starts again from no moments
+    model m;
+    layer* l = m.AddInputLayer(2);
+    m.AddDenseLayer(2, ActivationFunction::Sigmoid, l);
+    optimizer adam;
+    adam.kind = OptimizerKind::Adam;
+    m.SetOptimizer(adam);
+    m.Train({seedsDataset[0]}, {seedsOutputs[0]}, 1, rate);
+    m.SetOptimizer(adam);
+    return m.optimizerSteps == 0 && m.layers[1]->numMoments == 0;
+}
+
+// ------------------------------ gemm test ------------------------------
+
+bool gemmProducts()
+{
+    // the blocked product matches the textbook triple loop at every kernel level, for
+    // each way round the inputs can be stored, at sizes that leave partial tiles and
+    // blocks at every level, both overwriting and adding to c. the epilogue sees every
+    // value of c once, at its place in c, after its sum is complete.
+    const KernelLevel best = detectKernelLevel();
+    const uint32 sizes[][3] = { {1, 1, 1}, {7, 5, 3}, {13, 33, 70}, {64, 200, 150}, {300, 45, 700}, {9, 1100, 20} };
+
+    srand(31337);
+    bool ok = true;
+    for (short level = 0; level <= short(best) && ok; level++)
+    {
+        setKernelLevel(KernelLevel(level));
+        for (const auto& size : sizes)
+        {
+            const uint32 m = size[0], n = size[1], k = size[2];
+            for (uint32 variant=0; variant < 16 && ok; variant++)
+            {
+                const bool transposeA = variant & 1;
+                const bool transposeB = variant & 2;
+                const bool accumulate = variant & 4;
+                const bool withEpilogue = variant & 8;
+
+                // stored with padded rows, as the layers store them
+                auto stored = [](uint32 rows, uint32 cols, std::vector<real>& values)
+                {
+                    const uint32 stride = cols + 3;
+                    values.resize(size_t(rows) * stride);
+                    for (real& v : values) v = (rand() % 2000) * 0.001 - 1;
+                    return matrixView(values.data(), rows, cols, stride);
+                };
+                std::vector<real> aValues, bValues, cValues;
+                const matrixView a = transposeA ? stored(k, m, aValues) : stored(m, k, aValues);
+                const matrixView b = transposeB ? stored(n, k, bValues) : stored(k, n, bValues);
+                const matrixView c = stored(m, n, cValues);
+
+                std::vector<double> expected(size_t(m) * n);
+                for (uint32 i=0; i < m; i++)
+                {
+                    for (uint32 j=0; j < n; j++)
+                    {
+                        double sum = accumulate ? c[i][j] : 0;
+                        for (uint32 p=0; p < k; p++)
+                            sum += (transposeA ? a[p][i] : a[i][p]) * (transposeB ? b[j][p] : b[p][j]);
+                        expected[size_t(i) * n + j] = withEpilogue ? sum * sum + 0.5 * i - 0.25 * j : sum;
+                    }
+                }
+
+                gemmEpilogue epilogue;
+                if (withEpilogue)
+                {
+                    epilogue.fn = [](void*, matrixView tile, uint32 row, uint32 col)
+                    {
+                        for (uint32 r=0; r < tile.rows; r++)
+                        {
+                            for (uint32 j=0; j < tile.cols; j++)
+                                tile[r][j] = tile[r][j] * tile[r][j] + 0.5 * (row + r) - 0.25 * (col + j);
+                        }
+                    };
+                }
+                gemm(a, transposeA, b, transposeB, c, accumulate, columnView(), epilogue);
+                for (uint32 i=0; i < m && ok; i++)
+                {
+                    for (uint32 j=0; j < n && ok; j++)
+                    {
+                        // squaring in the epilogue scales the rounding up with the value
+                        const double want = expected[size_t(i) * n + j];
+                        const double scale = withEpilogue ? std::max(1.0, fabs(want)) : 1.0;
+                        ok = fabs(c[i][j] - want) <= Rounding * std::max(1.0, double(k)) * scale;
+                    }
+                }
+            }
+        }
+        if (ok)
+            printf("gemm: %s matches the reference\n", activeKernels().name);
+    }
+    setKernelLevel(best);
+    return ok;
+}
+
+bool gemmTuningCache()
+{
+    // tuned products match the untuned ones, the winners go into the cache and are read
+    // back rather than timed again, another cpu's lines are ignored, and once a shape is
+    // tuned its products don't allocate. the packs only grow while tuning is on.
+    const char* cacheName = "test_gemm_tuning.txt";
+    remove(cacheName);
+
+    const uint32 m = 40, n = 70, k = 90;
+    std::vector<real> aValues(size_t(m) * k), bValues(size_t(k) * n), expectedValues(size_t(m) * n), cValues(size_t(m) * n);
+    srand(4242);
+    for (real& v : aValues) v = (rand() % 2000) * 0.001 - 1;
+    for (real& v : bValues) v = (rand() % 2000) * 0.001 - 1;
+    const matrixView a(aValues.data(), m, k, k);
+    const matrixView b(bValues.data(), k, n, n);
+    const matrixView expected(expectedValues.data(), m, n, n);
+    const matrixView c(cValues.data(), m, n, n);
+    gemm(a, false, b, false, expected, false);
+
+    auto matches = [&]()
+    {
+        for (uint32 i=0; i < m; i++)
+        {
+            for (uint32 j=0; j < n; j++)
+            {
+                if (fabs(c[i][j] - expected[i][j]) > Rounding * k)
+                    return false;
+            }
+        }
+        return true;
+    };
+    auto cacheLines = [&]()
+    {
+        uint32 lines = 0;
+        char line[512];
+        FILE* fp = fopen(cacheName, "r");
+        while (fp && fgets(line, sizeof(line), fp))
+            lines += strncmp(line, "gemm ", 5) == 0;
+        if (fp)
+            fclose(fp);
+        return lines;
+    };
+
+    const size_t untunedPack = gemmPackSize(n);
+    bool ok = setGemmTuning(true, cacheName) && gemmPackSize(n) >= untunedPack;
+    const uint32 tuned = gemmShapesTuned();
+    gemm(a, false, b, false, c, false);
+    ok = ok && matches() && gemmShapesTuned() == tuned + 1 && cacheLines() == 1;
+    gemm(b, true, a, true, matrixView(cValues.data(), n, m, m), false);
+    ok = ok && gemmShapesTuned() == tuned + 2 && cacheLines() == 2;
+
+    // the first line's plan again, from another cpu for a shape this one hasn't tuned
+    char type[16];
+    unsigned ceiling, plan[4];
+    FILE* fp = fopen(cacheName, "r");
+    ok = ok && fp && fscanf(fp, "%*[^\n]\ngemm %15s %u %*u %*u %*u %*u %*u %u %u %u %u", type, &ceiling,
+        &plan[0], &plan[1], &plan[2], &plan[3]) == 6;
+    if (fp)
+        fclose(fp);
+    fp = fopen(cacheName, "a");
+    ok = ok && fp;
+    if (fp)
+    {
+        fprintf(fp, "gemm %s %u %u %u %u 0 1 %u %u %u %u some other cpu\n", type, ceiling, m, m, k,
+            plan[0], plan[1], plan[2], plan[3]);
+        fclose(fp);
+    }
+
+    // reading the cache back, the shapes tuned here aren't timed again but the other
+    // cpu's one is
+    ok = ok && setGemmTuning(true, cacheName);
+    gemm(a, false, b, false, c, false);
+    ok = ok && matches() && gemmShapesTuned() == tuned + 2;
+    std::vector<real> squareValues(size_t(m) * m);
+    const matrixView square(squareValues.data(), m, m, m);
+    gemm(a, false, a, true, square, false);
+    ok = ok && gemmShapesTuned() == tuned + 3 && cacheLines() == 4;
+
+    alignedArray<real> pack(gemmPackSize(n));
+    const uint64 before = allocationCount;
+    gemm(a, false, b, false, c, true, columnView(pack.data(), uint32(pack.size())));
+    ok = ok && allocationCount == before;
+
+    // other threads take the plan this one tuned
+    threadPool pool;
+    pool.SetNumThreads(3);
+    std::vector<real> threadValues(size_t(3) * m * n);
+    pool.Run(3, [&](uint32 t)
+    {
+        gemm(a, false, b, false, matrixView(threadValues.data() + size_t(t) * m * n, m, n, n), false);
+    });
+    ok = ok && gemmShapesTuned() == tuned + 3;
+    for (size_t i=0; i < threadValues.size() && ok; i++)
+        ok = fabs(threadValues[i] - expectedValues[i % (size_t(m) * n)]) <= Rounding * k;
+
+    setGemmTuning(false);
+    ok = ok && gemmPackSize(n) == untunedPack;
+    remove(cacheName);
+    return ok;
+}
+
+// ------------------------------ kernels test ------------------------------
+
+bool kernels()
+{
+    // every instruction set this cpu supports gives the same results as the scalar
+    // reference, across lengths that exercise the unrolled loops and the tails
+    const kernelTable& reference = *scalarKernelTable();
+    const uint32 maxCount = 75;
+
+    srand(20202);
+    column x[4], w(maxCount), y(maxCount);
+    for (auto&& c : x)
+    {
+        c.resize(maxCount);
+        for (real& v : c) v = (rand() % 2000) * 0.001 - 1;
+    }
+    for (real& v : w) v = (rand() % 2000) * 0.001 - 1;
+    for (real& v : y) v = (rand() % 2000) * 0.001 - 1;
+    uint8 planes[3 * maxCount];
+    for (uint8& v : planes) v = uint8(rand());
+
+    for (short level = short(KernelLevel::SSE2); level <= short(detectKernelLevel()); level++)
+    {
+        const kernelTable& k = kernelsFor(KernelLevel(level));
+        for (uint32 count=0; count <= maxCount; count++)
+        {
+            if (fabs(k.dot(w.data(), x[0].data(), count) - reference.dot(w.data(), x[0].data(), count)) > Rounding)
+                return false;
+
+            column a = y, b = y;
+            k.axpy(a.data(), x[1].data(), -0.37, count);
+            reference.axpy(b.data(), x[1].data(), -0.37, count);
+            for (uint32 i=0; i < maxCount; i++)
+            {
+                if (fabs(a[i] - b[i]) > Rounding)
+                    return false;
+            }
+
+            column c(3 * maxCount + 1, -1), d(3 * maxCount + 1, -1);
+            k.interleave3(c.data(), planes, planes + maxCount, planes + 2*maxCount, 1.0 / 255, count);
+            reference.interleave3(d.data(), planes, planes + maxCount, planes + 2*maxCount, 1.0 / 255, count);
+            if (c != d)
+                return false;
+
+            // two optimizer steps each, so the moments carry from one to the next
+            const optimizerStep step = { 0.05, 0.9, 0.9, 0.999, 1 / (1 - 0.81), 1 / (1 - 0.998001), 1e-8, 0.01, 0.002, (count & 1) != 0 };
+            column wa = y, wb = y, ma(maxCount, 0.1), mb = ma, va(maxCount, 0.2), vb = va;
+            for (uint32 s=0; s < 2; s++)
+            {
+                k.momentumStep(wa.data(), ma.data(), x[2].data(), 0.5, step, count);
+                reference.momentumStep(wb.data(), mb.data(), x[2].data(), 0.5, step, count);
+                k.adamStep(wa.data(), ma.data(), va.data(), x[3].data(), 0.5, step, count);
+                reference.adamStep(wb.data(), mb.data(), vb.data(), x[3].data(), 0.5, step, count);
+            }
+            for (uint32 i=0; i < maxCount; i++)
+            {
+                if (fabs(wa[i] - wb[i]) > Rounding || fabs(ma[i] - mb[i]) > Rounding || fabs(va[i] - vb[i]) > Rounding)
+                    return false;
+            }
+
+            // with a repeated largest value, so the first of them has to be the one found
+            column scores(x[0].begin(), x[0].begin() + count);
+            if (count > 2)
+                scores[count - 1] = scores[count / 2] = *std::max_element(scores.begin(), scores.end());
+            if (k.argmax(scores.data(), count) != reference.argmax(scores.data(), count))
+                return false;
+            for (uint32 i=0; i < count; i++)
+            {
+                if (k.countGreater(scores.data(), scores[i], count) != reference.countGreater(scores.data(), scores[i], count))
+                    return false;
+            }
+        }
+        printf("kernels: %s matches %s\n", k.name, reference.name);
+    }
+
+    // the int8 dot products are exact, so every level must match to the last bit.
+    // long enough for the widest unrolled loop and its tails.
+    const uint32 maxBytes = 300;
+    uint8 activations8[maxBytes];
+    int8 weights8[maxBytes];
+    for (uint8& v : activations8) v = uint8(rand());
+    for (int8& v : weights8) v = int8(rand() % 255 - 127);
+    activations8[0] = 255;
+    weights8[0] = -127;
+
+    const int8KernelTable& reference8 = *scalarInt8KernelTable();
+    for (short level = short(KernelLevel::SSE2); level <= short(detectKernelLevel()); level++)
+    {
+        const int8KernelTable& k = int8KernelsFor(KernelLevel(level));
+        for (uint32 count=0; count <= maxBytes; count++)
+        {
+            if (k.dot(activations8, weights8, count) != reference8.dot(activations8, weights8, count))
+                return false;
+        }
+        printf("kernels: int8 %s matches %s\n", k.name, reference8.name);
+    }
+    return true;
+}
+
 void check(const char* name, const int result)
 {
     printf("TEST: [%-12s] %s\n", name, result ? "success" : "fail");
@@ -346,6 +2132,32 @@ int main(int, char**)
     //check("backwards", backwards());
     check("numbers", numbers());
     //check("seeds", seeds());
+    check("batches", batches());
+    check("kernels", kernels());
+    check("gemm", gemmProducts());
+    check("gemm tuning", gemmTuningCache());
+    // central differences need double's precision
+    if (DoublePrecision)
+    {
+        check("gradientCheck", gradientCheck());
+        check("convolution", convolution());
+    }
+    check("optimizers", optimizers());
+    check("threads", threads());
+    check("threadPool", threadPoolRuns());
+    check("initialization", initialization());
+    check("backgroundTraining", backgroundTraining());
+    check("predictBatch", predictBatch());
+    check("evaluate", evaluate());
+    check("softmaxCrossEntropy", softmaxCrossEntropy());
+    check("allocations", allocations());
+    check("sparseInputs", sparseInputs());
+    check("tensorFiles", tensorFiles());
+    check("imageSets", imageSets());
+    check("saveLoad", saveLoad());
+    check("quantized", quantized());
+    check("staticModels", staticModels());
+    check("tracing", tracing());
     printf("tests end\n");
     return 1;
 }
\ No newline at end of file
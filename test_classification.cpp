@@ -1,4 +1,7 @@
 #include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 
 #include "model.h"
 
@@ -104,7 +107,7 @@ bool numbersClassification()
     layer* l = m.AddInputLayer(1);
     l = m.AddDenseLayer(2, ActivationFunction::Sigmoid, l);
     //l = m.AddDenseLayer(2, ActivationFunction::Sigmoid, l);
-    l = m.AddDenseLayer(numNumbers, ActivationFunction::Softmax, l);
+    l = m.AddSoftmaxCrossEntropyLayer(numNumbers, l);
 
     for (uint32 i=0; i < 10; i++)
     {
@@ -0,0 +1,120 @@
+#include <algorithm>
+
+#include "threads.h"
+
+threadPool::threadPool()
+{
+}
+
+threadPool::~threadPool()
+{
+    Stop();
+}
+
+void threadPool::SetNumThreads(uint32 numThreads)
+{
+    if (numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    if (numThreads == NumThreads())
+        return;
+
+    Stop();
+
+    stopping = false;
+    workers.reserve(numThreads - 1);
+    for (uint32 t=1; t < numThreads; t++)
+        workers.emplace_back(&threadPool::WorkerLoop, this);
+}
+
+void threadPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread& t : workers)
+        t.join();
+    workers.clear();
+}
+
+void threadPool::Run(uint32 numTasks, void (*fn)(void*, uint32), void* context)
+{
+    if (workers.empty() || numTasks <= 1)
+    {
+        for (uint32 i=0; i < numTasks; i++)
+            fn(context, i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobFn = fn;
+        jobContext = context;
+        jobTasks = numTasks;
+        generation++;
+        nextTask = generation << 32;
+        remainingTasks = numTasks;
+    }
+    wake.notify_all();
+
+    RunTasks(fn, context, numTasks, generation);
+
+    // wait for the other tasks, and for every worker to have left this loop
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return remainingTasks == 0 && busyWorkers == 0; });
+}
+
+// takes indices only while nextTask still belongs to job, so a worker that wakes after
+// its loop has finished, and another has started, leaves the new one's tasks alone
+void threadPool::RunTasks(void (*fn)(void*, uint32), void* context, uint32 numTasks, uint64 job)
+{
+    const uint64 tag = job << 32;
+    uint64 next = nextTask.load();
+    for (;;)
+    {
+        if ((next & ~uint64(0xffffffff)) != tag || uint32(next) >= numTasks)
+            return;
+        if (!nextTask.compare_exchange_weak(next, next + 1))
+            continue;
+
+        fn(context, uint32(next));
+        remainingTasks--;
+        next = nextTask.load();
+    }
+}
+
+void threadPool::WorkerLoop()
+{
+    uint64 seen = 0;
+    for (;;)
+    {
+        void (*fn)(void*, uint32);
+        void* context;
+        uint32 numTasks;
+        uint64 job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this, seen] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+
+            seen = generation;
+            fn = jobFn;
+            context = jobContext;
+            numTasks = jobTasks;
+            job = seen;
+            busyWorkers++;
+        }
+
+        RunTasks(fn, context, numTasks, job);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyWorkers--;
+        }
+        finished.notify_all();
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "utils.h"
+
+// a fixed set of worker threads that run the tasks of one parallel loop at a time.
+// the calling thread takes part in every loop, so a pool of n threads keeps n-1 workers.
+// running a loop doesn't allocate, so it can be used on the training hot path.
+class threadPool
+{
+  public:
+    threadPool();
+    ~threadPool();
+
+    threadPool(const threadPool&) = delete;
+    threadPool& operator=(const threadPool&) = delete;
+
+    // 0 uses one thread per hardware thread
+    void SetNumThreads(uint32 numThreads);
+    uint32 NumThreads() const { return uint32(workers.size()) + 1; }
+
+    // calls task(i) for every i in [0, numTasks) and waits for them all to finish.
+    // tasks are handed out in no particular order, so each one must only write
+    // to state that belongs to its index.
+    template <typename F>
+    void Run(uint32 numTasks, F&& task)
+    {
+        using callable = std::remove_reference_t<F>;
+        Run(numTasks, [](void* context, uint32 i) { (*static_cast<callable*>(context))(i); }, &task);
+    }
+
+    void Run(uint32 numTasks, void (*fn)(void*, uint32), void* context);
+
+  private:
+    void WorkerLoop();
+    void RunTasks(void (*fn)(void*, uint32), void* context, uint32 numTasks, uint64 job);
+    void Stop();
+
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    // the current loop, guarded by mutex
+    void (*jobFn)(void*, uint32) = nullptr;
+    void* jobContext = nullptr;
+    uint32 jobTasks = 0;
+    uint64 generation = 0;
+    uint32 busyWorkers = 0;
+    bool stopping = false;
+
+    // the next task index in the low half, and the generation it belongs to in the high
+    // half, so a worker still holding a finished loop can't take an index of the next one
+    std::atomic<uint64> nextTask{0};
+    std::atomic<uint32> remainingTasks{0};
+};
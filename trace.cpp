@@ -0,0 +1,150 @@
+#include <chrono>
+#include <cstdio>
+
+#include "trace.h"
+
+#pragma warning( disable : 4996 )
+
+#if defined(AGAIN_TRACE)
+
+// ------------------------------- recording -------------------------------
+
+// events kept per thread, a power of two
+const uint32 TraceCapacity = 1 << 14;
+
+struct traceEvent
+{
+    const char* name;
+    int32 index;
+    std::uint64_t start;
+    std::uint64_t end;
+};
+
+// only its own thread writes to a buffer. head counts every event it has ever recorded,
+// and is published after the event is written.
+struct traceBuffer
+{
+    traceEvent events[TraceCapacity];
+    std::atomic<std::uint64_t> head{0};
+    uint32 thread = 0;
+    traceBuffer* next = nullptr;
+};
+
+std::atomic<bool> tracingEnabled{false};
+
+// every thread's buffer, pushed on the first time it records. they are never freed,
+// so writeTrace can read the events of threads that have finished.
+static std::atomic<traceBuffer*> traceBuffers{nullptr};
+static std::atomic<uint32> traceThreads{0};
+
+// when tracing was last enabled, in ticks and in steady time, to turn ticks into time
+static std::uint64_t traceStartTicks = 0;
+static std::chrono::steady_clock::time_point traceStartTime;
+
+static traceBuffer* threadTraceBuffer()
+{
+    thread_local traceBuffer* buffer = nullptr;
+    if (!buffer)
+    {
+        buffer = new traceBuffer();
+        buffer->thread = traceThreads++;
+        buffer->next = traceBuffers.load();
+        while (!traceBuffers.compare_exchange_weak(buffer->next, buffer))
+        {
+        }
+    }
+    return buffer;
+}
+
+void recordTrace(const char* name, int32 index, std::uint64_t start, std::uint64_t end)
+{
+    traceBuffer* buffer = threadTraceBuffer();
+    const std::uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    buffer->events[head & (TraceCapacity - 1)] = { name, index, start, end };
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void setTracing(bool enabled)
+{
+    if (enabled && !tracingEnabled)
+    {
+        traceStartTime = std::chrono::steady_clock::now();
+        traceStartTicks = traceNow();
+    }
+    tracingEnabled = enabled;
+}
+
+// ------------------------------- writing -------------------------------
+
+// ticks per microsecond, measured against the steady clock since tracing was enabled
+static double traceTicksPerMicrosecond()
+{
+#if defined(AGAIN_TRACE_TSC)
+    // at least a few milliseconds between the two readings, for a stable rate
+    std::chrono::steady_clock::time_point now;
+    std::uint64_t ticks;
+    do
+    {
+        now = std::chrono::steady_clock::now();
+        ticks = traceNow();
+    } while (now - traceStartTime < std::chrono::milliseconds(5));
+
+    const double microseconds = std::chrono::duration<double, std::micro>(now - traceStartTime).count();
+    return double(ticks - traceStartTicks) / microseconds;
+#else
+    return 1000;
+#endif
+}
+
+bool writeTrace(const char* filename)
+{
+    FILE* fp = fopen(filename, "w");
+    if (!fp)
+        return false;
+
+    const double ticksPerMicrosecond = traceTicksPerMicrosecond();
+
+    fprintf(fp, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    bool first = true;
+    for (const traceBuffer* buffer = traceBuffers.load(); buffer; buffer = buffer->next)
+    {
+        fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"thread %u\"}}",
+            first ? "" : ",\n", buffer->thread, buffer->thread);
+        first = false;
+
+        // the newest events, oldest first, that were recorded since tracing was enabled
+        const std::uint64_t head = buffer->head.load(std::memory_order_acquire);
+        const std::uint64_t begin = (head > TraceCapacity) ? head - TraceCapacity : 0;
+        for (std::uint64_t i = begin; i < head; i++)
+        {
+            const traceEvent& e = buffer->events[i & (TraceCapacity - 1)];
+            if (e.start < traceStartTicks)
+                continue;
+
+            const double ts = double(e.start - traceStartTicks) / ticksPerMicrosecond;
+            const double dur = double(e.end - e.start) / ticksPerMicrosecond;
+            if (e.index >= 0)
+                fprintf(fp, ",\n{\"name\": \"%s %d\", \"cat\": \"again\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"layer\": %d}}",
+                    e.name, e.index, buffer->thread, ts, dur, e.index);
+            else
+                fprintf(fp, ",\n{\"name\": \"%s\", \"cat\": \"again\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+                    e.name, buffer->thread, ts, dur);
+        }
+    }
+    fprintf(fp, "\n]}\n");
+
+    return fclose(fp) == 0;
+}
+
+#else
+
+void setTracing(bool)
+{
+}
+
+bool writeTrace(const char*)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "utils.h"
+
+#if defined(AGAIN_TRACE)
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define AGAIN_TRACE_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define AGAIN_TRACE_TSC 1
+#endif
+#endif
+
+// ------------------------------- tracing -------------------------------
+
+// scoped timers around the passes, layers and loaders, written out as chrome trace json
+// for chrome://tracing or ui.perfetto.dev. built in with AGAIN_TRACE and off until
+// setTracing(true), when each scope costs one relaxed load and a branch. without
+// AGAIN_TRACE the scopes compile to nothing.
+//
+// each thread records into a ring of its own, so recording never takes a lock and a
+// long run keeps its most recent events. names must be string literals.
+
+void setTracing(bool enabled);
+
+// writes the events recorded since tracing was enabled. the threads being traced
+// should be idle, e.g. between epochs, or events still being written may be torn.
+bool writeTrace(const char* filename);
+
+#if defined(AGAIN_TRACE)
+
+extern std::atomic<bool> tracingEnabled;
+
+// a timestamp in cpu ticks where there is a cheap counter, otherwise nanoseconds
+inline std::uint64_t traceNow()
+{
+#if defined(AGAIN_TRACE_TSC)
+    return __rdtsc();
+#else
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// index is a layer number, or -1
+void recordTrace(const char* name, int32 index, std::uint64_t start, std::uint64_t end);
+
+class traceScope
+{
+  public:
+    traceScope(const char* name, int32 index = -1)
+        : name(name)
+        , index(index)
+        , start(tracingEnabled.load(std::memory_order_relaxed) ? traceNow() : 0)
+    {
+    }
+
+    ~traceScope()
+    {
+        if (start)
+            recordTrace(name, index, start, traceNow());
+    }
+
+    traceScope(const traceScope&) = delete;
+    traceScope& operator=(const traceScope&) = delete;
+
+  private:
+    const char* name;
+    int32 index;
+    std::uint64_t start;
+};
+
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+#define TRACE_SCOPE(name) traceScope TRACE_JOIN(traceScope_, __LINE__)(name)
+#define TRACE_LAYER(name, index) traceScope TRACE_JOIN(traceScope_, __LINE__)(name, int32(index))
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_LAYER(name, index)
+
+#endif
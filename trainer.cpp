@@ -0,0 +1,69 @@
+#include <cassert>
+
+#include "trace.h"
+#include "trainer.h"
+
+// ------------------------------- backgroundTrainer -------------------------------
+
+backgroundTrainer::~backgroundTrainer()
+{
+    Stop();
+}
+
+void backgroundTrainer::Start(model& m, std::function<void(model&)> newRound)
+{
+    Stop();
+    trained = &m;
+    round = std::move(newRound);
+
+    // every snapshot starts as the untrained model, with the middle one handed to the reader
+    for (model& snapshot : snapshots)
+    {
+        const bool copied = snapshot.CopyFrom(m);
+        assert(copied);
+        (void)copied;
+    }
+    writing = 0;
+    reading = 1;
+    middle.store(2 | FreshBit, std::memory_order_release);
+
+    stopping.store(false, std::memory_order_relaxed);
+    rounds.store(0, std::memory_order_relaxed);
+    thread = std::thread(&backgroundTrainer::Run, this);
+}
+
+void backgroundTrainer::Stop()
+{
+    if (!thread.joinable())
+        return;
+
+    stopping.store(true, std::memory_order_relaxed);
+    thread.join();
+}
+
+void backgroundTrainer::Run()
+{
+    while (!stopping.load(std::memory_order_relaxed))
+    {
+        round(*trained);
+        Publish();
+        rounds.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void backgroundTrainer::Publish()
+{
+    TRACE_SCOPE("publish snapshot");
+    snapshots[writing].CopyFrom(*trained);
+
+    // the release makes the copy visible to the reader that picks this index up, and
+    // whichever snapshot was in the middle, taken or not, is the next one written
+    writing = middle.exchange(writing | FreshBit, std::memory_order_acq_rel) & ~FreshBit;
+}
+
+model& backgroundTrainer::Latest()
+{
+    if (middle.load(std::memory_order_relaxed) & FreshBit)
+        reading = middle.exchange(reading, std::memory_order_acq_rel) & ~FreshBit;
+    return snapshots[reading];
+}
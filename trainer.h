@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "model.h"
+
+// ------------------------------- backgroundTrainer -------------------------------
+
+// trains a model on a thread of its own, and after every round of training publishes a
+// snapshot of it for one other thread, such as a render loop, to predict from. the
+// snapshots are a triple buffer: the trainer copies into one while the reader holds
+// another, and the third is the newest whole one, swapped between them with a single
+// atomic exchange. neither side ever waits on the other, so drawing doesn't slow
+// training down, and a long round doesn't hold up the frames.
+class backgroundTrainer
+{
+  public:
+    backgroundTrainer() {}
+    ~backgroundTrainer();
+
+    backgroundTrainer(const backgroundTrainer&) = delete;
+    backgroundTrainer& operator=(const backgroundTrainer&) = delete;
+
+    // runs round(m) over and over on the training thread, publishing a snapshot after
+    // each one. m belongs to that thread until Stop returns. the snapshots are made here,
+    // so publishing them never allocates, and Latest has one to hand back straight away.
+    void Start(model& m, std::function<void(model&)> round);
+
+    // lets the current round finish, publishes it, and waits for the thread to end
+    void Stop();
+
+    bool Running() const { return thread.joinable(); }
+
+    // the newest published snapshot. the reader may predict with it, which writes to its
+    // workspaces, and it doesn't change until the next call to Latest. only one thread
+    // may call this, and only between Start and the trainer being destroyed.
+    model& Latest();
+
+    // rounds finished since Start
+    uint64 Rounds() const { return rounds.load(std::memory_order_relaxed); }
+
+  private:
+    void Run();
+    void Publish();
+
+    // set on the index in middle when it holds a snapshot the reader hasn't taken yet
+    static const uint32 FreshBit = 4;
+
+    model snapshots[3];
+    uint32 writing = 0;                 // only touched by the training thread
+    uint32 reading = 1;                 // only touched by the reader
+    std::atomic<uint32> middle{2};
+
+    model* trained = nullptr;
+    std::function<void(model&)> round;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64> rounds{0};
+};
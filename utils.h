@@ -1,10 +1,24 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <type_traits>
 #include <vector>
 
-typedef std::vector<double> column;
+// the scalar type models train and predict with. build with AGAIN_FLOAT to use float
+// throughout, which halves the memory traffic and doubles the simd width.
+#if defined(AGAIN_FLOAT)
+typedef float real;
+#else
+typedef double real;
+#endif
+
+typedef std::vector<real> column;
 typedef std::vector<column> matrix;
 
 using uint8 = unsigned char;
-using int8 = char;
+using int8 = signed char;
 using uint16 = unsigned short;
 using int16 = short;
 using uint32 = unsigned int;
@@ -12,5 +26,142 @@ using int32 = int;
 using uint64 = unsigned long;
 using int64 = long;
 
-int argmax(const column& values);
+// ------------------------------- views -------------------------------
+
+// non-owning view over a contiguous run of values
+template <typename T>
+struct span
+{
+    span() : ptr(nullptr), count(0) {}
+    span(T* ptr, uint32 count) : ptr(ptr), count(count) {}
+
+    span(std::vector<std::remove_const_t<T>>& values)
+        : ptr(values.data()), count(uint32(values.size())) {}
+
+    template <typename U = T, typename = std::enable_if_t<std::is_const_v<U>>>
+    span(const std::vector<std::remove_const_t<T>>& values)
+        : ptr(values.data()), count(uint32(values.size())) {}
+
+    // a view of mutable values can always be used as a view of const values
+    template <typename U, typename = std::enable_if_t<std::is_same_v<const U, T>>>
+    span(const span<U>& other) : ptr(other.ptr), count(other.count) {}
+
+    T& operator[](uint32 i) const { assert(i < count); return ptr[i]; }
+
+    T* data() const { return ptr; }
+    uint32 size() const { return count; }
+    bool empty() const { return count == 0; }
+    T* begin() const { return ptr; }
+    T* end() const { return ptr + count; }
+
+    T* ptr;
+    uint32 count;
+};
+
+// non-owning row-major 2D view. stride is the distance between the start of each row,
+// which may be larger than cols when rows are padded out to cache line boundaries.
+template <typename T>
+struct span2d
+{
+    span2d() : ptr(nullptr), rows(0), cols(0), stride(0) {}
+    span2d(T* ptr, uint32 rows, uint32 cols, uint32 stride)
+        : ptr(ptr), rows(rows), cols(cols), stride(stride) {}
+
+    template <typename U, typename = std::enable_if_t<std::is_same_v<const U, T>>>
+    span2d(const span2d<U>& other)
+        : ptr(other.ptr), rows(other.rows), cols(other.cols), stride(other.stride) {}
+
+    span<T> operator[](uint32 r) const { assert(r < rows); return span<T>(ptr + size_t(r) * stride, cols); }
+
+    // view of count rows starting at row first
+    span2d<T> subRows(uint32 first, uint32 count) const
+    {
+        assert(first + count <= rows);
+        return span2d<T>(ptr + size_t(first) * stride, count, cols, stride);
+    }
+
+    T* data() const { return ptr; }
+    bool empty() const { return rows == 0 || cols == 0; }
+
+    T* ptr;
+    uint32 rows;
+    uint32 cols;
+    uint32 stride;
+};
+
+using columnView = span<real>;
+using constColumnView = span<const real>;
+using matrixView = span2d<real>;
+using constMatrixView = span2d<const real>;
+
+// ------------------------------- aligned storage -------------------------------
+
+const uint32 CacheLineSize = 64;
+
+// rounds a count of T up so that the next value after it starts on a cache line
+template <typename T>
+constexpr uint32 alignedCount(uint32 count)
+{
+    const uint32 perLine = CacheLineSize / sizeof(T);
+    return (count + perLine - 1) / perLine * perLine;
+}
+
+// owning, cache line aligned, zero initialized block of values. move-only.
+template <typename T>
+struct alignedArray
+{
+    alignedArray() : ptr(nullptr), count(0) {}
+    explicit alignedArray(size_t count) : ptr(nullptr), count(0) { Allocate(count); }
+    ~alignedArray() { Free(); }
+
+    alignedArray(const alignedArray&) = delete;
+    alignedArray& operator=(const alignedArray&) = delete;
+
+    alignedArray(alignedArray&& other) : ptr(other.ptr), count(other.count)
+    {
+        other.ptr = nullptr;
+        other.count = 0;
+    }
+
+    alignedArray& operator=(alignedArray&& other)
+    {
+        if (this != &other)
+        {
+            Free();
+            ptr = other.ptr;
+            count = other.count;
+            other.ptr = nullptr;
+            other.count = 0;
+        }
+        return *this;
+    }
+
+    void Allocate(size_t newCount)
+    {
+        Free();
+        if (newCount == 0)
+            return;
+
+        ptr = static_cast<T*>(::operator new(newCount * sizeof(T), std::align_val_t(CacheLineSize)));
+        count = newCount;
+        for (size_t i=0; i < count; i++)
+            ptr[i] = T();
+    }
+
+    void Free()
+    {
+        if (ptr)
+            ::operator delete(ptr, std::align_val_t(CacheLineSize));
+        ptr = nullptr;
+        count = 0;
+    }
+
+    T* data() const { return ptr; }
+    size_t size() const { return count; }
+
+    T* ptr;
+    size_t count;
+};
+
+int argmax(constColumnView values);
 column softmax(const column& inputs);